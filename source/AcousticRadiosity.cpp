@@ -0,0 +1,213 @@
+#include "AcousticRadiosity.h"
+
+/**
+ * Computes the form factors between all pairs of patches that can see each other.
+ * The form factor from patch i to patch j is approximated by
+ * @code
+ * F_ij = cos(theta_i) * cos(theta_j) * A_j / (pi * r^2 + A_j)
+ * @endcode
+ * which stays finite for neighboring patches. Form factors leaving a patch are normalized to sum up to at most 1.
+ *
+ * @see https://doi.org/10.1109/TASL.2007.908139
+ *
+ * @return False if the computation was cancelled.
+ */
+bool AcousticRadiosity::computeFormFactors(const std::vector<Patch>& roomPatches, float speedOfSoundMpS, float newBinWidthMS, const VisibilityCheck& isVisible, const ProgressCallback& progress)
+{
+    clearFormFactors();
+
+    patches = roomPatches;
+    binWidthMS = newBinWidthMS;
+    links.resize(patches.size());
+
+    double const numPairs = 0.5 * (double) patches.size() * (double) patches.size();
+    double pairsDone = 0.0;
+
+    for (size_t patchA = 0; patchA < patches.size(); patchA++) {
+        if (!progress(pairsDone / numPairs)) {
+            clearFormFactors();
+            return false;
+        }
+
+        const auto& a = patches[patchA];
+
+        for (size_t patchB = patchA + 1; patchB < patches.size(); patchB++) {
+            const auto& b = patches[patchB];
+
+            glm::vec3 edgeAB = b.center - a.center;
+            float distanceSquared = glm::dot(edgeAB, edgeAB);
+
+            if (distanceSquared == 0.0f) {
+                continue;
+            }
+
+            glm::vec3 directionAB = edgeAB / std::sqrt(distanceSquared);
+            float cosineA =  glm::dot(a.normal, directionAB);
+            float cosineB = -glm::dot(b.normal, directionAB);
+
+            // patches have to face each other
+            if (cosineA <= 0.0f || cosineB <= 0.0f) {
+                continue;
+            }
+
+            // both centers lie on a surface, stop just in front of the target so it does not occlude itself
+            if (!isVisible(a.center, b.center + 0.001f * b.normal)) {
+                continue;
+            }
+
+            float const distanceM = std::sqrt(distanceSquared);
+            int const delayBins = jmax(1, (int) std::round(distanceM / speedOfSoundMpS * 1000.0f / binWidthMS));
+            float const geometry = cosineA * cosineB / glm::pi<float>();
+
+            links[patchA].push_back({(int) patchB, geometry * b.area / (distanceSquared + b.area / glm::pi<float>()), delayBins});
+            links[patchB].push_back({(int) patchA, geometry * a.area / (distanceSquared + a.area / glm::pi<float>()), delayBins});
+        }
+
+        pairsDone += (double) (patches.size() - patchA - 1);
+    }
+
+    for (auto& patchLinks : links) {
+        float sum = 0.0f;
+
+        for (const auto& link : patchLinks) {
+            sum += link.formFactor;
+        }
+
+        if (sum > 1.0f) {
+            for (auto& link : patchLinks) {
+                link.formFactor /= sum;
+            }
+        }
+    }
+
+    formFactorsValid = true;
+    return true;
+}
+
+void AcousticRadiosity::clearFormFactors()
+{
+    patches.clear();
+    links.clear();
+    formFactorsValid = false;
+
+    energies.clear();
+    patchHasEnergy.clear();
+    numBins = 0;
+}
+
+bool AcousticRadiosity::hasFormFactors(float forBinWidthMS) const
+{
+    return formFactorsValid && forBinWidthMS == binWidthMS;
+}
+
+juce::int64 AcousticRadiosity::getNumLinks() const
+{
+    juce::int64 numLinks = 0;
+
+    for (const auto& patchLinks : links) {
+        numLinks += (juce::int64) patchLinks.size();
+    }
+
+    return numLinks;
+}
+
+/**
+ * Clears the energy histograms of all patches, each of them covers newNumBins * binWidthMS.
+ */
+void AcousticRadiosity::reset(int newNumBins)
+{
+    numBins = jmax(newNumBins, 1);
+
+    energies.assign(patches.size() * (size_t) numBins * 6, 0.0f);
+    patchHasEnergy.assign(patches.size(), false);
+}
+
+/**
+ * Adds energy that leaves the patch after the given delay, e.g. the diffusely reflected part of a traced ray.
+ */
+void AcousticRadiosity::inject(int patch, float delayMS, Band6Coefficients energy)
+{
+    if (patch < 0 || patch >= (int) patches.size()) {
+        return;
+    }
+
+    int const bin = (int) (delayMS / binWidthMS);
+
+    if (bin < 0 || bin >= numBins) {
+        return;
+    }
+
+    float* binEnergies = &energies[getIndex(patch, bin)];
+
+    for (int band = 0; band < 6; band++) {
+        binEnergies[band] += energy[band];
+    }
+
+    patchHasEnergy[(size_t) patch] = true;
+}
+
+/**
+ * Exchanges the energy between the patches, one time bin after the other. Every link delays the energy
+ * by at least one bin, so all energy leaving a patch during a bin is known once the bin is reached.
+ *
+ * @param reflectances  Fraction of the incoming energy that every patch reflects, per band.
+ * @return False if the propagation was cancelled.
+ */
+bool AcousticRadiosity::propagate(const std::vector<Band6Coefficients>& reflectances, const ProgressCallback& progress)
+{
+    jassert(reflectances.size() == patches.size());
+
+    for (int bin = 0; bin < numBins; bin++) {
+        if (!progress((double) bin / (double) numBins)) {
+            return false;
+        }
+
+        for (size_t patch = 0; patch < patches.size(); patch++) {
+            if (!patchHasEnergy[patch]) {
+                continue;
+            }
+
+            const float* leaving = &energies[getIndex((int) patch, bin)];
+
+            if (*std::max_element(leaving, leaving + 6) < minimumEnergy) {
+                continue;
+            }
+
+            for (const auto& link : links[patch]) {
+                int const targetBin = bin + link.delayBins;
+
+                if (targetBin >= numBins) {
+                    continue;
+                }
+
+                float* arriving = &energies[getIndex(link.target, targetBin)];
+                const auto& reflectance = reflectances[(size_t) link.target];
+
+                for (int band = 0; band < 6; band++) {
+                    arriving[band] += leaving[band] * link.formFactor * reflectance[band];
+                }
+
+                patchHasEnergy[(size_t) link.target] = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool AcousticRadiosity::hasEnergy(int patch) const
+{
+    return patchHasEnergy[(size_t) patch];
+}
+
+Band6Coefficients AcousticRadiosity::getEnergy(int patch, int bin) const
+{
+    Band6Coefficients energy;
+    const float* binEnergies = &energies[getIndex(patch, bin)];
+
+    for (int band = 0; band < 6; band++) {
+        energy[band] = binEnergies[band];
+    }
+
+    return energy;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "CustomDatatypes.h"
+#include "JuceHeader.h"
+#include "glm/glm.hpp"
+#include "glm/gtc/constants.hpp"
+
+/**
+ * Time dependent acoustic radiance transfer between the patches of a room.
+ * Energy leaving a patch is handed on to every patch it can see, weighted by their form factor and
+ * delayed by the propagation time between their centers. All exchanged energy is reflected diffusely.
+ *
+ * Form factors only depend on the geometry and are kept until they are cleared explicitly,
+ * the energy histograms are rebuilt for every set of sources.
+ */
+class AcousticRadiosity
+{
+public:
+    struct Patch {
+        glm::vec3 center;
+        glm::vec3 normal;
+        float area;
+    };
+
+    // returns whether the straight path between two points is unobstructed
+    using VisibilityCheck = std::function<bool(glm::vec3 from, glm::vec3 to)>;
+
+    // receives the progress from 0 to 1, returns false to cancel
+    using ProgressCallback = std::function<bool(double progress)>;
+
+    bool computeFormFactors(const std::vector<Patch>& roomPatches, float speedOfSoundMpS, float newBinWidthMS, const VisibilityCheck& isVisible, const ProgressCallback& progress);
+    void clearFormFactors();
+    bool hasFormFactors(float forBinWidthMS) const;
+
+    void reset(int newNumBins);
+    void inject(int patch, float delayMS, Band6Coefficients energy);
+    bool propagate(const std::vector<Band6Coefficients>& reflectances, const ProgressCallback& progress);
+
+    int getNumPatches() const   { return (int) patches.size(); }
+    int getNumBins() const      { return numBins; }
+    float getBinWidthMS() const { return binWidthMS; }
+    juce::int64 getNumLinks() const;
+
+    const Patch& getPatch(int patch) const { return patches[(size_t) patch]; }
+    bool hasEnergy(int patch) const;
+    Band6Coefficients getEnergy(int patch, int bin) const;
+
+    static constexpr float minimumEnergy = 1.0e-12f;
+
+private:
+    struct Link {
+        int target;
+        float formFactor;
+        int delayBins;
+    };
+
+    std::vector<Patch> patches;
+    std::vector<std::vector<Link>> links;
+    bool formFactorsValid = false;
+
+    float binWidthMS = 0.0f;
+    int numBins = 0;
+
+    // energy leaving each patch, indexed by patch, time bin and band
+    std::vector<float> energies;
+    std::vector<bool> patchHasEnergy;
+
+    size_t getIndex(int patch, int bin) const { return ((size_t) patch * (size_t) numBins + (size_t) bin) * 6; }
+};
@@ -0,0 +1,102 @@
+#include "ConvolutionBenchmark.h"
+
+ConvolutionBenchmark::ConvolutionBenchmark(double sr, juce::Component* componentToCentreAround)
+    : juce::ThreadWithProgressWindow("Convolution Benchmark", true, true, 10000, "Cancel", componentToCentreAround)
+    , sampleRate(sr > 0.0 ? sr : 48000.0)
+{
+}
+
+/**
+ * Exponentially decaying white noise, which falls by 60 dB over the length.
+ */
+juce::AudioBuffer<float> ConvolutionBenchmark::createImpulseResponse(double lengthS, double rate, juce::Random& random)
+{
+    juce::AudioBuffer<float> buffer(numChannels, (int) (lengthS * rate));
+    auto const decayPerSample = std::pow(0.001, 1.0 / buffer.getNumSamples());
+
+    for (int channel = 0; channel < numChannels; channel++) {
+        auto* writePtr = buffer.getWritePointer(channel);
+        double gain = 1.0;
+
+        for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
+            writePtr[sample] = (float) (gain * (random.nextFloat() * 2.0f - 1.0f));
+            gain *= decayPerSample;
+        }
+    }
+
+    return buffer;
+}
+
+void ConvolutionBenchmark::run()
+{
+    const double lengthsS[] = {0.5, 1.0, 2.0, 4.0, 6.0, 8.0, 10.0};
+    auto const numLengths = (int) std::size(lengthsS);
+
+    juce::Random random;
+    juce::AudioBuffer<float> block(numChannels, blockSize);
+
+    results.clear();
+    results.add("Sample rate " + juce::String(sampleRate, 0) + " Hz, blocks of " + juce::String(blockSize) + " samples, "
+                + juce::String(scheduler->getNumWorkers()) + " tail workers");
+
+    for (int lengthNum = 0; lengthNum < numLengths; lengthNum++) {
+        auto const lengthS = lengthsS[lengthNum];
+        setStatusMessage("Convolving with a " + juce::String(lengthS, 1) + " s impulse response...");
+
+        ImpulseResponse impulseResponse{createImpulseResponse(lengthS, sampleRate, random), sampleRate};
+        PartitionedConvolver convolver(impulseResponse, sampleRate, numChannels, true);
+
+        auto const numBlocks = (int) (secondsPerLength * sampleRate / blockSize);
+        auto const blockDurationMS = 1000.0 * blockSize / sampleRate;
+        auto const workerStartS = scheduler->getWorkerTimeSeconds();
+        auto const startMS = juce::Time::getMillisecondCounterHiRes();
+        juce::int64 audioThreadTicks = 0;
+
+        for (int blockNum = 0; blockNum < numBlocks; blockNum++) {
+            if (threadShouldExit()) {
+                return;
+            }
+
+            for (int channel = 0; channel < numChannels; channel++) {
+                auto* writePtr = block.getWritePointer(channel);
+
+                for (int sample = 0; sample < blockSize; sample++) {
+                    writePtr[sample] = random.nextFloat() * 2.0f - 1.0f;
+                }
+            }
+
+            auto const blockStartTicks = juce::Time::getHighResolutionTicks();
+
+            for (int channel = 0; channel < numChannels; channel++) {
+                convolver.process(channel, block.getReadPointer(channel), block.getWritePointer(channel), blockSize);
+            }
+
+            audioThreadTicks += juce::Time::getHighResolutionTicks() - blockStartTicks;
+
+            // wait for the time at which an audio device would ask for the next block
+            while (juce::Time::getMillisecondCounterHiRes() < startMS + (blockNum + 1) * blockDurationMS) {
+                juce::Thread::sleep(1);
+            }
+
+            setProgress(((double) lengthNum + (double) blockNum / numBlocks) / numLengths);
+        }
+
+        auto const audioThreadLoad = 100.0 * juce::Time::highResolutionTicksToSeconds(audioThreadTicks) / secondsPerLength;
+        auto const workerLoad = 100.0 * (scheduler->getWorkerTimeSeconds() - workerStartS) / secondsPerLength;
+
+        results.add(juce::String(lengthS, 1) + " s: audio thread " + juce::String(audioThreadLoad, 2) + " %, workers "
+                    + juce::String(workerLoad, 2) + " %, " + juce::String(convolver.getNumMissedDeadlines()) + " missed deadlines");
+    }
+}
+
+void ConvolutionBenchmark::threadComplete(bool userPressedCancel)
+{
+    if (userPressedCancel) {
+        return;
+    }
+
+    juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::InfoIcon, "Convolution Benchmark",
+                                           "CPU load of one stereo instance per impulse response length, in percent of a core. "
+                                           "The workers are shared, their time includes other running instances.\n\n"
+                                           + results.joinIntoString("\n"));
+}
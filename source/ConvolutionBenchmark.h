@@ -0,0 +1,31 @@
+#pragma once
+
+#include "ConvolutionTailScheduler.h"
+#include "JuceHeader.h"
+#include "PartitionedConvolver.h"
+
+/**
+ * Measures the CPU load of one stereo convolution instance for a range of impulse response lengths.
+ * Blocks are processed at the pace of an audio device, so the tail workers have the same time as during playback.
+ * The time spent in the process calls is the load of the audio thread, the time the workers spent on tail blocks is reported separately.
+ */
+class ConvolutionBenchmark : public juce::ThreadWithProgressWindow
+{
+public:
+    ConvolutionBenchmark(double sampleRate, juce::Component* componentToCentreAround);
+
+    void run() override;
+    void threadComplete(bool userPressedCancel) override;
+
+private:
+    static juce::AudioBuffer<float> createImpulseResponse(double lengthS, double rate, juce::Random& random);
+
+    static constexpr int blockSize = 512;
+    static constexpr int numChannels = 2;
+    static constexpr double secondsPerLength = 3.0;
+
+    double sampleRate;
+    juce::StringArray results;
+
+    juce::SharedResourcePointer<ConvolutionTailScheduler> scheduler;
+};
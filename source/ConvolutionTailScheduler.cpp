@@ -0,0 +1,128 @@
+#include "ConvolutionTailScheduler.h"
+
+void ConvolutionTailScheduler::Job::queue(juce::int64 deadlineTicks) noexcept
+{
+    jassert(state.load() == IDLE);
+
+    deadline.store(deadlineTicks);
+    state.store(QUEUED);
+
+    if (scheduler != nullptr) {
+        scheduler->jobQueued.signal();
+    }
+}
+
+bool ConvolutionTailScheduler::Job::finish() noexcept
+{
+    bool missedDeadline = false;
+    int expected = QUEUED;
+
+    if (state.compare_exchange_strong(expected, RUNNING)) {
+        // no worker got to it in time
+        compute();
+        missedDeadline = true;
+    } else if (expected == RUNNING) {
+        while (state.load() == RUNNING) {
+            std::this_thread::yield();
+        }
+
+        missedDeadline = true;
+    }
+
+    state.store(IDLE);
+    return missedDeadline;
+}
+
+ConvolutionTailScheduler::ConvolutionTailScheduler()
+{
+    // one core stays free for the audio thread
+    auto const numWorkers = juce::jlimit(1, 4, juce::SystemStats::getNumCpus() - 1);
+
+    for (int number = 0; number < numWorkers; number++) {
+        workers.add(new Worker(*this, number + 1))->startThread(juce::Thread::Priority::high);
+    }
+}
+
+ConvolutionTailScheduler::~ConvolutionTailScheduler()
+{
+    for (auto* worker : workers) {
+        worker->signalThreadShouldExit();
+    }
+
+    jobQueued.signal();
+
+    for (auto* worker : workers) {
+        worker->stopThread(1000);
+    }
+
+    workers.clear();
+}
+
+void ConvolutionTailScheduler::add(Job* job)
+{
+    const juce::ScopedLock lock(jobsMutex);
+    job->scheduler = this;
+    jobs.push_back(job);
+}
+
+void ConvolutionTailScheduler::remove(Job* job)
+{
+    {
+        const juce::ScopedLock lock(jobsMutex);
+        jobs.erase(std::remove(jobs.begin(), jobs.end(), job), jobs.end());
+    }
+
+    // jobs are only claimed while the lock is held, so no worker can start it anymore
+    while (job->state.load() == Job::RUNNING) {
+        juce::Thread::yield();
+    }
+}
+
+/**
+ * Claims the queued job with the earliest deadline and computes it, returns whether there was one.
+ */
+bool ConvolutionTailScheduler::runEarliestJob()
+{
+    Job* earliest = nullptr;
+
+    {
+        const juce::ScopedLock lock(jobsMutex);
+
+        for (auto* job : jobs) {
+            if (job->state.load() == Job::QUEUED && (earliest == nullptr || job->deadline.load() < earliest->deadline.load())) {
+                earliest = job;
+            }
+        }
+
+        int expected = Job::QUEUED;
+
+        // the audio thread may have taken it over in the meantime
+        if (earliest == nullptr || !earliest->state.compare_exchange_strong(expected, Job::RUNNING)) {
+            return false;
+        }
+    }
+
+    auto const startTicks = juce::Time::getHighResolutionTicks();
+    earliest->compute();
+    workerTicks += juce::Time::getHighResolutionTicks() - startTicks;
+
+    earliest->state.store(Job::DONE);
+    return true;
+}
+
+void ConvolutionTailScheduler::Worker::run()
+{
+    while (!threadShouldExit()) {
+        // a job that is queued after the reset signals again, so none is missed
+        scheduler.jobQueued.reset();
+
+        if (scheduler.runEarliestJob()) {
+            continue;
+        }
+
+        // the destructor signals after asking the workers to exit
+        if (!threadShouldExit()) {
+            scheduler.jobQueued.wait();
+        }
+    }
+}
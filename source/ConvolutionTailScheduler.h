@@ -0,0 +1,93 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Worker threads that compute the tail blocks of all convolvers of the process, earliest deadline first.
+ *
+ * A job is queued by the audio thread together with the time at which its result is needed, the audio thread never
+ * locks but signals the workers, which sleep until a job is queued. If a job is still queued when its deadline arrives,
+ * the audio thread computes it itself, if it is being computed, the audio thread waits for it. Both count as a missed deadline.
+ *
+ * Shared between all instances through a juce::SharedResourcePointer.
+ */
+class ConvolutionTailScheduler
+{
+public:
+    class Job
+    {
+    public:
+        virtual ~Job() = default;
+
+        /**
+         * Audio thread: hands the job to the workers and wakes them, it must not be queued already.
+         */
+        void queue(juce::int64 deadlineTicks) noexcept;
+
+        /**
+         * Audio thread: makes sure the queued job is computed, returns whether the deadline was missed.
+         */
+        bool finish() noexcept;
+
+    protected:
+        virtual void compute() noexcept = 0;
+
+    private:
+        friend class ConvolutionTailScheduler;
+
+        enum State {
+            IDLE,
+            QUEUED,
+            RUNNING,
+            DONE
+        };
+
+        std::atomic<int> state{IDLE};
+        std::atomic<juce::int64> deadline{0};
+        ConvolutionTailScheduler* scheduler = nullptr;
+    };
+
+    ConvolutionTailScheduler();
+    ~ConvolutionTailScheduler();
+
+    void add(Job* job);
+
+    /**
+     * Waits until a worker that computes the job is done, afterwards the job can be destroyed.
+     */
+    void remove(Job* job);
+
+    int getNumWorkers() const                   { return workers.size(); }
+
+    // time the workers spent computing jobs, for benchmarks
+    double getWorkerTimeSeconds() const         { return juce::Time::highResolutionTicksToSeconds(workerTicks.load()); }
+
+private:
+    class Worker : public juce::Thread
+    {
+    public:
+        Worker(ConvolutionTailScheduler& s, int number)
+            : juce::Thread("Convolution Worker " + juce::String(number))
+            , scheduler(s)
+        {
+        }
+
+        void run() override;
+
+    private:
+        ConvolutionTailScheduler& scheduler;
+    };
+
+    bool runEarliestJob();
+
+    juce::CriticalSection jobsMutex;
+    std::vector<Job*> jobs;
+
+    // signalled whenever a job is queued, every worker resets it before looking for jobs
+    juce::WaitableEvent jobQueued{true};
+
+    juce::OwnedArray<Worker> workers;
+    std::atomic<juce::int64> workerTicks{0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ConvolutionTailScheduler)
+};
@@ -0,0 +1,169 @@
+#include "CrossfadingConvolution.h"
+
+CrossfadingConvolution::CrossfadingConvolution()
+    : juce::Thread("Convolution Loader")
+{
+    startThread();
+}
+
+CrossfadingConvolution::~CrossfadingConvolution()
+{
+    stopThread(10000);
+
+    delete loadedConvolver.exchange(nullptr);
+    delete retiredConvolver.exchange(nullptr);
+}
+
+/**
+ * Called while the audio thread is stopped. The latest impulse response is rebuilt for the new spec right away,
+ * so playback starts with it instead of fading it in.
+ */
+void CrossfadingConvolution::prepare(const juce::dsp::ProcessSpec& spec)
+{
+    Request request;
+
+    {
+        const juce::ScopedLock lock(requestMutex);
+
+        processSpec = spec;
+        specGeneration++;
+
+        request = latestRequest;
+        requestPending = false;
+
+        // built for the previous spec
+        delete loadedConvolver.exchange(nullptr);
+    }
+
+    delete retiredConvolver.exchange(nullptr);
+
+    nextConvolver.reset();
+    crossfadePosition = crossfadeLength = 0;
+
+    currentConvolver.reset();
+
+    if (request.impulseResponse != nullptr) {
+        currentConvolver = std::make_unique<PartitionedConvolver>(*request.impulseResponse, spec.sampleRate, (int) spec.numChannels, request.normalise);
+    }
+
+    dryBuffer.setSize((int) spec.numChannels, (int) spec.maximumBlockSize);
+    crossfadeBuffer.setSize((int) spec.numChannels, (int) spec.maximumBlockSize);
+}
+
+void CrossfadingConvolution::reset() noexcept
+{
+    if (currentConvolver != nullptr) {
+        currentConvolver->reset();
+    }
+
+    if (nextConvolver != nullptr) {
+        nextConvolver->reset();
+    }
+}
+
+void CrossfadingConvolution::loadImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse, bool normalise)
+{
+    {
+        const juce::ScopedLock lock(requestMutex);
+
+        latestRequest = {std::move(impulseResponse), normalise};
+        requestPending = true;
+    }
+
+    notify();
+}
+
+void CrossfadingConvolution::run()
+{
+    while (!threadShouldExit()) {
+        delete retiredConvolver.exchange(nullptr);
+
+        Request request;
+        juce::dsp::ProcessSpec spec{};
+        int generation = 0;
+
+        {
+            const juce::ScopedLock lock(requestMutex);
+
+            if (requestPending && processSpec.sampleRate > 0.0) {
+                request = latestRequest;
+                spec = processSpec;
+                generation = specGeneration;
+                requestPending = false;
+            }
+        }
+
+        if (request.impulseResponse != nullptr) {
+            auto convolver = std::make_unique<PartitionedConvolver>(*request.impulseResponse, spec.sampleRate, (int) spec.numChannels, request.normalise);
+
+            const juce::ScopedLock lock(requestMutex);
+
+            // a convolver that was prepared for an old spec or overtaken by a newer one before the audio thread took it is dropped
+            if (generation == specGeneration) {
+                delete loadedConvolver.exchange(convolver.release());
+            }
+
+            continue;
+        }
+
+        // replaced convolvers are freed within this interval
+        wait(50);
+    }
+}
+
+void CrossfadingConvolution::process(const juce::dsp::ProcessContextReplacing<float>& context) noexcept
+{
+    auto& block = context.getOutputBlock();
+    auto const numChannels = juce::jmin((int) block.getNumChannels(), dryBuffer.getNumChannels());
+    auto const numSamples = (int) block.getNumSamples();
+
+    // a new convolver is only taken once the previous fade is over and its old convolver has been freed
+    if (nextConvolver == nullptr && retiredConvolver.load() == nullptr) {
+        if (auto* loaded = loadedConvolver.exchange(nullptr)) {
+            nextConvolver.reset(loaded);
+            crossfadePosition = 0;
+            crossfadeLength = juce::roundToInt(crossfadeTimeS.load() * processSpec.sampleRate);
+        }
+    }
+
+    for (int start = 0; start < numSamples; start += dryBuffer.getNumSamples()) {
+        auto const numToProcess = juce::jmin(dryBuffer.getNumSamples(), numSamples - start);
+
+        for (int channel = 0; channel < numChannels; channel++) {
+            auto* samples = block.getChannelPointer((size_t) channel) + start;
+
+            if (nextConvolver == nullptr) {
+                if (currentConvolver != nullptr) {
+                    currentConvolver->process(channel, samples, samples, numToProcess);
+                }
+
+                continue;
+            }
+
+            auto* dry = dryBuffer.getWritePointer(channel);
+            auto* faded = crossfadeBuffer.getWritePointer(channel);
+            std::copy_n(samples, numToProcess, dry);
+
+            if (currentConvolver != nullptr) {
+                currentConvolver->process(channel, dry, samples, numToProcess);
+            }
+
+            nextConvolver->process(channel, dry, faded, numToProcess);
+
+            // both convolvers see the same input, so a linear fade keeps the level constant
+            for (int sample = 0; sample < numToProcess; sample++) {
+                auto const gain = crossfadeLength > 0 ? juce::jmin(1.0f, (float) (crossfadePosition + sample) / (float) crossfadeLength) : 1.0f;
+                samples[sample] += gain * (faded[sample] - samples[sample]);
+            }
+        }
+
+        if (nextConvolver != nullptr) {
+            crossfadePosition += numToProcess;
+
+            if (crossfadePosition >= crossfadeLength) {
+                retiredConvolver.store(currentConvolver.release());
+                currentConvolver = std::move(nextConvolver);
+            }
+        }
+    }
+}
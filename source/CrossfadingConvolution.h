@@ -0,0 +1,63 @@
+#pragma once
+
+#include "ImpulseResponseExchange.h"
+#include "JuceHeader.h"
+#include "PartitionedConvolver.h"
+
+/**
+ * Convolution whose impulse response can be replaced during playback.
+ *
+ * New impulse responses are partitioned and transformed by a background thread. The audio thread picks the finished
+ * convolver up, runs it next to the current one for the crossfade time and fades from the old output to the new one.
+ * Replaced convolvers are handed back to the background thread to be freed, so the audio thread never allocates or frees.
+ * Without an impulse response the input is passed through.
+ */
+class CrossfadingConvolution : private juce::Thread
+{
+public:
+    CrossfadingConvolution();
+    ~CrossfadingConvolution() override;
+
+    void prepare(const juce::dsp::ProcessSpec& spec);
+    void reset() noexcept;
+    void process(const juce::dsp::ProcessContextReplacing<float>& context) noexcept;
+
+    /**
+     * Can be called on any thread except the audio thread, only the latest impulse response is loaded.
+     */
+    void loadImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse, bool normalise);
+
+    void setCrossfadeTime(double seconds)       { crossfadeTimeS = juce::jmax(0.0, seconds); }
+    int getLatency() const noexcept             { return 0; }
+
+private:
+    struct Request {
+        std::shared_ptr<const ImpulseResponse> impulseResponse;
+        bool normalise = false;
+    };
+
+    void run() override;
+
+    // guarded by requestMutex, shared between prepare(), loadImpulseResponse() and the background thread
+    juce::CriticalSection requestMutex;
+    Request latestRequest;
+    bool requestPending = false;
+    juce::dsp::ProcessSpec processSpec{};
+    int specGeneration = 0;
+
+    // handed over between the background thread and the audio thread
+    std::atomic<PartitionedConvolver*> loadedConvolver{nullptr};
+    std::atomic<PartitionedConvolver*> retiredConvolver{nullptr};
+    std::atomic<double> crossfadeTimeS{0.1};
+
+    // only touched by the audio thread once prepared
+    std::unique_ptr<PartitionedConvolver> currentConvolver;
+    std::unique_ptr<PartitionedConvolver> nextConvolver;
+    int crossfadePosition = 0;
+    int crossfadeLength = 0;
+
+    juce::AudioBuffer<float> dryBuffer;
+    juce::AudioBuffer<float> crossfadeBuffer;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CrossfadingConvolution)
+};
@@ -4,13 +4,11 @@
 ImpulseResponseComponent::ImpulseResponseComponent(RaumsimulationAudioProcessor& p, juce::AudioProcessorValueTreeState& pts)
     : audioProcessor(p)
     , parameters(pts)
-    , thumbnail(128, formatManager, thumbnailCache)
 {
     irFileURL = static_cast<const juce::URL>(parameters.state.getProperty("ir_file_url"));
 
     setOpaque(false);
 
-    thumbnail.addChangeListener(this);
     formatManager.registerFormat(new AiffAudioFormat(), false);
     formatManager.registerFormat(new FlacAudioFormat(), false);
     formatManager.registerFormat(new OggVorbisAudioFormat(), false);
@@ -25,57 +23,70 @@ ImpulseResponseComponent::ImpulseResponseComponent(RaumsimulationAudioProcessor&
     addAndMakeVisible(irFileSaveButton);
     irFileSaveButton.onClick = [this] { saveFile(); };
 
+    addChildComponent(irLoadProgressBar);
+    addChildComponent(irExportProgressBar);
+
     irFileLabel.attachToComponent(&irFileLoadButton, false);
     irFileLabel.setText(irFileURL.toString(false), sendNotificationAsync);
     irFileLabel.setJustificationType(Justification::centredLeft);
 
     addAndMakeVisible(irSizeLabel);
-    irSizeLabel.setText(juce::String::formatted("%.2f s", thumbnail.getTotalLength()), dontSendNotification);
+    irSizeLabel.setText(juce::String::formatted("%.2f s", 0.0), dontSendNotification);
     irSizeLabel.setJustificationType(Justification::right);
 
     addAndMakeVisible(clearButton);
     clearButton.onClick = [this] { audioProcessor.clearIR();
                                    irFileURL = {};
-                                   updateThumbnail(audioProcessor.globalSampleRate); };
+                                   updateThumbnail(); };
 
     setURL(irFileURL); // has to come after registering the audio formats
 }
 
 ImpulseResponseComponent::~ImpulseResponseComponent()
 {
-    thumbnail.removeChangeListener(this);
+    irLoader.cancel();
+    peakPyramidGeneration++;
+    peakPyramidThread.removeAllJobs(true, 5000);
 }
 
 void ImpulseResponseComponent::paint(juce::Graphics & g)
 {
-    auto thumbArea = getLocalBounds().reduced(5);
-    thumbArea.removeFromBottom(50);
+    auto thumbArea = getWaveformArea();
 
-    if (thumbnail.getTotalLength() > 0.0) {
-        double ms = 0.0f;
+    if (peakPyramid != nullptr && peakPyramid->getLengthSeconds() > 0.0 && visibleLengthS > 0.0) {
+        double startMS = visibleStartS * 1000.0;
+        double lengthMS = visibleLengthS * 1000.0;
         double numberOfLines = (int) parameters.state.getProperty("lines_in_waveform");
 
-        double pixelPerMS = thumbArea.getWidth() / (thumbnail.getTotalLength() * 1000.0f);
-        double stepMS = thumbnail.getTotalLength() * 1000.0f / numberOfLines;
-        double roundedStep = floor((stepMS + 5.0f) / 10.0f) * 10.0f;
-        while (ms < thumbnail.getTotalLength() * 1000.0f) {
-            g.setColour(getLookAndFeel().findColour(0x0000002));
-            g.setFont(8.0f);
-
-            if (ms < 1000.0f) {
-                g.drawText(String(ms) + " ms", thumbArea.getX() + (int) (pixelPerMS * ms) + 3, thumbArea.getY(), 25, 10, Justification::centredLeft, false);
-            } else {
-                g.drawText(String(ms / 1000.0f) + " s", thumbArea.getX() + (int) (pixelPerMS * ms) + 3, thumbArea.getY(), 25, 10, Justification::centredLeft, false);
-            }
+        if (numberOfLines > 0.0) {
+            double pixelPerMS = thumbArea.getWidth() / lengthMS;
+            double stepMS = lengthMS / numberOfLines;
+
+            // multiples of 10 ms, or of a power of ten when zoomed in further
+            double roundedStep = stepMS >= 10.0 ? floor((stepMS + 5.0f) / 10.0f) * 10.0f : pow(10.0, floor(log10(stepMS)));
+            double ms = ceil(startMS / roundedStep) * roundedStep;
+
+            while (ms < startMS + lengthMS) {
+                auto const x = thumbArea.getX() + pixelPerMS * (ms - startMS);
 
-            g.setColour(getLookAndFeel().findColour(0x0000001));
-            g.fillRect((float) (thumbArea.getX() + pixelPerMS * ms),(float) thumbArea.getY(), 1.0f,(float) thumbArea.getHeight());
+                g.setColour(getLookAndFeel().findColour(0x0000002));
+                g.setFont(8.0f);
 
-            ms += roundedStep;
+                if (ms < 1000.0f) {
+                    g.drawText(String(ms, roundedStep < 1.0 ? 2 : 0) + " ms", (int) x + 3, thumbArea.getY(), 25, 10, Justification::centredLeft, false);
+                } else {
+                    g.drawText(String(ms / 1000.0f) + " s", (int) x + 3, thumbArea.getY(), 25, 10, Justification::centredLeft, false);
+                }
+
+                g.setColour(getLookAndFeel().findColour(0x0000001));
+                g.fillRect((float) x, (float) thumbArea.getY(), 1.0f, (float) thumbArea.getHeight());
+
+                ms += roundedStep;
+            }
         }
 
         g.setColour(getLookAndFeel().findColour(0x0000000));
-        thumbnail.drawChannels(g, thumbArea, 0, thumbnail.getTotalLength(), 1.0f);
+        peakPyramid->drawChannels(g, thumbArea, visibleStartS, visibleStartS + visibleLengthS);
     } else {
         g.setColour(getLookAndFeel().findColour(TextButton::textColourOffId));
         g.setFont(14.0f);
@@ -89,6 +100,9 @@ void ImpulseResponseComponent::resized()
 
     auto bottom = area.removeFromBottom(75);
 
+    irLoadProgressBar.setBounds(area.reduced(5).withSizeKeepingCentre(jmin(300, area.getWidth() - 10), 20));
+    irExportProgressBar.setBounds(irLoadProgressBar.getBounds().translated(0, 25));
+
     {   // Buttons
         irSizeLabel.                setBounds(bottom.removeFromTop(25));
 
@@ -102,38 +116,105 @@ void ImpulseResponseComponent::resized()
     }
 }
 
+/**
+ * Loads the file in the background, the decoded samples are handed to the processor and the waveform display once.
+ */
 void ImpulseResponseComponent::setURL(const URL& url)
 {
-    if (url.isLocalFile())
-    {
-        auto source = std::make_unique<FileInputSource>(irFileURL.getLocalFile());
+    if (!url.isLocalFile())
+        return;
 
-        if (source != nullptr) {
+    irLoadProgressBar.setVisible(true);
 
+    irLoader.load(url.getLocalFile(), [this] (const ImpulseResponseLoader::Result& result) {
+        irLoadProgressBar.setVisible(false);
 
-            auto stream = rawToUniquePtr(source->createInputStream());
+        if (result.buffer == nullptr) {
+            irFileLabel.setText(result.error, dontSendNotification);
+            return;
+        }
 
-            if (stream != nullptr) {
-                auto reader = rawToUniquePtr(formatManager.createReaderFor(std::move(stream)));
+        audioProcessor.setImpulseResponse(std::move(*result.buffer), result.sampleRate);
+        updateThumbnail();
+    });
+}
 
-                if (reader != nullptr) {
-                    audioProcessor.ir.setSize((int) reader->numChannels, (int) reader->lengthInSamples);
-                    reader->read(&audioProcessor.ir, 0, audioProcessor.ir.getNumSamples(), 0, true, true);
+/**
+ * Builds the peak pyramid of the current impulse response on a background thread.
+ * Builds that are overtaken by a newer impulse response stop early and are never shown.
+ */
+void ImpulseResponseComponent::updateThumbnail()
+{
+    const MessageManagerLock messageManagerLock;
 
-                    updateThumbnail(reader->sampleRate);
-                }
-            }
+    // published impulse responses never change, the pyramid shares the samples instead of copying them
+    auto const impulseResponse = audioProcessor.getImpulseResponse();
+    auto const generation = ++peakPyramidGeneration;
+
+    peakPyramidThread.addJob([this, impulseResponse, generation] {
+        auto pyramid = std::make_shared<PeakPyramid>();
+        auto samples = std::shared_ptr<const AudioBuffer<float>>(impulseResponse, &impulseResponse->samples);
+
+        if (pyramid->build(std::move(samples), impulseResponse->sampleRate, [this, generation] { return peakPyramidGeneration != generation; })) {
+            MessageManager::callAsync([safeThis = SafePointer<ImpulseResponseComponent>(this), pyramid, generation] {
+                if (safeThis != nullptr && safeThis->peakPyramidGeneration == generation)
+                    safeThis->setPeakPyramid(pyramid);
+            });
         }
+
+        return ThreadPoolJob::jobHasFinished;
+    });
+
+    irFileLabel.setText(irFileURL.toString(false), sendNotificationAsync);
+}
+
+void ImpulseResponseComponent::setPeakPyramid(std::shared_ptr<const PeakPyramid> newPeakPyramid)
+{
+    // a zoomed view stays where it is, otherwise the new impulse response is shown completely
+    bool const showsEverything = peakPyramid == nullptr || visibleLengthS >= peakPyramid->getLengthSeconds();
+
+    peakPyramid = std::move(newPeakPyramid);
+
+    if (showsEverything) {
+        setVisibleRange(0.0, peakPyramid->getLengthSeconds());
+    } else {
+        setVisibleRange(visibleStartS, visibleLengthS);
     }
+
+    irSizeLabel.setText(juce::String::formatted("%.2f s", peakPyramid->getLengthSeconds()), dontSendNotification);
+    repaint();
 }
 
-void ImpulseResponseComponent::updateThumbnail(double sampleRate)
+Rectangle<int> ImpulseResponseComponent::getWaveformArea() const
 {
-    const MessageManagerLock messageManagerLock;
+    auto thumbArea = getLocalBounds().reduced(5);
+    thumbArea.removeFromBottom(50);
+    return thumbArea;
+}
 
-    thumbnail.setSource(&audioProcessor.ir, sampleRate, (long long) Uuid().hash());
-    irFileLabel.setText(irFileURL.toString(false), sendNotificationAsync);
-    irSizeLabel.setText(juce::String::formatted("%.2f s", thumbnail.getTotalLength()), dontSendNotification);
+double ImpulseResponseComponent::getTimeAtX(float x) const
+{
+    auto const thumbArea = getWaveformArea();
+    return visibleStartS + (double) (x - (float) thumbArea.getX()) / jmax(1, thumbArea.getWidth()) * visibleLengthS;
+}
+
+/**
+ * Limits the range to the impulse response, at most one sample per pixel is shown when zoomed in fully.
+ */
+void ImpulseResponseComponent::setVisibleRange(double startS, double lengthS)
+{
+    auto const totalS = peakPyramid != nullptr ? peakPyramid->getLengthSeconds() : 0.0;
+
+    if (totalS <= 0.0) {
+        visibleStartS = visibleLengthS = 0.0;
+        return;
+    }
+
+    auto const minLengthS = jmin(totalS, getWaveformArea().getWidth() / peakPyramid->getSampleRate());
+
+    visibleLengthS = jlimit(minLengthS, totalS, lengthS);
+    visibleStartS = jlimit(0.0, totalS - visibleLengthS, startS);
+    repaint();
 }
 
 void ImpulseResponseComponent::openFile()
@@ -160,39 +241,111 @@ void ImpulseResponseComponent::openFile()
             }, nullptr);
 }
 
+/**
+ * Offers the export formats, a single file or a batch of files is written by the exporter in the background.
+ */
 void ImpulseResponseComponent::saveFile()
 {
     if (irFileChooser != nullptr)
         return;
 
-    irFileChooser = std::make_unique<FileChooser>("Select an audio file...", File(), "*.wav");
+    using Format = ImpulseResponseExporter::Format;
+    std::vector<Format> const allFormats = { Format::WAV_24, Format::WAV_FLOAT, Format::FLAC_24, Format::RAW_FLOAT };
+
+    PopupMenu menu;
+
+    for (auto format : allFormats)
+        menu.addItem(ImpulseResponseExporter::getFormatName(format) + "...", [this, format] { chooseExportFile({ format }, false, false); });
+
+    menu.addSeparator();
+    menu.addItem("All formats...", [this, allFormats] { chooseExportFile(allFormats, false, false); });
+    menu.addItem("Channels as separate files...", audioProcessor.getImpulseResponse()->samples.getNumChannels() > 1,
+                 false, [this] { chooseExportFile({ Format::WAV_FLOAT }, true, false); });
+
+    PopupMenu bandsMenu;
+
+    for (auto format : allFormats)
+        bandsMenu.addItem(ImpulseResponseExporter::getFormatName(format) + "...", [this, format] { chooseExportFile({ format }, false, true); });
+
+    menu.addSubMenu("Octave bands of the last render", bandsMenu, !audioProcessor.getBandImpulseResponses().empty());
+
+    menu.showMenuAsync(PopupMenu::Options().withTargetComponent(irFileSaveButton));
+}
+
+/**
+ * Takes the snapshots of the impulse responses once the file is chosen, every file of the batch shares them.
+ * The chosen name is used as it is for a single file, otherwise the band, format and channel are appended to it.
+ */
+void ImpulseResponseComponent::chooseExportFile(std::vector<ImpulseResponseExporter::Format> formats, bool splitChannels, bool octaveBands)
+{
+    if (irFileChooser != nullptr)
+        return;
+
+    auto const extension = ImpulseResponseExporter::getFileExtension(formats.front());
+    irFileChooser = std::make_unique<FileChooser>("Select a file name...", File(), formats.size() > 1 ? "*" : "*" + extension);
 
     irFileChooser->launchAsync(FileBrowserComponent::saveMode | FileBrowserComponent::warnAboutOverwriting,
-            [this] (const FileChooser& fc) mutable
+            [this, formats, splitChannels, octaveBands] (const FileChooser& fc) mutable
             {
-                if (fc.getURLResults().size() > 0)
-                {
-                    auto result = fc.getURLResult();
+                irFileChooser = nullptr;
 
-                    auto file = File(result.getLocalFile().getFullPathName());
+                if (fc.getURLResults().isEmpty())
+                    return;
 
-                    if (file.exists()) {
-                        file.moveToTrash();
-                    }
+                auto const chosenFile = fc.getURLResult().getLocalFile();
+
+                // impulse responses to export, each with the part of the file name that tells it apart
+                std::vector<std::pair<String, std::shared_ptr<const ImpulseResponse>>> impulseResponses;
 
-                    WavAudioFormat format;
-                    std::unique_ptr<AudioFormatWriter> writer;
-                    writer.reset(format.createWriterFor(new FileOutputStream (file),
-                                                        audioProcessor.globalSampleRate,
-                                                        audioProcessor.ir.getNumChannels(),
-                                                        24,
-                                                        {},
-                                                        0));
-                    if (writer != nullptr)
-                        writer->writeFromAudioSampleBuffer (audioProcessor.ir, 0, audioProcessor.ir.getNumSamples());
+                if (octaveBands) {
+                    auto const bands = audioProcessor.getBandImpulseResponses();
+
+                    for (size_t band = 0; band < bands.size(); band++)
+                        impulseResponses.emplace_back("_" + String(125 << band) + "Hz", bands[band]);
+                } else {
+                    impulseResponses.emplace_back(String(), audioProcessor.getImpulseResponse());
                 }
 
-                irFileChooser = nullptr;
+                bool const singleFile = impulseResponses.size() == 1 && formats.size() == 1 && !splitChannels;
+                std::vector<ImpulseResponseExporter::Item> items;
+
+                for (const auto& impulseResponse : impulseResponses) {
+                    auto const snapshot = std::shared_ptr<const AudioBuffer<float>>(impulseResponse.second, &impulseResponse.second->samples);
+                    auto const sampleRate = impulseResponse.second->sampleRate > 0.0 ? impulseResponse.second->sampleRate : audioProcessor.globalSampleRate;
+
+                    for (auto format : formats) {
+                        auto const name = chosenFile.getFileNameWithoutExtension() + impulseResponse.first
+                                        + (formats.size() > 1 ? ImpulseResponseExporter::getFileSuffix(format) : String());
+                        auto const formatExtension = ImpulseResponseExporter::getFileExtension(format);
+
+                        if (singleFile) {
+                            // the file chooser has already asked before overwriting the chosen file
+                            items.push_back({ chosenFile, format, snapshot, sampleRate });
+                        } else if (!splitChannels) {
+                            items.push_back({ chosenFile.getSiblingFile(name + formatExtension), format, snapshot, sampleRate });
+                        } else {
+                            for (int channel = 0; channel < snapshot->getNumChannels(); channel++) {
+                                auto channelBuffer = std::make_shared<AudioBuffer<float>>(1, snapshot->getNumSamples());
+                                channelBuffer->copyFrom(0, 0, *snapshot, channel, 0, snapshot->getNumSamples());
+
+                                auto const channelFile = chosenFile.getSiblingFile(name + "_" + String(channel + 1) + formatExtension);
+                                items.push_back({ channelFile, format, std::move(channelBuffer), sampleRate });
+                            }
+                        }
+                    }
+                }
+
+                irExportProgressBar.setVisible(true);
+
+                irExporter.exportBatch(std::move(items), [this] (const StringArray& errors, int numFilesWritten) {
+                    irExportProgressBar.setVisible(irExporter.isExporting());
+
+                    if (errors.isEmpty()) {
+                        irFileLabel.setText(String(numFilesWritten) + (numFilesWritten == 1 ? " file exported" : " files exported"), dontSendNotification);
+                    } else {
+                        irFileLabel.setText(errors.joinIntoString("; "), dontSendNotification);
+                    }
+                });
             }, nullptr);
 }
 
@@ -203,11 +356,9 @@ void ImpulseResponseComponent::changeListenerCallback (ChangeBroadcaster*)
 
 void ImpulseResponseComponent::mouseMove(const MouseEvent &e)
 {
-    auto thumbArea = getLocalBounds().reduced(5);
-    double msPerPixel = (thumbnail.getTotalLength() * 1000.0f) / thumbArea.getWidth();
-    double ms = (e.getMouseDownX() - 5) * msPerPixel;
+    double ms = getTimeAtX(e.position.x) * 1000.0;
 
-    if (e.getMouseDownX() > 5) {
+    if (e.position.x > 5) {
         if (ms < 1000.0f) {
             setTooltip(juce::String::formatted("%.2f ms", ms, dontSendNotification));
         } else {
@@ -215,3 +366,46 @@ void ImpulseResponseComponent::mouseMove(const MouseEvent &e)
         }
     }
 }
+
+void ImpulseResponseComponent::mouseDown(const MouseEvent&)
+{
+    dragStartS = visibleStartS;
+}
+
+void ImpulseResponseComponent::mouseDrag(const MouseEvent& e)
+{
+    auto const secondsPerPixel = visibleLengthS / jmax(1, getWaveformArea().getWidth());
+    setVisibleRange(dragStartS - e.getDistanceFromDragStartX() * secondsPerPixel, visibleLengthS);
+}
+
+void ImpulseResponseComponent::mouseDoubleClick(const MouseEvent&)
+{
+    setVisibleRange(0.0, peakPyramid != nullptr ? peakPyramid->getLengthSeconds() : 0.0);
+}
+
+/**
+ * Zooms around the time under the mouse, scrolls with a sideways wheel or with shift held down.
+ */
+void ImpulseResponseComponent::mouseWheelMove(const MouseEvent& e, const MouseWheelDetails& wheel)
+{
+    bool const sideways = std::abs(wheel.deltaX) > std::abs(wheel.deltaY);
+
+    if (sideways || e.mods.isShiftDown()) {
+        auto const delta = sideways ? wheel.deltaX : wheel.deltaY;
+        setVisibleRange(visibleStartS - delta * visibleLengthS / 2.0, visibleLengthS);
+        return;
+    }
+
+    auto const factor = std::pow(2.0, -wheel.deltaY * 2.0);
+    auto const anchorS = getTimeAtX(e.position.x);
+
+    setVisibleRange(anchorS - (anchorS - visibleStartS) * factor, visibleLengthS * factor);
+}
+
+void ImpulseResponseComponent::mouseMagnify(const MouseEvent& e, float scaleFactor)
+{
+    auto const factor = 1.0 / jmax(0.01, (double) scaleFactor);
+    auto const anchorS = getTimeAtX(e.position.x);
+
+    setVisibleRange(anchorS - (anchorS - visibleStartS) * factor, visibleLengthS * factor);
+}
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "ImpulseResponseExporter.h"
+#include "ImpulseResponseLoader.h"
 #include "JuceHeader.h"
+#include "PeakPyramid.h"
 #include "PluginProcessor.h"
 
 class ImpulseResponseComponent : public juce::Component,
@@ -14,21 +17,44 @@ public:
 
     void paint(juce::Graphics&) override;
     void resized() override;
-    void updateThumbnail(double sampleRate);
+    void updateThumbnail();
 
 private:
     void openFile();
     void saveFile();
+    void chooseExportFile(std::vector<ImpulseResponseExporter::Format> formats, bool splitChannels, bool octaveBands);
     void setURL(const URL&);
     void changeListenerCallback(ChangeBroadcaster*) override;
     void mouseMove(const MouseEvent& e) override;
+    void mouseDown(const MouseEvent& e) override;
+    void mouseDrag(const MouseEvent& e) override;
+    void mouseDoubleClick(const MouseEvent& e) override;
+    void mouseWheelMove(const MouseEvent& e, const MouseWheelDetails& wheel) override;
+    void mouseMagnify(const MouseEvent& e, float scaleFactor) override;
+
+    Rectangle<int> getWaveformArea() const;
+    double getTimeAtX(float x) const;
+    void setVisibleRange(double startS, double lengthS);
+    void setPeakPyramid(std::shared_ptr<const PeakPyramid> newPeakPyramid);
 
     RaumsimulationAudioProcessor& audioProcessor;
     juce::AudioProcessorValueTreeState& parameters;
 
     AudioFormatManager formatManager;
-    juce::AudioThumbnailCache thumbnailCache{3};
-    juce::AudioThumbnail thumbnail;
+    ImpulseResponseLoader irLoader{formatManager};
+    ProgressBar irLoadProgressBar{irLoader.progress};
+    ImpulseResponseExporter irExporter;
+    ProgressBar irExportProgressBar{irExporter.progress};
+
+    // built on a background thread whenever the impulse response changes, only replaced on the message thread
+    std::shared_ptr<const PeakPyramid> peakPyramid;
+    std::atomic<int> peakPyramidGeneration{0};
+    juce::ThreadPool peakPyramidThread{1};
+
+    // zoomed and scrolled part of the waveform, a length of 0 shows all of it
+    double visibleStartS = 0.0;
+    double visibleLengthS = 0.0;
+    double dragStartS = 0.0;
 
     juce::URL irFileURL = {};
 
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * A finished impulse response, it is never changed once it is published.
+ */
+struct ImpulseResponse {
+    juce::AudioBuffer<float> samples;
+    double sampleRate = 0.0;
+};
+
+/**
+ * Hands impulse responses from the threads that create them to the audio thread without locks and without copies.
+ *
+ * Every published impulse response is kept in a release pool. The audio thread only reads a raw pointer,
+ * which it announces in a hazard pointer for the duration of a block, so it never takes part in the reference counting
+ * and never frees a buffer. The pool drops impulse responses on the other threads, once they are neither current,
+ * nor in use by the audio thread, nor referenced by anyone else.
+ */
+class ImpulseResponseExchange : private juce::Timer
+{
+public:
+    ImpulseResponseExchange()
+    {
+        publish(std::make_shared<const ImpulseResponse>());
+        startTimer(1000);
+    }
+
+    ~ImpulseResponseExchange() override
+    {
+        stopTimer();
+    }
+
+    /**
+     * Makes the impulse response current, can be called on any thread except the audio thread.
+     */
+    void publish(std::shared_ptr<const ImpulseResponse> impulseResponse)
+    {
+        jassert(impulseResponse != nullptr);
+
+        const juce::ScopedLock lock(poolMutex);
+
+        pool.push_back(impulseResponse);
+        current.store(impulseResponse.get());
+        latest = std::move(impulseResponse);
+
+        collectGarbage();
+    }
+
+    /**
+     * The current impulse response, can be called on any thread except the audio thread.
+     * Holding on to it is cheap, the samples are shared.
+     */
+    std::shared_ptr<const ImpulseResponse> get() const
+    {
+        const juce::ScopedLock lock(poolMutex);
+        return latest;
+    }
+
+    /**
+     * The current impulse response for the audio thread, it stays valid until releaseForAudioThread() is called.
+     * Only one audio thread may read at a time.
+     */
+    const ImpulseResponse* acquireForAudioThread() noexcept
+    {
+        auto* impulseResponse = current.load();
+
+        // the pointer is only safe once the hazard is set while it is still current
+        for (;;) {
+            hazard.store(impulseResponse);
+            auto* check = current.load();
+
+            if (check == impulseResponse) {
+                return impulseResponse;
+            }
+
+            impulseResponse = check;
+        }
+    }
+
+    void releaseForAudioThread() noexcept
+    {
+        hazard.store(nullptr);
+    }
+
+private:
+    void timerCallback() override
+    {
+        const juce::ScopedLock lock(poolMutex);
+        collectGarbage();
+    }
+
+    void collectGarbage()
+    {
+        auto const* inUse = hazard.load();
+
+        pool.erase(std::remove_if(pool.begin(), pool.end(), [this, inUse] (const std::shared_ptr<const ImpulseResponse>& impulseResponse) {
+            return impulseResponse != latest && impulseResponse.get() != inUse && impulseResponse.use_count() == 1;
+        }), pool.end());
+    }
+
+    juce::CriticalSection poolMutex;
+    std::vector<std::shared_ptr<const ImpulseResponse>> pool;
+    std::shared_ptr<const ImpulseResponse> latest;
+
+    std::atomic<const ImpulseResponse*> current{nullptr};
+    std::atomic<const ImpulseResponse*> hazard{nullptr};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponseExchange)
+};
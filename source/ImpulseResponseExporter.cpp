@@ -0,0 +1,256 @@
+#include "ImpulseResponseExporter.h"
+
+ImpulseResponseExporter::ImpulseResponseExporter()
+    : juce::Thread("Impulse Response Exporter")
+{
+}
+
+ImpulseResponseExporter::~ImpulseResponseExporter()
+{
+    stopThread(10000);
+    cancelPendingUpdate();
+}
+
+juce::String ImpulseResponseExporter::getFileExtension(Format format)
+{
+    switch (format) {
+        case Format::WAV_24:
+        case Format::WAV_FLOAT:     return ".wav";
+        case Format::FLAC_24:       return ".flac";
+        case Format::RAW_FLOAT:     return ".raw";
+    }
+
+    return {};
+}
+
+/**
+ * Part of the file name that tells the formats of a batch apart, the extension alone does not.
+ */
+juce::String ImpulseResponseExporter::getFileSuffix(Format format)
+{
+    switch (format) {
+        case Format::WAV_24:
+        case Format::FLAC_24:       return "_24bit";
+        case Format::WAV_FLOAT:
+        case Format::RAW_FLOAT:     return "_float";
+    }
+
+    return {};
+}
+
+juce::String ImpulseResponseExporter::getFormatName(Format format)
+{
+    switch (format) {
+        case Format::WAV_24:        return "WAV 24 bit";
+        case Format::WAV_FLOAT:     return "WAV 32 bit float";
+        case Format::FLAC_24:       return "FLAC 24 bit";
+        case Format::RAW_FLOAT:     return "Raw 32 bit float";
+    }
+
+    return {};
+}
+
+/**
+ * Queues the items, the callback is called on the message thread once all of them are written.
+ * The buffers are snapshots, they are not changed while they are written.
+ */
+void ImpulseResponseExporter::exportBatch(std::vector<Item> items, Callback onFinished)
+{
+    bool shouldStart;
+
+    {
+        const juce::ScopedLock lock(queueMutex);
+        pendingBatches.push_back({std::move(items), std::move(onFinished), {}, 0});
+
+        shouldStart = !exporting;
+        exporting = true;
+    }
+
+    if (shouldStart) {
+        // the previous run has given up the lock already and only has to return
+        waitForThreadToExit(-1);
+
+        progress = 0.0;
+        startThread();
+    }
+}
+
+bool ImpulseResponseExporter::isExporting() const
+{
+    const juce::ScopedLock lock(queueMutex);
+    return exporting;
+}
+
+void ImpulseResponseExporter::run()
+{
+    for (;;) {
+        Batch batch;
+
+        {
+            const juce::ScopedLock lock(queueMutex);
+
+            if (pendingBatches.empty()) {
+                exporting = false;
+                return;
+            }
+
+            batch = std::move(pendingBatches.front());
+            pendingBatches.pop_front();
+        }
+
+        progress = 0.0;
+
+        for (size_t itemNum = 0; itemNum < batch.items.size(); itemNum++) {
+            if (threadShouldExit()) {
+                const juce::ScopedLock lock(queueMutex);
+                exporting = false;
+                return;
+            }
+
+            juce::String error;
+            auto const progressStart = (double) itemNum / (double) batch.items.size();
+            auto const progressEnd = (double) (itemNum + 1) / (double) batch.items.size();
+
+            if (write(batch.items[itemNum], progressStart, progressEnd, error)) {
+                batch.numFilesWritten++;
+            } else if (error.isNotEmpty()) {
+                batch.errors.add(error);
+            }
+        }
+
+        {
+            const juce::ScopedLock lock(queueMutex);
+            finishedBatches.push_back(std::move(batch));
+        }
+
+        triggerAsyncUpdate();
+    }
+}
+
+/**
+ * Writes into a temporary file next to the target, which only replaces the target once it is complete.
+ */
+bool ImpulseResponseExporter::write(const Item& item, double progressStart, double progressEnd, juce::String& error)
+{
+    const auto& buffer = *item.buffer;
+
+    if (buffer.getNumChannels() == 0 || buffer.getNumSamples() == 0) {
+        error = item.file.getFileName() + ": the impulse response is empty";
+        return false;
+    }
+
+    juce::TemporaryFile temporaryFile(item.file);
+    auto stream = std::make_unique<juce::FileOutputStream>(temporaryFile.getFile());
+
+    if (!stream->openedOk()) {
+        error = item.file.getFileName() + ": " + stream->getStatus().getErrorMessage();
+        return false;
+    }
+
+    bool written = false;
+
+    if (item.format == Format::RAW_FLOAT) {
+        written = writeRaw(item, *stream, progressStart, progressEnd);
+        stream->flush();
+        written = written && stream->getStatus().wasOk();
+        stream.reset();
+    } else {
+        std::unique_ptr<juce::AudioFormat> format;
+        int bitsPerSample = 24;
+
+        if (item.format == Format::FLAC_24) {
+            format = std::make_unique<juce::FlacAudioFormat>();
+        } else {
+            format = std::make_unique<juce::WavAudioFormat>();
+            bitsPerSample = item.format == Format::WAV_FLOAT ? 32 : 24;
+        }
+
+        std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(stream.get(), item.sampleRate, (unsigned int) buffer.getNumChannels(),
+                                                                               bitsPerSample, {}, 0));
+
+        if (writer == nullptr) {
+            error = item.file.getFileName() + ": " + getFormatName(item.format) + " does not support this impulse response";
+            return false;
+        }
+
+        // the writer owns the stream now
+        stream.release();
+        written = true;
+
+        for (int start = 0; start < buffer.getNumSamples() && written; start += samplesPerBlock) {
+            if (threadShouldExit()) {
+                return false;
+            }
+
+            auto const numToWrite = juce::jmin(samplesPerBlock, buffer.getNumSamples() - start);
+            written = writer->writeFromAudioSampleBuffer(buffer, start, numToWrite);
+
+            progress = progressStart + (progressEnd - progressStart) * (double) (start + numToWrite) / (double) buffer.getNumSamples();
+        }
+
+        // finishes the header
+        writer.reset();
+    }
+
+    if (!written || !temporaryFile.overwriteTargetFileWithTemporary()) {
+        error = item.file.getFileName() + ": could not be written";
+        return false;
+    }
+
+    return true;
+}
+
+bool ImpulseResponseExporter::writeRaw(const Item& item, juce::OutputStream& stream, double progressStart, double progressEnd)
+{
+    const auto& buffer = *item.buffer;
+    auto const numChannels = buffer.getNumChannels();
+
+    std::vector<float> interleaved((size_t) (samplesPerBlock * numChannels));
+
+    for (int start = 0; start < buffer.getNumSamples(); start += samplesPerBlock) {
+        if (threadShouldExit()) {
+            return false;
+        }
+
+        auto const numToWrite = juce::jmin(samplesPerBlock, buffer.getNumSamples() - start);
+
+        for (int sample = 0; sample < numToWrite; sample++) {
+            for (int channel = 0; channel < numChannels; channel++) {
+                interleaved[(size_t) (sample * numChannels + channel)] = buffer.getSample(channel, start + sample);
+            }
+        }
+
+       #if JUCE_BIG_ENDIAN
+        for (auto& value : interleaved) {
+            juce::uint32 bits;
+            std::memcpy(&bits, &value, sizeof(float));
+            bits = juce::ByteOrder::swap(bits);
+            std::memcpy(&value, &bits, sizeof(float));
+        }
+       #endif
+
+        if (!stream.write(interleaved.data(), (size_t) (numToWrite * numChannels) * sizeof(float))) {
+            return false;
+        }
+
+        progress = progressStart + (progressEnd - progressStart) * (double) (start + numToWrite) / (double) buffer.getNumSamples();
+    }
+
+    return true;
+}
+
+void ImpulseResponseExporter::handleAsyncUpdate()
+{
+    std::deque<Batch> batches;
+
+    {
+        const juce::ScopedLock lock(queueMutex);
+        std::swap(batches, finishedBatches);
+    }
+
+    for (auto& batch : batches) {
+        if (batch.callback != nullptr) {
+            batch.callback(batch.errors, batch.numFilesWritten);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Writes impulse responses to files on a background thread.
+ * Every export is a batch of files that is written in blocks, so the progress can be shown and the editor stays responsive.
+ * Batches that are started while another one is written are queued.
+ */
+class ImpulseResponseExporter : private juce::Thread,
+                                private juce::AsyncUpdater
+{
+public:
+    enum class Format {
+        WAV_24,
+        WAV_FLOAT,
+        FLAC_24,
+        RAW_FLOAT       // interleaved little endian 32 bit float samples without a header
+    };
+
+    struct Item {
+        juce::File file;
+        Format format;
+        std::shared_ptr<const juce::AudioBuffer<float>> buffer;
+        double sampleRate;
+    };
+
+    using Callback = std::function<void(const juce::StringArray& errors, int numFilesWritten)>;
+
+    ImpulseResponseExporter();
+    ~ImpulseResponseExporter() override;
+
+    void exportBatch(std::vector<Item> items, Callback onFinished);
+
+    bool isExporting() const;
+
+    static juce::String getFileExtension(Format format);
+    static juce::String getFileSuffix(Format format);
+    static juce::String getFormatName(Format format);
+
+    // written by the export thread and polled by a ProgressBar, like the progress of ThreadWithProgressWindow
+    double progress = 0.0;
+
+private:
+    struct Batch {
+        std::vector<Item> items;
+        Callback callback;
+        juce::StringArray errors;
+        int numFilesWritten = 0;
+    };
+
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    bool write(const Item& item, double progressStart, double progressEnd, juce::String& error);
+    bool writeRaw(const Item& item, juce::OutputStream& stream, double progressStart, double progressEnd);
+
+    static constexpr int samplesPerBlock = 65536;
+
+    juce::CriticalSection queueMutex;
+    std::deque<Batch> pendingBatches;
+    std::deque<Batch> finishedBatches;
+    bool exporting = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponseExporter)
+};
@@ -0,0 +1,101 @@
+#include "ImpulseResponseLoader.h"
+
+ImpulseResponseLoader::ImpulseResponseLoader(juce::AudioFormatManager& fm)
+    : juce::Thread("Impulse Response Loader")
+    , formatManager(fm)
+{
+}
+
+ImpulseResponseLoader::~ImpulseResponseLoader()
+{
+    cancel();
+}
+
+/**
+ * Starts loading the file, a load that is still running is cancelled and its result is dropped.
+ * Must be called on the message thread.
+ */
+void ImpulseResponseLoader::load(const juce::File& file, Callback onLoaded)
+{
+    cancel();
+
+    fileToLoad = file;
+    callback = std::move(onLoaded);
+    progress = 0.0;
+
+    startThread();
+}
+
+void ImpulseResponseLoader::cancel()
+{
+    stopThread(5000);
+    cancelPendingUpdate();
+}
+
+std::unique_ptr<juce::AudioFormatReader> ImpulseResponseLoader::createReader(const juce::File& file)
+{
+    if (auto* format = formatManager.findFormatForFileExtension(file.getFileExtension())) {
+        // only uncompressed formats can be mapped, the others return no reader
+        std::unique_ptr<juce::MemoryMappedAudioFormatReader> mappedReader(format->createMemoryMappedReader(file));
+
+        if (mappedReader != nullptr && mappedReader->mapEntireFile()) {
+            return mappedReader;
+        }
+    }
+
+    return std::unique_ptr<juce::AudioFormatReader>(formatManager.createReaderFor(file));
+}
+
+void ImpulseResponseLoader::run()
+{
+    Result loaded;
+    loaded.file = fileToLoad;
+
+    auto reader = createReader(fileToLoad);
+
+    if (reader == nullptr) {
+        loaded.error = "Could not read " + fileToLoad.getFileName();
+    } else if (reader->lengthInSamples > std::numeric_limits<int>::max()) {
+        loaded.error = fileToLoad.getFileName() + " is too long";
+    } else {
+        auto const numSamples = (int) reader->lengthInSamples;
+        auto buffer = std::make_shared<juce::AudioBuffer<float>>((int) reader->numChannels, numSamples);
+
+        // read in blocks, so the progress can be shown and a newer file can cancel the load
+        for (int start = 0; start < numSamples; start += samplesPerBlock) {
+            if (threadShouldExit()) {
+                return;
+            }
+
+            auto const numToRead = juce::jmin(samplesPerBlock, numSamples - start);
+            reader->read(buffer.get(), start, numToRead, start, true, true);
+
+            progress = (double) (start + numToRead) / (double) numSamples;
+        }
+
+        loaded.buffer = std::move(buffer);
+        loaded.sampleRate = reader->sampleRate;
+    }
+
+    {
+        const juce::ScopedLock lock(resultMutex);
+        result = std::move(loaded);
+    }
+
+    triggerAsyncUpdate();
+}
+
+void ImpulseResponseLoader::handleAsyncUpdate()
+{
+    Result loaded;
+
+    {
+        const juce::ScopedLock lock(resultMutex);
+        loaded = std::move(result);
+        result = {};
+    }
+
+    if (callback != nullptr) {
+        callback(loaded);
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Decodes an impulse response file on a background thread, exactly once.
+ * WAV and AIFF files are memory mapped, so the operating system pages the samples in while they are converted,
+ * other formats are read through a regular reader. The decoded buffer is handed to a callback on the message thread.
+ */
+class ImpulseResponseLoader : private juce::Thread,
+                              private juce::AsyncUpdater
+{
+public:
+    struct Result {
+        std::shared_ptr<juce::AudioBuffer<float>> buffer;
+        double sampleRate = 0.0;
+        juce::File file;
+        juce::String error;
+    };
+
+    using Callback = std::function<void(const Result&)>;
+
+    explicit ImpulseResponseLoader(juce::AudioFormatManager&);
+    ~ImpulseResponseLoader() override;
+
+    void load(const juce::File& file, Callback onLoaded);
+    void cancel();
+
+    bool isLoading() const  { return isThreadRunning(); }
+
+    // written by the loading thread and polled by a ProgressBar, like the progress of ThreadWithProgressWindow
+    double progress = 0.0;
+
+private:
+    void run() override;
+    void handleAsyncUpdate() override;
+
+    std::unique_ptr<juce::AudioFormatReader> createReader(const juce::File& file);
+
+    static constexpr int samplesPerBlock = 65536;
+
+    juce::AudioFormatManager& formatManager;
+
+    juce::File fileToLoad;
+    Callback callback;
+
+    juce::CriticalSection resultMutex;
+    Result result;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(ImpulseResponseLoader)
+};
@@ -24,7 +24,7 @@ private:
         explicit ObjectComponent(ObjectWindow& pw)
         : parentWindow(pw)
         {
-            setSize(400, 400);
+            setSize(400, 475);
 
             addAndMakeVisible(generalLabel);
             generalLabel.setFont(juce::Font(16.0f, juce::Font::bold));
@@ -81,7 +81,8 @@ private:
                                                  }
                                                  alreadyTakenLabel.setVisible(false);
                                              }
-                                         } };
+                                         }
+                                         updateDirectivityControls(); };
 
             addAndMakeVisible(positionLabel);
             positionLabel.setFont(juce::Font(16.0f, juce::Font::bold));
@@ -133,6 +134,24 @@ private:
             zRotationSlider.setNumDecimalPlacesToDisplay(2);
             zRotationLabel.attachToComponent(&zRotationSlider, false);
 
+            addAndMakeVisible(directivityLabel);
+            directivityLabel.setFont(juce::Font(16.0f, juce::Font::bold));
+
+            addAndMakeVisible(patternLabel);
+            addAndMakeVisible(patternMenu);
+            patternMenu.addItem("Omnidirectional", Raytracer::Directivity::Pattern::OMNIDIRECTIONAL + 1);
+            patternMenu.addItem("Subcardioid", Raytracer::Directivity::Pattern::SUBCARDIOID + 1);
+            patternMenu.addItem("Cardioid", Raytracer::Directivity::Pattern::CARDIOID + 1);
+            patternMenu.addItem("Supercardioid", Raytracer::Directivity::Pattern::SUPERCARDIOID + 1);
+            patternMenu.addItem("Hypercardioid", Raytracer::Directivity::Pattern::HYPERCARDIOID + 1);
+            patternMenu.addItem("Balloon data", Raytracer::Directivity::Pattern::BALLOON + 1);
+            patternMenu.setTooltip("Directivity pattern of the speaker. Rays are emitted proportionally to the pattern.");
+            patternMenu.onChange = [this] { updateDirectivityControls(); };
+
+            addAndMakeVisible(balloonFileLabel);
+            addAndMakeVisible(balloonFileLoadButton);
+            balloonFileLoadButton.onClick = [this] { openBalloonFile(); };
+
             addAndMakeVisible(cancelButton);
             cancelButton.onClick = [this] { parentWindow.closeButtonPressed(); };
 
@@ -200,6 +219,19 @@ private:
                 zRotationSlider.            setBounds(xyzArea.removeFromLeft(rotationArea.getWidth()/3));
             }
 
+            {   // Directivity
+                auto directivityArea = area.removeFromTop(75);
+                directivityLabel.           setBounds(directivityArea.removeFromTop(25));
+
+                auto patternArea = directivityArea.removeFromTop(25);
+                patternLabel.               setBounds(patternArea.removeFromLeft(directivityArea.getWidth()/3));
+                patternMenu.                setBounds(patternArea);
+
+                auto balloonArea = directivityArea.removeFromTop(25);
+                balloonFileLabel.           setBounds(balloonArea.removeFromLeft(directivityArea.getWidth()/3));
+                balloonFileLoadButton.      setBounds(balloonArea);
+            }
+
             {
                 auto buttonsArea = area.removeFromBottom(75);
 
@@ -245,8 +277,17 @@ private:
                     xPositionSlider.setValue(object.position.x, dontSendNotification);
                     yPositionSlider.setValue(object.position.y, dontSendNotification);
                     zPositionSlider.setValue(object.position.z, dontSendNotification);
+
+                    xRotationSlider.setValue(object.rotation.x, dontSendNotification);
+                    yRotationSlider.setValue(object.rotation.y, dontSendNotification);
+                    zRotationSlider.setValue(object.rotation.z, dontSendNotification);
+
+                    patternMenu.setSelectedId(object.directivity.pattern + 1, dontSendNotification);
+                    balloonFile = object.directivity.balloonFile;
                 }
             }
+
+            updateDirectivityControls();
         }
 
         void clearObjectProperties()
@@ -269,6 +310,10 @@ private:
             yRotationSlider.setValue(0.0f, dontSendNotification);
             zRotationSlider.setValue(0.0f, dontSendNotification);
 
+            patternMenu.setSelectedId(Raytracer::Directivity::Pattern::OMNIDIRECTIONAL + 1, dontSendNotification);
+            balloonFile = {};
+            updateDirectivityControls();
+
             okButton.setEnabled(false);
         }
 
@@ -281,6 +326,8 @@ private:
              newObject.active = activeToggle.getToggleState();
              newObject.type = static_cast<Raytracer::Object::Type>(typeMenu.getSelectedId());
              newObject.position = {xPositionSlider.getValue(), yPositionSlider.getValue(), zPositionSlider.getValue()};
+             newObject.rotation = {xRotationSlider.getValue(), yRotationSlider.getValue(), zRotationSlider.getValue()};
+             applyDirectivity(newObject);
 
              parentWindow.raytracer.objects.push_back(newObject);
              parentWindow.raytracer.saveObjects();
@@ -309,12 +356,62 @@ private:
                     object.position.x = (float) xPositionSlider.getValue();
                     object.position.y = (float) yPositionSlider.getValue();
                     object.position.z = (float) zPositionSlider.getValue();
+
+                    object.rotation.x = (float) xRotationSlider.getValue();
+                    object.rotation.y = (float) yRotationSlider.getValue();
+                    object.rotation.z = (float) zRotationSlider.getValue();
+
+                    applyDirectivity(object);
                 }
             }
 
             parentWindow.raytracer.saveObjects();
         }
 
+        void applyDirectivity(Raytracer::Object& object)
+        {
+            object.directivity.setRotation(object.rotation);
+            object.directivity.pattern = patternMenu.getSelectedId() > 0 ? static_cast<Raytracer::Directivity::Pattern>(patternMenu.getSelectedId() - 1)
+                                                                         : Raytracer::Directivity::Pattern::OMNIDIRECTIONAL;
+
+            if (balloonFile.isNotEmpty() && balloonFile != object.directivity.balloonFile) {
+                auto result = object.directivity.loadBalloon(File(balloonFile));
+
+                if (result.failed()) {
+                    AlertWindow::showMessageBoxAsync(MessageBoxIconType::WarningIcon, "Balloon data", result.getErrorMessage());
+                }
+            }
+        }
+
+        void updateDirectivityControls()
+        {
+            bool isSpeaker = typeMenu.getSelectedId() == Raytracer::Object::Type::SPEAKER;
+            bool usesBalloon = patternMenu.getSelectedId() == Raytracer::Directivity::Pattern::BALLOON + 1;
+
+            patternMenu.setEnabled(isSpeaker);
+            balloonFileLoadButton.setEnabled(isSpeaker && usesBalloon);
+            balloonFileLabel.setText(balloonFile.isEmpty() ? "No file selected" : File(balloonFile).getFileName(), dontSendNotification);
+        }
+
+        void openBalloonFile()
+        {
+            if (balloonFileChooser != nullptr)
+                return;
+
+            balloonFileChooser = std::make_unique<FileChooser>("Select a balloon data file...", File(), "*.txt,*.csv");
+
+            balloonFileChooser->launchAsync(FileBrowserComponent::openMode | FileBrowserComponent::canSelectFiles,
+                    [this] (const FileChooser& fc) mutable
+                    {
+                        if (fc.getResults().size() > 0) {
+                            balloonFile = fc.getResult().getFullPathName();
+                            updateDirectivityControls();
+                        }
+
+                        balloonFileChooser = nullptr;
+                    }, nullptr);
+        }
+
         bool checkNameAlreadyTaken(const String& name)
         {
             for (const auto& object : parentWindow.raytracer.objects) {
@@ -358,6 +455,14 @@ private:
         Label           zRotationLabel{{}, "Z Rotation"};
         Slider          zRotationSlider;
 
+        Label           directivityLabel{{}, "Directivity"};
+        Label           patternLabel{{}, "Pattern"};
+        ComboBox        patternMenu;
+        Label           balloonFileLabel{{}, "No file selected"};
+        TextButton      balloonFileLoadButton{"Load balloon data...", "Choose a file that contains tabulated directivity data of the speaker"};
+        String          balloonFile;
+        std::unique_ptr<juce::FileChooser> balloonFileChooser;
+
         TextButton      cancelButton{"Cancel"};
         TextButton      okButton{"Ok"};
     };
@@ -17,17 +17,27 @@ OpenGLComponent::OpenGLComponent(RaumsimulationAudioProcessor& p, juce::AudioPro
 
 
     openGLContext.setRenderer(this);
-    openGLContext.setContinuousRepainting(true);
+    openGLContext.setContinuousRepainting(false);
 
+    // multisampling is done in an off-screen frame buffer, so its level can follow the frame time
     OpenGLPixelFormat pixelFormat;
-    pixelFormat.multisamplingLevel = 16;
+    pixelFormat.multisamplingLevel = 0;
     openGLContext.setPixelFormat(pixelFormat);
-    openGLContext.setMultisamplingEnabled(true);
+    openGLContext.setMultisamplingEnabled(false);
     openGLContext.attachTo(*this);
+
+    parameters.state.addListener(this);
+
+   #if JUCE_DEBUG
+    // keeps the frame counter of the debug overlay up to date, otherwise the timer only runs during a render
+    startTimerHz(traceDataPollingRateHz);
+   #endif
 }
 
 OpenGLComponent::~OpenGLComponent()
 {
+    stopTimer();
+    parameters.state.removeListener(this);
     openGLContext.detach();
 }
 
@@ -42,6 +52,63 @@ void OpenGLComponent::resized()
     bounds = getLocalBounds();
     controlsOverlay->setBounds(bounds);
     draggableOrientation.setViewport(bounds);
+
+    requestRepaint();
+}
+
+/**
+ * The raytracer only sends change messages for some of the data it adds, so while it runs the number of
+ * secondary sources and ray paths is polled and a frame is requested whenever there is something new.
+ */
+void OpenGLComponent::timerCallback()
+{
+    auto const numSources = raytracer.secondarySources.size();
+    auto const sourceGeneration = raytracer.secondarySources.getGeneration();
+    auto const numRayPaths = raytracer.rayPaths.getNumPushed();
+
+    if (numSources != polledNumSources || sourceGeneration != polledSourceGeneration || numRayPaths != polledNumRayPaths) {
+        polledNumSources = numSources;
+        polledSourceGeneration = sourceGeneration;
+        polledNumRayPaths = numRayPaths;
+
+        requestRepaint();
+    }
+
+   #if JUCE_DEBUG
+    updateFrameCounter();
+   #else
+    if (!raytracer.isThreadRunning())
+        stopTimer();
+   #endif
+}
+
+/**
+ * Shows the frame rate in the debug overlay. The label is only changed while requested frames are
+ * being rendered and once more when they stop, changing it renders a frame itself.
+ */
+void OpenGLComponent::updateFrameCounter()
+{
+    auto const now = Time::getMillisecondCounterHiRes();
+
+    if (now - lastFrameCountTimeMS < frameCounterIntervalMS)
+        return;
+
+    auto const framesRendered = numFramesRendered.load();
+    auto const framesRequested = numFramesRequested.load();
+
+    bool const active = framesRequested != lastNumFramesRequested;
+
+    if (active || frameCounterShowsActivity) {
+        auto const framesPerSecond = (double) (framesRendered - lastNumFramesRendered) * 1000.0 / jmax(1.0, now - lastFrameCountTimeMS);
+
+        controlsOverlay->frameCounterLabel.setText(String(framesRendered) + " frames, " + String(active ? framesPerSecond : 0.0, 1) + " fps",
+                                                   dontSendNotification);
+        frameCounterShowsActivity = active;
+    }
+
+    lastNumFramesRendered = framesRendered;
+    lastNumFramesRequested = framesRequested;
+    lastFrameCountTimeMS = now;
 }
 
 void OpenGLComponent::newOpenGLContextCreated()
@@ -57,43 +124,41 @@ void OpenGLComponent::newOpenGLContextCreated()
 
                out vec4 destinationColor;
 
-               uniform mat4 projectionMatrix;
-               uniform mat4 viewMatrix;
-               uniform mat4 positionMatrix;
-               uniform mat4 rotationMatrix;
+               layout(std140, binding = 0) uniform Camera
+               {
+                   mat4 projectionMatrix;
+                   mat4 viewMatrix;
+               };
 
                void main()
                {
                    destinationColor = sourceColor;
-                   gl_Position = projectionMatrix * viewMatrix * positionMatrix * rotationMatrix * position;
+                   gl_Position = projectionMatrix * viewMatrix * position;
                }
             )";
 
-    String cFragmentShaderString =
+    String instancedVertexShaderString =
             R"(#version 450
-               in vec4 destinationColor;
+               in vec4 position;
+               in vec3 instancePosition;
+               in vec4 instanceColor;
 
-               layout(location = 0) out vec4 color;
+               out vec4 destinationColor;
 
-               void main()
+               layout(std140, binding = 0) uniform Camera
                {
-                   color = destinationColor;
-               }
-            )";
-
-    String roomFragmentShaderString =
-            R"(#version 450
-               in vec4 destinationColor;
-
-               layout(location = 0) out vec4 color;
+                   mat4 projectionMatrix;
+                   mat4 viewMatrix;
+               };
 
                void main()
                {
-                   color = vec4(0.50, 0.50, 0.50, 0.50);
+                   destinationColor = instanceColor;
+                   gl_Position = projectionMatrix * viewMatrix * (position + vec4(instancePosition, 0.0));
                }
             )";
 
-    String microphoneFragmentShaderString =
+    String cFragmentShaderString =
             R"(#version 450
                in vec4 destinationColor;
 
@@ -101,11 +166,11 @@ void OpenGLComponent::newOpenGLContextCreated()
 
                void main()
                {
-                   color = vec4(0.50, 0.00, 0.00, 0.75);
+                   color = destinationColor;
                }
             )";
 
-    String speakerFragmentShaderString =
+    String roomFragmentShaderString =
             R"(#version 450
                in vec4 destinationColor;
 
@@ -113,33 +178,85 @@ void OpenGLComponent::newOpenGLContextCreated()
 
                void main()
                {
-                   color = vec4(0.00, 0.00, 0.50, 0.75);
+                   color = vec4(0.50, 0.50, 0.50, 0.50);
                }
             )";
 
     genericShader = std::make_unique<Shader>(rmvpVertexShaderString, cFragmentShaderString, openGLContext);
     roomRRRShader = std::make_unique<Shader>(rmvpVertexShaderString, roomFragmentShaderString, openGLContext);
-    microphoneRRRShader = std::make_unique<Shader>(rmvpVertexShaderString, microphoneFragmentShaderString, openGLContext);
-    speakerRRRShader = std::make_unique<Shader>(rmvpVertexShaderString, speakerFragmentShaderString, openGLContext);
+    instancedShader = std::make_unique<Shader>(instancedVertexShaderString, cFragmentShaderString, openGLContext);
+
+    cameraBuffer = std::make_unique<UniformBuffer>((unsigned int) (32 * sizeof(float)));
+    coordCameraBuffer = std::make_unique<UniformBuffer>((unsigned int) (32 * sizeof(float)));
 
     updateRoomModel();
 
     roomAttributes = std::make_shared<OpenGLUtils::Attributes>(*roomRRRShader->getShaderProgram());
     visualizationAttributes = std::make_shared<OpenGLUtils::Attributes>(*genericShader->getShaderProgram());
     coordAttributes = std::make_shared<OpenGLUtils::Attributes>(*genericShader->getShaderProgram());
-    floodAttributes = std::make_shared<OpenGLUtils::Attributes>(*genericShader->getShaderProgram());
+    floodAttributes = std::make_shared<OpenGLUtils::Attributes>(*instancedShader->getShaderProgram());
 
     auto headFileStream = std::make_unique<MemoryInputStream>(BinaryData::ball_small_obj, BinaryData::ball_small_objSize, true);
     microphoneShape = std::make_shared<OpenGLUtils::Shape>(String(CharPointer_UTF8((const char*) headFileStream->getData())));
-    microphoneAttributes = std::make_shared<OpenGLUtils::Attributes>(*microphoneRRRShader->getShaderProgram());
+    microphoneAttributes = std::make_shared<OpenGLUtils::Attributes>(*instancedShader->getShaderProgram());
+    microphoneInstances = std::make_unique<InstanceBuffer>(*instancedShader->getShaderProgram());
 
     auto ballFileStream = std::make_unique<MemoryInputStream>(BinaryData::ball_small_obj, BinaryData::ball_small_objSize, true);
     speakerShape = std::make_shared<OpenGLUtils::Shape>(String(CharPointer_UTF8((const char*) ballFileStream->getData())));
-    speakerAttributes = std::make_shared<OpenGLUtils::Attributes>(*speakerRRRShader->getShaderProgram());
+    speakerAttributes = std::make_shared<OpenGLUtils::Attributes>(*instancedShader->getShaderProgram());
+    speakerInstances = std::make_unique<InstanceBuffer>(*instancedShader->getShaderProgram());
+
+    // every flood fill cube is an instance of a single point at the origin
+    OpenGLUtils::Vertex origin{{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}};
+    floodPoint = std::make_unique<VertexBuffer>(&origin, (unsigned int) sizeof(OpenGLUtils::Vertex));
+    floodInstances = std::make_unique<InstanceBuffer>(*instancedShader->getShaderProgram());
 }
 
 void OpenGLComponent::openGLContextClosing()
 {
+    const ScopedLock lock(shaderMutex);
+
+    // the buffers belong to this context, so they have to be deleted while it is still active
+    roomShape.reset();
+    microphoneShape.reset();
+    speakerShape.reset();
+    loadedRoomURL.clear();
+
+    roomAttributes.reset();
+    microphoneAttributes.reset();
+    speakerAttributes.reset();
+    visualizationAttributes.reset();
+    coordAttributes.reset();
+    floodAttributes.reset();
+
+    cameraBuffer.reset();
+    coordCameraBuffer.reset();
+    microphoneInstances.reset();
+    speakerInstances.reset();
+    floodInstances.reset();
+    floodPoint.reset();
+    rayPathBuffer.reset();
+
+    genericShader.reset();
+    roomRRRShader.reset();
+    instancedShader.reset();
+
+    visualizationBuffer.reset();
+    numVisualizedSources = 0;
+
+    if (pointTimerQuery != 0) {
+        juce::gl::glDeleteQueries(1, &pointTimerQuery);
+        pointTimerQuery = 0;
+        pointTimerQueryPending = false;
+    }
+
+    if (frameTimerQueries[0] != 0) {
+        juce::gl::glDeleteQueries(2, frameTimerQueries);
+        frameTimerQueries[0] = frameTimerQueries[1] = 0;
+        frameTimerQueriesPending = false;
+    }
+
+    multisampleFramebuffer.release();
 }
 
 void OpenGLComponent::renderOpenGL()
@@ -150,15 +267,38 @@ void OpenGLComponent::renderOpenGL()
 
     jassert(OpenGLHelpers::isContextActive());
 
+    numFramesRendered++;
+
+    if (repaintRequested.exchange(false))
+        numFramesRequested++;
+
+    auto const frameStartMS = Time::getMillisecondCounterHiRes();
     auto desktopScale = (float) openGLContext.getRenderingScale();
+    auto const backgroundColour = getLookAndFeel().findColour(ResizableWindow::backgroundColourId);
 
-    OpenGLHelpers::clear(getLookAndFeel().findColour(ResizableWindow::backgroundColourId));
+    OpenGLHelpers::clear(backgroundColour);
 
     updateRoomModel();
 
     if (roomRRRShader == nullptr)
         return;
 
+    // only one pair of timestamps is in flight, the render thread never waits for the GPU
+    bool const timeFrame = frameTimerQueries[0] != 0 && !frameTimerQueriesPending;
+
+    if (timeFrame)
+        glQueryCounter(frameTimerQueries[0], GL_TIMESTAMP);
+
+    const auto& quality = qualityLevels[(size_t) qualityLevel.load()];
+    auto const width = roundToInt(desktopScale * (float) bounds.getWidth());
+    auto const height = roundToInt(desktopScale * (float) bounds.getHeight());
+    bool const multisampled = multisampleFramebuffer.prepare(width, height, quality.multisampling);
+
+    if (multisampled) {
+        multisampleFramebuffer.bind();
+        OpenGLHelpers::clear(backgroundColour);
+    }
+
     // reset OpenGL state
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
@@ -167,108 +307,123 @@ void OpenGLComponent::renderOpenGL()
     glActiveTexture(GL_TEXTURE0);
     glEnable(GL_TEXTURE_2D);
 
-    glViewport(0, 0,
-        roundToInt(desktopScale * (float)bounds.getWidth()),
-        roundToInt(desktopScale * (float)bounds.getHeight()));
+    glViewport(0, 0, width, height);
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 
+    // CAMERA
+    auto const projectionMatrix = getProjectionMatrix();
+    auto const viewMatrix = getViewMatrix();
+
+    std::array<float, 32> camera;
+    std::copy(projectionMatrix.mat, projectionMatrix.mat + 16, camera.begin());
+    std::copy(viewMatrix.mat, viewMatrix.mat + 16, camera.begin() + 16);
+
+    cameraBuffer->update(camera.data());
+    cameraBuffer->bind(0);
+
     // ROOM
     glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);      // wireframe mode for room draw call
 
     roomRRRShader->bind();
-
-    roomRRRShader->setUniformMatrix4("projectionMatrix", getProjectionMatrix().mat, 1, false);
-    roomRRRShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-    roomRRRShader->setUniformMatrix4("positionMatrix", Matrix3D<float>().mat, 1 ,false);
-    roomRRRShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
-
     roomShape->draw(*roomAttributes);
 
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
-    // MICROPHONES
-    for (const auto& object : raytracer.objects) {
-        if (object.type == Raytracer::Object::MICROPHONE && object.active) {
-            auto microphoneMatrix = glm::translate(glm::mat4(1.0f), object.position);
+    // MICROPHONES & SPEAKERS
+    updateObjectInstances();
 
-            microphoneRRRShader->bind();
+    instancedShader->bind();
+    microphoneShape->drawInstanced(*microphoneAttributes, *microphoneInstances);
+    speakerShape->drawInstanced(*speakerAttributes, *speakerInstances);
 
-            microphoneRRRShader->setUniformMatrix4("projectionMatrix", getProjectionMatrix().mat, 1, false);
-            microphoneRRRShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-            microphoneRRRShader->setUniformMatrix4("positionMatrix", glm::value_ptr(microphoneMatrix), 1 ,false);
-            microphoneRRRShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
+    updateVisualizationVertexBuffers();
+    updateRayPaths();
 
-            microphoneShape->draw(*microphoneAttributes);
-        }
+    if (visualizedLOD) {
+        updatePointBudget();
+        updatePointCloudSelection();
     }
 
-    // SPEAKERS
-    for (const auto& object : raytracer.objects) {
-        if (object.type == Raytracer::Object::SPEAKER && object.active) {
-            auto speakerMatrix = glm::translate(glm::mat4(1.0f), object.position);
+    // VISUALIZATION
+    genericShader->bind();
 
-            speakerRRRShader->bind();
+    visualizationBuffer->bind();
 
-            speakerRRRShader->setUniformMatrix4("projectionMatrix", getProjectionMatrix().mat, 1, false);
-            speakerRRRShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-            speakerRRRShader->setUniformMatrix4("positionMatrix", glm::value_ptr(speakerMatrix), 1 ,false);
-            speakerRRRShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
+    glPointSize(3);
 
-            speakerShape->draw(*speakerAttributes);
-        }
-    }
+    // the query of an earlier frame has to be read before the next one can start
+    bool const timePoints = visualizedLOD && pointTimerQuery != 0 && !pointTimerQueryPending;
 
-    updateVisualizationVertexBuffers();
+    if (timePoints)
+        glBeginQuery(GL_TIME_ELAPSED, pointTimerQuery);
 
-    // VISUALIZATION
-    genericShader->bind();
+    visualizationAttributes->enable();
+    // the level of detail limits its point budget instead
+    auto const numDrawnPoints = visualizedLOD ? visualizationBuffer->size() : (size_t) ((float) visualizationBuffer->size() * quality.pointBudgetScale);
+    glDrawArrays(GL_POINTS, 0, (GLsizei) numDrawnPoints);
+    visualizationAttributes->disable();
 
-    genericShader->setUniformMatrix4("projectionMatrix", getProjectionMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("positionMatrix", Matrix3D<float>().mat, 1 ,false);
-    genericShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
+    if (timePoints) {
+        glEndQuery(GL_TIME_ELAPSED);
+        pointTimerQueryPending = true;
+    }
 
-    VertexBuffer secondarySourcesVertexBuffer(visualizationVertices.getRawDataPointer(), sizeof(OpenGLUtils::Vertex) * visualizationVertices.size());
+    // RAY PATHS
+    if (showRayPaths && rayPathBuffer != nullptr) {
+        genericShader->bind();
 
-    secondarySourcesVertexBuffer.bind();
+        rayPathBuffer->bind();
 
-    glPointSize(3);
+        // at lower quality only every n-th path is drawn
+        auto const rayPathStride = (size_t) roundToInt(1.0f / quality.rayPathDensity);
 
-    visualizationAttributes->enable();
-    glDrawElements(GL_POINTS, visualizationVertices.size(), GL_UNSIGNED_INT, nullptr);
-    visualizationAttributes->disable();
+        if (rayPathStride > 1) {
+            rayPathDrawFirsts.clear();
+            rayPathDrawCounts.clear();
 
-    // FLOOD FILL
-    genericShader->bind();
+            for (size_t slot = 0; slot < rayPathCounts.size(); slot += rayPathStride) {
+                rayPathDrawFirsts.push_back(rayPathFirsts[slot]);
+                rayPathDrawCounts.push_back(rayPathCounts[slot]);
+            }
+        }
 
-    genericShader->setUniformMatrix4("projectionMatrix", getProjectionMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("positionMatrix", Matrix3D<float>().mat, 1 ,false);
-    genericShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
+        const auto& firsts = rayPathStride > 1 ? rayPathDrawFirsts : rayPathFirsts;
+        const auto& counts = rayPathStride > 1 ? rayPathDrawCounts : rayPathCounts;
 
-    VertexBuffer cubesVertexBuffer(floodVertices.getRawDataPointer(), sizeof(OpenGLUtils::Vertex) * floodVertices.size());
+        visualizationAttributes->enable();
+        glMultiDrawArrays(GL_LINE_STRIP, firsts.data(), counts.data(), (GLsizei) counts.size());
+        visualizationAttributes->disable();
+    }
 
-    cubesVertexBuffer.bind();
+    // FLOOD FILL
+    if (floodInstances->size() > 0) {
+        instancedShader->bind();
 
-    glPointSize(3);
+        floodPoint->bind();
 
-    floodAttributes->enable();
-    glDrawElements(GL_POINTS, floodVertices.size(), GL_UNSIGNED_INT, nullptr);
-    floodAttributes->disable();
+        glPointSize(3);
+
+        floodAttributes->enable();
+        floodInstances->enable();
+        glDrawArraysInstanced(GL_POINTS, 0, 1, floodInstances->size());
+        floodInstances->disable();
+        floodAttributes->disable();
+    }
 
     // COORDINATE AXIS
     glViewport(0, 0,
                roundToInt(desktopScale * (float)bounds.getWidth() / 10),
                roundToInt(desktopScale * (float)bounds.getHeight() / 10));
 
-    genericShader->bind();
+    auto const coordProjectionMatrix = getCoordProjectionMatrix();
+    std::copy(coordProjectionMatrix.mat, coordProjectionMatrix.mat + 16, camera.begin());
 
-    genericShader->setUniformMatrix4("projectionMatrix", getCoordProjectionMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("viewMatrix", getViewMatrix().mat, 1, false);
-    genericShader->setUniformMatrix4("positionMatrix", Matrix3D<float>().mat, 1 ,false);
-    genericShader->setUniformMatrix4("rotationMatrix", Matrix3D<float>().mat, 1, false);
+    coordCameraBuffer->update(camera.data());
+    coordCameraBuffer->bind(0);
+
+    genericShader->bind();
 
     OpenGLUtils::Vertex oVertex{{0.0f, 0.0f, 0.0f},
             {0.0f, 0.0f, 0.0f},
@@ -308,12 +463,194 @@ void OpenGLComponent::renderOpenGL()
     glDrawElements(GL_LINES, coordIndexBuffer.getCount(), GL_UNSIGNED_INT, nullptr);
     coordAttributes->disable();
 
+    if (multisampled)
+        multisampleFramebuffer.resolve(openGLContext.getFrameBufferID());
+
+    if (timeFrame) {
+        glQueryCounter(frameTimerQueries[1], GL_TIMESTAMP);
+        frameTimerQueriesPending = true;
+    }
+
     // Reset the element buffers so child Components draw correctly
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-    if (!controlsOverlay->isMouseButtonDownThreadsafe())
+    updateQualityLevel(Time::getMillisecondCounterHiRes() - frameStartMS);
+
+    bool const rotating = !controlsOverlay->isMouseButtonDownThreadsafe() && rotationSpeed.getCurrentValue() > 0.0f;
+
+    if (rotating)
         rotation += rotationSpeed.getCurrentValue();
+
+    // keep rendering while the view moves or not all trace data has been shown yet
+    if (rotating
+        || numVisualizedSources < raytracer.secondarySources.size()
+        || (showRayPaths && raytracer.rayPaths.hasNext(rayPathReadIndex))
+        || (visualizedLOD && pointCloudSelectionPending))
+        requestRepaint();
+}
+
+/**
+ * Adapts the point budget of the level of detail to the time the GPU needed to draw the points.
+ * The query result is only read once it is available, so the render thread never waits for the GPU.
+ */
+void OpenGLComponent::updatePointBudget()
+{
+    using namespace ::juce::gl;
+
+    if (pointTimerQuery == 0) {
+        glGenQueries(1, &pointTimerQuery);
+        return;
+    }
+
+    if (!pointTimerQueryPending) {
+        return;
+    }
+
+    GLint available = 0;
+    glGetQueryObjectiv(pointTimerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+
+    if (available == 0) {
+        return;
+    }
+
+    GLuint64 elapsedNS = 0;
+    glGetQueryObjectui64v(pointTimerQuery, GL_QUERY_RESULT, &elapsedNS);
+    pointTimerQueryPending = false;
+
+    auto const elapsedMS = (double) elapsedNS / 1.0e6;
+    auto const qualityScale = (double) qualityLevels[(size_t) qualityLevel.load()].pointBudgetScale;
+    auto const largestBudget = jmax(minPointBudget, (size_t) ((double) maxPointBudget * qualityScale * visualizedPercentage / 100.0));
+
+    if (elapsedMS > 1.25 * pointDrawBudgetMS) {
+        pointBudget = jmax(minPointBudget, pointBudget * 4 / 5);
+    } else if (elapsedMS < 0.5 * pointDrawBudgetMS && pointCloudSelection.size() + 8 >= pointBudget) {
+        // only grow while the budget is what limits the detail
+        pointBudget = pointBudget * 5 / 4;
+    }
+
+    pointBudget = jmin(pointBudget, largestBudget);
+}
+
+/**
+ * Steps the multisampling, the point budget and the ray path density to hold the target frame time.
+ * The frame time is the longer of the time the render thread and the GPU spent on a frame, smoothed over
+ * several frames. After every step the new level gets some frames to settle before it is judged.
+ */
+void OpenGLComponent::updateQualityLevel(double cpuFrameTimeMS)
+{
+    using namespace ::juce::gl;
+
+    if (frameTimerQueries[0] == 0) {
+        glGenQueries(2, frameTimerQueries);
+        return;
+    }
+
+    if (frameTimerQueriesPending) {
+        GLint available = 0;
+        glGetQueryObjectiv(frameTimerQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (available != 0) {
+            GLuint64 startNS = 0, endNS = 0;
+            glGetQueryObjectui64v(frameTimerQueries[0], GL_QUERY_RESULT, &startNS);
+            glGetQueryObjectui64v(frameTimerQueries[1], GL_QUERY_RESULT, &endNS);
+
+            gpuFrameTimeMS = (double) (endNS - startNS) / 1.0e6;
+            frameTimerQueriesPending = false;
+        }
+    }
+
+    auto const frameTimeMS = jmax(cpuFrameTimeMS, gpuFrameTimeMS);
+    smoothedFrameTimeMS = smoothedFrameTimeMS > 0.0 ? 0.9 * smoothedFrameTimeMS + 0.1 * frameTimeMS : frameTimeMS;
+
+    if (++framesSinceQualityChange < qualitySettleFrames) {
+        return;
+    }
+
+    auto level = qualityLevel.load();
+
+    // the gap between both thresholds keeps the level from flipping back and forth
+    if (smoothedFrameTimeMS > 1.2 * targetFrameTimeMS && level > 0) {
+        level--;
+    } else if (smoothedFrameTimeMS < 0.6 * targetFrameTimeMS && level < (int) qualityLevels.size() - 1) {
+        level++;
+    } else {
+        return;
+    }
+
+    qualityLevel = level;
+    framesSinceQualityChange = 0;
+    smoothedFrameTimeMS = 0.0;
+
+    triggerAsyncUpdate();
+    requestRepaint();
+}
+
+String OpenGLComponent::getQualityDescription() const
+{
+    auto const level = qualityLevel.load();
+    const auto& quality = qualityLevels[(size_t) level];
+
+    return "Quality " + String(level + 1) + "/" + String(qualityLevels.size()) + ": "
+           + (quality.multisampling > 1 ? String(quality.multisampling) + "x MSAA" : String("no MSAA")) + ", "
+           + String(roundToInt(quality.pointBudgetScale * 100.0f)) + "% points, "
+           + String(roundToInt(quality.rayPathDensity * 100.0f)) + "% ray paths";
+}
+
+/**
+ * Selects the voxels of the level of detail for the current view and uploads them.
+ * A voxel is split until it covers no more pixels than a point, so the detail follows the zoom and the distance.
+ * The selection is redone at most ten times per second.
+ */
+void OpenGLComponent::updatePointCloudSelection()
+{
+    auto const viewMatrix = getViewMatrix();
+    auto const projectionMatrix = getProjectionMatrix();
+    auto const viewportWidth = (float) openGLContext.getRenderingScale() * (float) bounds.getWidth();
+
+    std::array<float, 33> view;
+    std::copy(viewMatrix.mat, viewMatrix.mat + 16, view.begin());
+    std::copy(projectionMatrix.mat, projectionMatrix.mat + 16, view.begin() + 16);
+    view[32] = viewportWidth;
+
+    auto const now = Time::getMillisecondCounterHiRes();
+
+    pointCloudSelectionPending = view != pointCloudSelectionView || pointCloudChanged || pointBudget != pointCloudSelectionBudget;
+
+    if (!pointCloudSelectionPending || now - pointCloudSelectionTimeMS < 100.0) {
+        return;
+    }
+
+    pointCloudSelectionPending = false;
+    pointCloudSelectionView = view;
+    pointCloudSelectionTimeMS = now;
+    pointCloudSelectionBudget = pointBudget;
+    pointCloudChanged = false;
+
+    // a length at distance d covers length * near / (half width * d) of the half viewport
+    float const pixelsPerUnit = projectionMatrix.mat[0] * viewportWidth / 2.0f;
+
+    auto const projectedSize = [&viewMatrix, pixelsPerUnit] (glm::vec3 center, float voxelSizeM) {
+        float const depth = -(viewMatrix.mat[2] * center.x + viewMatrix.mat[6] * center.y + viewMatrix.mat[10] * center.z + viewMatrix.mat[14]);
+        return voxelSizeM * pixelsPerUnit / jmax(depth, 0.1f);
+    };
+
+    pointCloudLOD.select(projectedSize, 3.0f, pointBudget, pointCloudSelection);
+
+    visualizationStaging.clear();
+
+    for (const auto& point : pointCloudSelection) {
+        auto colour = getPointColour(point.meanOrder, point.meanEnergy);
+
+        visualizationStaging.push_back({
+                {point.position.x, point.position.y, point.position.z},
+                {0.0f, 0.0f, 0.0f},
+                {colour.getFloatRed(), colour.getFloatGreen(), colour.getFloatBlue(), 0.5f},
+        });
+    }
+
+    visualizationBuffer->clear();
+    visualizationBuffer->append(visualizationStaging.data(), visualizationStaging.size());
 }
 
 Matrix3D<float> OpenGLComponent::getProjectionMatrix() const
@@ -3,6 +3,7 @@
 #include "JuceHeader.h"
 #include "OpenGLUtility.h"
 #include "PluginProcessor.h"
+#include "PointCloudLOD.h"
 #include "Raytracer.h"
 #include "WavefrontObjParser.h"
 #include "glm/glm.hpp"
@@ -116,6 +117,26 @@ struct OpenGLUtils
             }
         }
 
+        void drawInstanced(Attributes& attributes, InstanceBuffer& instances)
+        {
+            using namespace ::juce::gl;
+
+            if (instances.size() == 0)
+                return;
+
+            for (auto* vertexBuffer : vertexBuffers)
+            {
+                vertexBuffer->bind();
+                attributes.enable();
+
+                instances.enable();
+                glDrawElementsInstanced(GL_TRIANGLES, vertexBuffer->numIndices, GL_UNSIGNED_INT, nullptr, instances.size());
+                instances.disable();
+
+                attributes.disable();
+            }
+        }
+
     private:
         struct VertexBuffer
         {
@@ -188,7 +209,9 @@ struct OpenGLUtils
 class OpenGLComponent: public juce::Component,
                        public juce::OpenGLRenderer,
                        public ChangeListener,
-                       private juce::AsyncUpdater
+                       private juce::AsyncUpdater,
+                       private juce::ValueTree::Listener,
+                       private juce::Timer
 {
 public:
     OpenGLComponent(RaumsimulationAudioProcessor&, juce::AudioProcessorValueTreeState&, Raytracer&);
@@ -205,7 +228,27 @@ public:
 
     void changeListenerCallback(juce::ChangeBroadcaster* /*source*/) override
     {
+        {
+            const ScopedLock lock(shaderMutex);
+            statusText = raytracer.getRenderSummary();
+        }
+
+        triggerAsyncUpdate();
         controlsOverlay->repaint();
+        requestRepaint();
+
+        // a render has started, new trace data is polled until it ends
+        if (!isTimerRunning())
+            startTimerHz(traceDataPollingRateHz);
+    }
+
+    /**
+     * Renders a new frame, the view is only redrawn when something changed.
+     */
+    void requestRepaint()
+    {
+        repaintRequested = true;
+        openGLContext.triggerRepaint();
     }
 
     Matrix3D<float> getProjectionMatrix() const;
@@ -214,6 +257,11 @@ public:
 
     void setShaderProgram();
 
+    void updatePointCloudSelection();
+    void updatePointBudget();
+    void updateQualityLevel(double cpuFrameTimeMS);
+    String getQualityDescription() const;
+
     Rectangle<int> bounds;
     Draggable3DOrientation draggableOrientation;
     SmoothedValue<float, ValueSmoothingTypes::Linear> scale = 0.5f, rotationSpeed = 0.0f;
@@ -224,10 +272,39 @@ private:
 
     void handleAsyncUpdate() override
     {
-        const ScopedLock lock(shaderMutex); // Prevent concurrent access to shader strings and status
-        controlsOverlay->statusLabel.setText(statusText, dontSendNotification);
+        {
+            const ScopedLock lock(shaderMutex); // Prevent concurrent access to shader strings and status
+            controlsOverlay->statusLabel.setText(statusText, dontSendNotification);
+        }
+
+        controlsOverlay->qualityLabel.setText(getQualityDescription(), dontSendNotification);
     }
 
+    // settings, objects and the room are all stored in the state
+    void valueTreePropertyChanged(ValueTree&, const Identifier&) override  { requestRepaint(); }
+    void valueTreeChildAdded(ValueTree&, ValueTree&) override               { requestRepaint(); }
+    void valueTreeChildRemoved(ValueTree&, ValueTree&, int) override        { requestRepaint(); }
+    void valueTreeRedirected(ValueTree&) override                           { requestRepaint(); }
+
+    void timerCallback() override;
+    void updateFrameCounter();
+
+    static constexpr int traceDataPollingRateHz = 10;
+    size_t polledNumSources = 0;
+    juce::uint64 polledSourceGeneration = 0;
+    juce::uint64 polledNumRayPaths = 0;
+
+    // frames are counted for the debug overlay, the ones requested by requestRepaint() separately
+    // from the ones JUCE renders to composite the overlay, so updating the overlay does not keep the view busy
+    std::atomic<bool> repaintRequested{ false };
+    std::atomic<juce::int64> numFramesRendered{ 0 };
+    std::atomic<juce::int64> numFramesRequested{ 0 };
+    juce::int64 lastNumFramesRendered = 0;
+    juce::int64 lastNumFramesRequested = 0;
+    double lastFrameCountTimeMS = 0.0;
+    static constexpr double frameCounterIntervalMS = 500.0;
+    bool frameCounterShowsActivity = false;
+
     juce::OpenGLContext openGLContext;
 
     RaumsimulationAudioProcessor& audioProcessor;
@@ -272,6 +349,15 @@ private:
             objFileLabel.attachToComponent(&objFileLoadButton, false);
             objFileLabel.setText(openGLComponent.objFileURL.toString(false), sendNotificationAsync);
 
+            addAndMakeVisible(qualityLabel);
+            qualityLabel.setJustificationType(Justification::bottomLeft);
+            qualityLabel.setText(openGLComponent.getQualityDescription(), dontSendNotification);
+
+           #if JUCE_DEBUG
+            addAndMakeVisible(frameCounterLabel);
+            frameCounterLabel.setJustificationType(Justification::bottomLeft);
+           #endif
+
             lookAndFeelChanged();
         }
 
@@ -302,14 +388,16 @@ private:
                 auto min = order.removeFromTop(15);
                 auto max = order.removeFromBottom(15);
 
+                bool colorByEnergy = openGLComponent.parameters.state.getProperty("color_points_by_energy");
+
                 g.setFillType(getLookAndFeel().findColour(Label::textColourId));
-                g.drawText(String(openGLComponent.raytracer.minOrder), min, Justification::right, false);
-                g.drawText(String(openGLComponent.raytracer.maxOrder), max, Justification::right, false);
+                g.drawText(colorByEnergy ? "0 dB" : String(openGLComponent.raytracer.minOrder), min, Justification::right, false);
+                g.drawText(colorByEnergy ? String(-energyRangeDB, 0) + " dB" : String(openGLComponent.raytracer.maxOrder), max, Justification::right, false);
 
                 // make the area a square so the text is vertical on the right side after a 90-degree rotation with top-justification
                 order.expand(0, (order.getWidth() - order.getHeight()) / 2);
                 g.addTransform(AffineTransform::rotation(MathConstants<float>::pi / 2.0f, (float) order.getCentreX(), (float) order.getCentreY()));
-                g.drawText("Reflection Order", order, Justification::centredTop, false);
+                g.drawText(colorByEnergy ? "Energy" : "Reflection Order", order, Justification::centredTop, false);
             }
         }
 
@@ -330,6 +418,9 @@ private:
             {   // Bottom
                 auto bottom = area.removeFromBottom(25);
                 objFileLoadButton.setBounds(bottom.removeFromRight(1*area.getWidth()/2));
+                frameCounterLabel.setBounds(bottom);
+
+                qualityLabel.setBounds(area.removeFromBottom(20).removeFromLeft(area.getWidth()/2));
             }
         }
 
@@ -337,21 +428,29 @@ private:
 
         void mouseDown(const MouseEvent& e) override
         {
-            const ScopedLock lock(openGLComponent.mutex);
-            openGLComponent.draggableOrientation.mouseDown(e.getPosition());
+            {
+                const ScopedLock lock(openGLComponent.mutex);
+                openGLComponent.draggableOrientation.mouseDown(e.getPosition());
+            }
 
             buttonDown = true;
+            openGLComponent.requestRepaint();
         }
 
         void mouseDrag(const MouseEvent& e) override
         {
-            const ScopedLock lock(openGLComponent.mutex);
-            openGLComponent.draggableOrientation.mouseDrag(e.getPosition());
+            {
+                const ScopedLock lock(openGLComponent.mutex);
+                openGLComponent.draggableOrientation.mouseDrag(e.getPosition());
+            }
+
+            openGLComponent.requestRepaint();
         }
 
         void mouseUp(const MouseEvent&) override
         {
             buttonDown = false;
+            openGLComponent.requestRepaint();
         }
 
         void mouseWheelMove(const MouseEvent&, const MouseWheelDetails& d) override
@@ -365,14 +464,20 @@ private:
         }
 
         Label statusLabel;
+        Label qualityLabel;
+        Label frameCounterLabel;
 
     private:
         void sliderChanged()
         {
-            const ScopedLock lock(openGLComponent.mutex);
+            {
+                const ScopedLock lock(openGLComponent.mutex);
 
-            openGLComponent.scale = (float) zoomSlider.getValue();
-            openGLComponent.rotationSpeed = (float) speedSlider.getValue();
+                openGLComponent.scale = (float) zoomSlider.getValue();
+                openGLComponent.rotationSpeed = (float) speedSlider.getValue();
+            }
+
+            openGLComponent.requestRepaint();
         }
 
         OpenGLComponent& openGLComponent;
@@ -397,7 +502,12 @@ private:
                         if (fc.getURLResults().size() > 0)
                         {
                             auto result = fc.getURLResult();
-                            openGLComponent.objFileURL = result;
+
+                            {
+                                const ScopedLock lock(openGLComponent.mutex);
+                                openGLComponent.objFileURL = result;
+                            }
+
                             openGLComponent.parameters.state.setProperty("obj_file_url", result.toString(false), nullptr);
                             objFileLabel.setText(result.toString(false), sendNotificationAsync);
 
@@ -431,79 +541,342 @@ private:
     std::shared_ptr<OpenGLUtils::Attributes>    coordAttributes;
     std::shared_ptr<OpenGLUtils::Attributes>    floodAttributes;
 
+    // projection and view matrix, uploaded once per frame and shared by all shaders
+    std::unique_ptr<UniformBuffer>              cameraBuffer;
+    std::unique_ptr<UniformBuffer>              coordCameraBuffer;
+
+    // one instance buffer per object class, so every class is a single draw call
+    std::unique_ptr<InstanceBuffer>             microphoneInstances;
+    std::unique_ptr<InstanceBuffer>             speakerInstances;
+    std::unique_ptr<InstanceBuffer>             floodInstances;
+    std::unique_ptr<VertexBuffer>               floodPoint;
+    std::vector<InstanceBuffer::Instance>       objectInstances;
+
     CriticalSection shaderMutex;
     String statusText;
 
     std::unique_ptr<Shader> genericShader = nullptr;
     std::unique_ptr<Shader> roomRRRShader = nullptr;
-    std::unique_ptr<Shader> microphoneRRRShader = nullptr;
-    std::unique_ptr<Shader> speakerRRRShader = nullptr;
+    std::unique_ptr<Shader> instancedShader = nullptr;
+
+    // secondary sources are appended to the buffer as the raytracer records them
+    std::unique_ptr<StreamingVertexBuffer> visualizationBuffer;
+    std::vector<OpenGLUtils::Vertex> visualizationStaging;
+    size_t numVisualizedSources = 0;
+    juce::uint64 visualizedGeneration = 0;
+    int visualizedMaxOrder = 0;
+    float visualizedPercentage = 0.0f;
+    bool visualizedLOD = false;
+    bool visualizedColorByEnergy = false;
+    static constexpr size_t maxVisualizedSourcesPerFrame = 262144;
+
+    // with level of detail the sources are merged into voxels and only a selection of them is uploaded
+    PointCloudLOD pointCloudLOD;
+    std::vector<PointCloudLOD::Point> pointCloudSelection;
+    bool pointCloudChanged = false;
+    bool pointCloudSelectionPending = false;
+    std::array<float, 33> pointCloudSelectionView {};
+    double pointCloudSelectionTimeMS = 0.0;
+    size_t pointCloudSelectionBudget = 0;
+
+    // number of selected points, adapted to the time the GPU needs to draw them
+    size_t pointBudget = 500000;
+    GLuint pointTimerQuery = 0;
+    bool pointTimerQueryPending = false;
+    static constexpr double pointDrawBudgetMS = 4.0;
+    static constexpr size_t minPointBudget = 10000;
+    static constexpr size_t maxPointBudget = 4000000;
+
+    // sampled ray paths, every path owns a fixed range of the buffer and the oldest one is replaced first
+    std::unique_ptr<VertexBuffer> rayPathBuffer;
+    std::vector<RayPathRing::Path> visualizedRayPaths;
+    std::vector<GLint> rayPathFirsts;
+    std::vector<GLsizei> rayPathCounts;
+    std::vector<OpenGLUtils::Vertex> rayPathStaging;
+    juce::uint64 rayPathReadIndex = 0;
+    juce::uint32 visualizedRayPathGeneration = 0;
+    size_t nextRayPathSlot = 0;
+    bool showRayPaths = false;
+    int rayPathColorMaxOrder = 0;
+    bool rayPathColorByEnergy = false;
+    static constexpr int maxRayPathsPerFrame = 1024;
+
+    // quality is stepped down when frames take longer than the target and up again when they are much faster
+    struct QualityLevel {
+        int multisampling;
+        float pointBudgetScale;
+        float rayPathDensity;
+    };
+
+    static constexpr std::array<QualityLevel, 5> qualityLevels {{
+        { 0, 0.25f, 0.25f },
+        { 2, 0.50f, 0.50f },
+        { 4, 0.75f, 1.00f },
+        { 8, 1.00f, 1.00f },
+        { 16, 1.00f, 1.00f },
+    }};
+
+    std::atomic<int> qualityLevel { (int) qualityLevels.size() - 1 };
+    MultisampleFramebuffer multisampleFramebuffer;
+    GLuint frameTimerQueries[2] = { 0, 0 };
+    bool frameTimerQueriesPending = false;
+    double gpuFrameTimeMS = 0.0;
+    double smoothedFrameTimeMS = 0.0;
+    int framesSinceQualityChange = 0;
+    std::vector<GLint> rayPathDrawFirsts;
+    std::vector<GLsizei> rayPathDrawCounts;
+    static constexpr double targetFrameTimeMS = 16.0;
+    static constexpr int qualitySettleFrames = 30;
+
+    static constexpr float energyRangeDB = 60.0f;
+
+    Colour getPointColour(float order, float energy) const
+    {
+        if (visualizedColorByEnergy) {
+            float relativeLevel = energy > 0.0f ? jlimit(0.0f, 1.0f, -10.0f * std::log10(energy) / energyRangeDB) : 1.0f;
+            return Colour::fromHSV(1.0f - (1 - endHue) * relativeLevel, 1.0f, 0.5f, 1.0f);
+        }
+
+        float step = (1 - endHue) / (float) jmax(1, visualizedMaxOrder);
+        return Colour::fromHSV(1.0f - step * order, 1.0f, 0.5f, 1.0f);
+    }
 
-    Array<OpenGLUtils::Vertex> visualizationVertices;
     float startHue  = 1.00f;
     float endHue    = 0.55f;
-    Array<OpenGLUtils::Vertex> floodVertices;
+
+    // the uploaded room geometry is kept until another file is chosen or the file is modified
+    String loadedRoomURL;
+    Time loadedRoomModificationTime;
 
     void updateRoomModel()
     {
+        auto const roomURL = objFileURL.toString(false);
+        auto const modificationTime = objFileURL.isEmpty() ? Time() : objFileURL.getLocalFile().getLastModificationTime();
+
+        if (roomShape != nullptr && roomURL == loadedRoomURL && modificationTime == loadedRoomModificationTime) {
+            return;
+        }
+
         if (objFileURL.isEmpty()) {
             roomShape = std::make_shared<OpenGLUtils::Shape>();
         } else {
             roomShape = std::make_shared<OpenGLUtils::Shape>(objFileURL.getLocalFile());
         }
+
+        loadedRoomURL = roomURL;
+        loadedRoomModificationTime = modificationTime;
+    }
+
+    void updateObjectInstances()
+    {
+        for (auto type : {Raytracer::Object::MICROPHONE, Raytracer::Object::SPEAKER}) {
+            objectInstances.clear();
+
+            for (const auto& object : raytracer.objects) {
+                if (object.type == type && object.active) {
+                    if (type == Raytracer::Object::MICROPHONE) {
+                        objectInstances.push_back({{object.position.x, object.position.y, object.position.z}, {0.50f, 0.00f, 0.00f, 0.75f}});
+                    } else {
+                        objectInstances.push_back({{object.position.x, object.position.y, object.position.z}, {0.00f, 0.00f, 0.50f, 0.75f}});
+                    }
+                }
+            }
+
+            (type == Raytracer::Object::MICROPHONE ? microphoneInstances : speakerInstances)->update(objectInstances);
+        }
+    }
+
+    void uploadRayPaths(size_t firstSlot, size_t numSlots)
+    {
+        if (numSlots == 0) {
+            return;
+        }
+
+        rayPathStaging.assign(numSlots * RayPathRing::maxVertices, {});
+
+        for (size_t slot = firstSlot; slot < firstSlot + numSlots; slot++) {
+            const auto& path = visualizedRayPaths[slot];
+            auto* vertex = rayPathStaging.data() + (slot - firstSlot) * RayPathRing::maxVertices;
+
+            for (int vertexNum = 0; vertexNum < path.numVertices; vertexNum++, vertex++) {
+                auto const position = path.vertices[vertexNum].position;
+                auto const colour = getPointColour((float) vertexNum, path.vertices[vertexNum].energy);
+
+                *vertex = {
+                        {position.x, position.y, position.z},
+                        {0.0f, 0.0f, 0.0f},
+                        {colour.getFloatRed(), colour.getFloatGreen(), colour.getFloatBlue(), 0.75f},
+                };
+            }
+
+            rayPathCounts[slot] = path.numVertices;
+        }
+
+        rayPathBuffer->update((unsigned int) (firstSlot * RayPathRing::maxVertices * sizeof(OpenGLUtils::Vertex)),
+                              rayPathStaging.data(),
+                              (unsigned int) (rayPathStaging.size() * sizeof(OpenGLUtils::Vertex)));
+    }
+
+    /**
+     * Moves the ray paths that the raytracer recorded since the last frame into the line strip buffer.
+     * Nothing is read or drawn while the ray paths are hidden.
+     */
+    void updateRayPaths()
+    {
+        showRayPaths = parameters.state.getProperty("show_ray_paths");
+
+        if (!showRayPaths) {
+            return;
+        }
+
+        auto const& ring = raytracer.rayPaths;
+        auto const capacity = ring.getCapacity();
+
+        if (rayPathBuffer == nullptr) {
+            rayPathBuffer = std::make_unique<VertexBuffer>(nullptr, (unsigned int) (capacity * RayPathRing::maxVertices * sizeof(OpenGLUtils::Vertex)), juce::gl::GL_DYNAMIC_DRAW);
+            visualizedRayPaths.assign(capacity, {});
+            rayPathCounts.assign(capacity, 0);
+            rayPathFirsts.resize(capacity);
+
+            for (size_t slot = 0; slot < capacity; slot++) {
+                rayPathFirsts[slot] = (GLint) (slot * RayPathRing::maxVertices);
+            }
+
+            nextRayPathSlot = 0;
+        }
+
+        auto const generation = ring.getGeneration();
+
+        if (generation != visualizedRayPathGeneration) {
+            std::fill(rayPathCounts.begin(), rayPathCounts.end(), 0);
+            std::fill(visualizedRayPaths.begin(), visualizedRayPaths.end(), RayPathRing::Path());
+            nextRayPathSlot = 0;
+            visualizedRayPathGeneration = generation;
+        }
+
+        // the paths already uploaded are coloured again when the colours of the points change
+        if (visualizedMaxOrder != rayPathColorMaxOrder || visualizedColorByEnergy != rayPathColorByEnergy) {
+            rayPathColorMaxOrder = visualizedMaxOrder;
+            rayPathColorByEnergy = visualizedColorByEnergy;
+            uploadRayPaths(0, capacity);
+        }
+
+        size_t firstSlot = nextRayPathSlot;
+        RayPathRing::Path path;
+
+        for (int pathNum = 0; pathNum < maxRayPathsPerFrame && ring.readNext(rayPathReadIndex, path); pathNum++) {
+            if (path.generation != generation) {
+                continue;
+            }
+
+            visualizedRayPaths[nextRayPathSlot++] = path;
+
+            // contiguous slots are uploaded together
+            if (nextRayPathSlot == capacity) {
+                uploadRayPaths(firstSlot, nextRayPathSlot - firstSlot);
+                nextRayPathSlot = 0;
+                firstSlot = 0;
+            }
+        }
+
+        uploadRayPaths(firstSlot, nextRayPathSlot - firstSlot);
     }
 
     void updateVisualizationVertexBuffers()
     {
         // FLOOD FILL
-        if (floodVertices.size() != raytracer.cubes.size()) {
-            floodVertices.clear();
+        if ((size_t) floodInstances->size() != raytracer.cubes.size()) {
+            objectInstances.clear();
             for (auto cube : raytracer.cubes) {
-                OpenGLUtils::Vertex vertex{
+                objectInstances.push_back({
                         {(float) cube.x / 100.0f, (float) cube.y / 100.0f, (float) cube.z / 100.0f},
-                        {0.0f, 0.0f, 0.0f},
                         {1.0f, 1.0f , 1.0f, 0.5f},
-                };
-
-                floodVertices.add(vertex);
+                });
             }
+
+            floodInstances->update(objectInstances);
         }
 
         // VISUALIZATION
-        if (visualizationVertices.size() != raytracer.secondarySources.size()) {
-            visualizationVertices.clear();
-            float percentage = (float) parameters.state.getProperty("points_in_visualizer");
-            if (percentage > 0.0f) {
-                for (int i = 0; i < raytracer.secondarySources.size(); i ++) {
-                    if (i % (int) (100.0f/percentage) != 0) {
-                        continue;
-                    }
+        if (visualizationBuffer == nullptr) {
+            visualizationBuffer = std::make_unique<StreamingVertexBuffer>((unsigned int) sizeof(OpenGLUtils::Vertex));
+        }
+
+        float percentage = (float) parameters.state.getProperty("points_in_visualizer");
+        bool useLOD = parameters.state.getProperty("use_point_lod");
+        bool colorByEnergy = parameters.state.getProperty("color_points_by_energy");
+        auto const generation = raytracer.secondarySources.getGeneration();
+        auto const numSources = raytracer.secondarySources.size();
+
+        // start over if the sources were replaced or the colours of the points already uploaded changed
+        if (generation != visualizedGeneration || numSources < numVisualizedSources
+            || raytracer.maxOrder != visualizedMaxOrder || percentage != visualizedPercentage
+            || useLOD != visualizedLOD || colorByEnergy != visualizedColorByEnergy) {
+            visualizationBuffer->clear();
+            numVisualizedSources = 0;
+            visualizedGeneration = generation;
+            visualizedMaxOrder = raytracer.maxOrder;
+            visualizedPercentage = percentage;
+            visualizedLOD = useLOD;
+            visualizedColorByEnergy = colorByEnergy;
+
+            pointCloudLOD.clear();
+            pointCloudChanged = true;
+        }
+
+        if (numVisualizedSources == numSources) {
+            return;
+        }
+
+        // large batches are spread over several frames
+        auto const lastSource = jmin(numSources, numVisualizedSources + maxVisualizedSourcesPerFrame);
+        auto const sampleInterval = percentage > 0.0f ? (size_t) jmax(1, (int) (100.0f/percentage)) : (size_t) 0;
 
-                    auto secondarySource = raytracer.secondarySources[i];
+        if (visualizedLOD) {
+            // every source is added, the level of detail decides what is shown
+            raytracer.forEachSecondarySourceInRange(numVisualizedSources, lastSource, [&] (size_t, const Raytracer::SecondarySource& secondarySource) {
+                auto energy = secondarySource.energyCoefficients;
+                pointCloudLOD.add(secondarySource.position, secondarySource.order, energy.getAverage());
+            });
 
-                    float step = (1 - endHue) / (float) raytracer.maxOrder;
+            numVisualizedSources = lastSource;
+            pointCloudChanged = true;
+            return;
+        }
 
-                    auto colour = Colour::fromHSV(1.0f - step * (float) secondarySource.order, 1.0f, 0.5f, 1.0f);
+        auto directColor = glm::rgbColor(glm::vec3(360.0f, 1.0f, 0.5f ));
 
-                    OpenGLUtils::Vertex vertex{
-                            {raytracer.secondarySources[i].position.x, raytracer.secondarySources[i].position.y, raytracer.secondarySources[i].position.z},
-                            {raytracer.secondarySources[i].normal.x, raytracer.secondarySources[i].normal.y, raytracer.secondarySources[i].normal.z},
-                            {colour.getFloatRed(), colour.getFloatGreen(), colour.getFloatBlue(), 0.5f},
-                    };
+        visualizationStaging.clear();
 
-                    visualizationVertices.add(vertex);
+        // secondary sources are read as a stream, as they might have been moved to disk
+        raytracer.forEachSecondarySourceInRange(numVisualizedSources, lastSource, [&] (size_t index, const Raytracer::SecondarySource& secondarySource) {
+            if (sampleInterval == 0) {
+                if (index == 0) {
+                    visualizationStaging.push_back({
+                            {secondarySource.position.x, secondarySource.position.y, secondarySource.position.z},
+                            {secondarySource.normal.x, secondarySource.normal.y, secondarySource.normal.z},
+                            {directColor.r, directColor.g, directColor.b, 0.5f},
+                    });
                 }
-            } else if (!raytracer.secondarySources.empty()) {
-                auto color = glm::rgbColor(glm::vec3(360.0f, 1.0f, 0.5f ));
 
-                OpenGLUtils::Vertex vertex{
-                        {raytracer.secondarySources[0].position.x, raytracer.secondarySources[0].position.y, raytracer.secondarySources[0].position.z},
-                        {raytracer.secondarySources[0].normal.x, raytracer.secondarySources[0].normal.y, raytracer.secondarySources[0].normal.z},
-                        {color.r, color.g, color.b, 0.5f},
-                };
+                return;
+            }
 
-                visualizationVertices.add(vertex);
+            if (index % sampleInterval != 0) {
+                return;
             }
-        }
+
+            auto energy = secondarySource.energyCoefficients;
+            auto colour = getPointColour((float) secondarySource.order, energy.getAverage());
+
+            visualizationStaging.push_back({
+                    {secondarySource.position.x, secondarySource.position.y, secondarySource.position.z},
+                    {secondarySource.normal.x, secondarySource.normal.y, secondarySource.normal.z},
+                    {colour.getFloatRed(), colour.getFloatGreen(), colour.getFloatBlue(), 0.5f},
+            });
+        });
+
+        visualizationBuffer->append(visualizationStaging.data(), visualizationStaging.size());
+        numVisualizedSources = lastSource;
     }
 };
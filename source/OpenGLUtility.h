@@ -64,13 +64,13 @@ private:
 class VertexBuffer
 {
 public:
-    VertexBuffer(const void* data, unsigned int size)
+    VertexBuffer(const void* data, unsigned int size, GLenum usage = juce::gl::GL_STATIC_DRAW)
     {
         using namespace juce::gl;
 
         glGenBuffers(1, &vertexBuffer);
         glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glBufferData(GL_ARRAY_BUFFER, size, data, GL_STATIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, size, data, usage);
     }
 
     ~VertexBuffer()
@@ -99,6 +99,14 @@ public:
         }
     }
 
+    void update(unsigned int offset, const void* data, unsigned int size)
+    {
+        using namespace juce::gl;
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+    }
+
     void bind() const
     {
         using namespace juce::gl;
@@ -119,6 +127,346 @@ private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(VertexBuffer)
 };
 
+/**
+ * Vertex buffer that new vertices are appended to, it grows geometrically and keeps its content when it grows.
+ * Only the appended range is uploaded, so a large buffer can be filled a little every frame.
+ */
+class StreamingVertexBuffer
+{
+public:
+    explicit StreamingVertexBuffer(unsigned int itemSizeBytes)
+    : itemSize(itemSizeBytes)
+    {
+        using namespace juce::gl;
+
+        glGenBuffers(1, &vertexBuffer);
+    }
+
+    ~StreamingVertexBuffer()
+    {
+        using namespace juce::gl;
+
+        glDeleteBuffers(1, &vertexBuffer);
+    }
+
+    void append(const void* data, size_t count)
+    {
+        using namespace juce::gl;
+
+        if (count == 0) {
+            return;
+        }
+
+        if (numItems + count > capacity) {
+            reserve(std::max(numItems + count, 2 * capacity));
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr) (numItems * itemSize), (GLsizeiptr) (count * itemSize), data);
+        numItems += count;
+    }
+
+    /**
+     * Discards the content, the storage is orphaned so the driver does not wait for draw calls that still use it.
+     */
+    void clear()
+    {
+        using namespace juce::gl;
+
+        numItems = 0;
+
+        if (capacity > 0) {
+            glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (capacity * itemSize), nullptr, GL_DYNAMIC_DRAW);
+        }
+    }
+
+    void bind() const
+    {
+        using namespace juce::gl;
+
+        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    }
+
+    size_t size() const
+    {
+        return numItems;
+    }
+
+private:
+    void reserve(size_t newCapacity)
+    {
+        using namespace juce::gl;
+
+        newCapacity = std::max(newCapacity, minimumCapacity);
+
+        GLuint newBuffer;
+        glGenBuffers(1, &newBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr) (newCapacity * itemSize), nullptr, GL_DYNAMIC_DRAW);
+
+        // copied on the GPU, the vertices do not have to be uploaded again
+        if (numItems > 0) {
+            glBindBuffer(GL_COPY_READ_BUFFER, vertexBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr) (numItems * itemSize));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        }
+
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        glDeleteBuffers(1, &vertexBuffer);
+
+        vertexBuffer = newBuffer;
+        capacity = newCapacity;
+    }
+
+    static constexpr size_t minimumCapacity = 65536;
+
+    GLuint vertexBuffer;
+    size_t itemSize;
+    size_t numItems = 0;
+    size_t capacity = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamingVertexBuffer)
+};
+
+/**
+ * Off-screen multisampled frame buffer that is resolved into the frame buffer of the context.
+ * Unlike the multisampling of the pixel format, the number of samples can be changed while the context is alive.
+ */
+class MultisampleFramebuffer
+{
+public:
+    MultisampleFramebuffer() = default;
+
+    ~MultisampleFramebuffer()
+    {
+        release();
+    }
+
+    /**
+     * Reallocates the attachments when the size or the number of samples changed.
+     *
+     * @return Whether the frame buffer can be drawn to, false for no multisampling.
+     */
+    bool prepare(int newWidth, int newHeight, int newNumSamples)
+    {
+        using namespace juce::gl;
+
+        if (newWidth == width && newHeight == height && newNumSamples == requestedNumSamples) {
+            return framebuffer != 0;
+        }
+
+        release();
+
+        width = newWidth;
+        height = newHeight;
+        requestedNumSamples = newNumSamples;
+
+        if (newNumSamples <= 1 || newWidth <= 0 || newHeight <= 0) {
+            return false;
+        }
+
+        GLint maxSamples = 0;
+        glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+        auto const numSamples = juce::jmin(newNumSamples, (int) maxSamples);
+
+        glGenRenderbuffers(1, &colourBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, colourBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, numSamples, GL_RGBA8, width, height);
+
+        glGenRenderbuffers(1, &depthBuffer);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, numSamples, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colourBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+
+        bool const complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        if (!complete) {
+            release();
+            requestedNumSamples = newNumSamples;
+        }
+
+        return complete;
+    }
+
+    void bind() const
+    {
+        using namespace juce::gl;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    void resolve(GLuint targetFramebuffer) const
+    {
+        using namespace juce::gl;
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFramebuffer);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFramebuffer);
+    }
+
+    void release()
+    {
+        using namespace juce::gl;
+
+        if (framebuffer != 0)
+            glDeleteFramebuffers(1, &framebuffer);
+
+        if (colourBuffer != 0)
+            glDeleteRenderbuffers(1, &colourBuffer);
+
+        if (depthBuffer != 0)
+            glDeleteRenderbuffers(1, &depthBuffer);
+
+        framebuffer = colourBuffer = depthBuffer = 0;
+        width = height = requestedNumSamples = 0;
+    }
+
+private:
+    GLuint framebuffer = 0, colourBuffer = 0, depthBuffer = 0;
+    int width = 0, height = 0, requestedNumSamples = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MultisampleFramebuffer)
+};
+
+/**
+ * Buffer behind a uniform block, shared by all shaders that declare the block at the same binding point.
+ */
+class UniformBuffer
+{
+public:
+    explicit UniformBuffer(unsigned int sizeBytes)
+    : size(sizeBytes)
+    {
+        using namespace juce::gl;
+
+        glGenBuffers(1, &uniformBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~UniformBuffer()
+    {
+        using namespace juce::gl;
+
+        glDeleteBuffers(1, &uniformBuffer);
+    }
+
+    void update(const void* data)
+    {
+        using namespace juce::gl;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, uniformBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    void bind(unsigned int bindingPoint) const
+    {
+        using namespace juce::gl;
+
+        glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, uniformBuffer);
+    }
+
+private:
+    GLuint uniformBuffer;
+    unsigned int size;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(UniformBuffer)
+};
+
+/**
+ * Attributes that advance once per instance, every instance of a shape is drawn at its own position in its own color.
+ */
+class InstanceBuffer
+{
+public:
+    struct Instance
+    {
+        float position[3];
+        float color[4];
+    };
+
+    explicit InstanceBuffer(OpenGLShaderProgram& shader)
+    {
+        using namespace juce::gl;
+
+        glGenBuffers(1, &instanceBuffer);
+        positionLocation = glGetAttribLocation(shader.getProgramID(), "instancePosition");
+        colorLocation = glGetAttribLocation(shader.getProgramID(), "instanceColor");
+    }
+
+    ~InstanceBuffer()
+    {
+        using namespace juce::gl;
+
+        glDeleteBuffers(1, &instanceBuffer);
+    }
+
+    void update(const std::vector<Instance>& instances)
+    {
+        using namespace juce::gl;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr) (instances.size() * sizeof(Instance)), instances.data(), GL_DYNAMIC_DRAW);
+        numInstances = (int) instances.size();
+    }
+
+    void enable()
+    {
+        using namespace juce::gl;
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+
+        if (positionLocation >= 0) {
+            glVertexAttribPointer((GLuint) positionLocation, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), nullptr);
+            glEnableVertexAttribArray((GLuint) positionLocation);
+            glVertexAttribDivisor((GLuint) positionLocation, 1);
+        }
+
+        if (colorLocation >= 0) {
+            glVertexAttribPointer((GLuint) colorLocation, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (GLvoid*) (sizeof(float) * 3));
+            glEnableVertexAttribArray((GLuint) colorLocation);
+            glVertexAttribDivisor((GLuint) colorLocation, 1);
+        }
+    }
+
+    void disable()
+    {
+        using namespace juce::gl;
+
+        if (positionLocation >= 0) {
+            glVertexAttribDivisor((GLuint) positionLocation, 0);
+            glDisableVertexAttribArray((GLuint) positionLocation);
+        }
+
+        if (colorLocation >= 0) {
+            glVertexAttribDivisor((GLuint) colorLocation, 0);
+            glDisableVertexAttribArray((GLuint) colorLocation);
+        }
+    }
+
+    int size() const
+    {
+        return numInstances;
+    }
+
+private:
+    GLuint instanceBuffer;
+    GLint positionLocation, colorLocation;
+    int numInstances = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(InstanceBuffer)
+};
+
 class IndexBuffer
 {
 public:
@@ -0,0 +1,336 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Append-only array of trivially copyable items that is stored in fixed-size chunks.
+ * As soon as the chunks in memory exceed the memory budget, the oldest full chunks are written to a
+ * temporary file and read back through memory mapping, so the operating system can page them in and out.
+ *
+ * Items can be appended or replaced by one thread while other threads read them as a stream of chunks.
+ */
+template <typename Item>
+class OutOfCoreArray
+{
+public:
+    static_assert(std::is_trivially_copyable<Item>::value, "Items are written to disk byte by byte");
+
+    // chunks are a multiple of the page size, so spilled chunks can be mapped individually
+    static constexpr size_t itemsPerChunk = 65536;
+    static constexpr size_t bytesPerChunk = itemsPerChunk * sizeof(Item);
+
+    OutOfCoreArray() = default;
+
+    ~OutOfCoreArray()
+    {
+        clear();
+    }
+
+    void setMemoryBudget(size_t newMemoryBudgetBytes)
+    {
+        const ScopedLock lock(chunkMutex);
+        memoryBudgetBytes = jmax(newMemoryBudgetBytes, bytesPerChunk);
+    }
+
+    void clear()
+    {
+        const ScopedLock lock(chunkMutex);
+
+        // mappings have to be released before the file can be deleted
+        chunks.clear();
+        numItems = 0;
+        numChunksInMemory = 0;
+        peakNumChunksInMemory = 0;
+        generation++;
+
+        spillStream.reset();
+        spillFile.reset();
+        spillResult = Result::ok();
+    }
+
+    void push_back(const Item& item)
+    {
+        const ScopedLock lock(chunkMutex);
+
+        if (chunks.empty() || chunks.back().numItems == itemsPerChunk) {
+            Chunk chunk;
+            chunk.items = std::make_shared<std::vector<Item>>();
+            chunk.items->reserve(itemsPerChunk);
+            chunks.push_back(std::move(chunk));
+            numChunksInMemory++;
+
+            spillChunksOverBudget();
+            peakNumChunksInMemory = jmax(peakNumChunksInMemory, numChunksInMemory);
+        }
+
+        // the vector never reallocates, so readers can keep using pointers into it
+        chunks.back().items->push_back(item);
+        chunks.back().numItems++;
+        numItems++;
+    }
+
+    /**
+     * Replaces an item that was added before, only possible as long as its chunk has not been spilled.
+     * Readers that are using the chunk keep their copy, the item is replaced in a new one.
+     * Readers that follow the array incrementally do not notice, call markRewritten() to make them start over.
+     */
+    void set(size_t index, const Item& item)
+    {
+        const ScopedLock lock(chunkMutex);
+
+        jassert(index < numItems);
+        auto& chunk = chunks[index / itemsPerChunk];
+
+        jassert(!chunk.spilled);
+        if (chunk.spilled) {
+            return;
+        }
+
+        // readers only take a reference while the lock is held, so nobody else can be using an unshared chunk
+        if (chunk.items.use_count() > 1) {
+            auto copy = std::make_shared<std::vector<Item>>();
+            copy->reserve(itemsPerChunk);
+            copy->assign(chunk.items->begin(), chunk.items->end());
+            chunk.items = std::move(copy);
+        }
+
+        (*chunk.items)[index % itemsPerChunk] = item;
+    }
+
+    /**
+     * Tells readers that follow the array incrementally to start over.
+     */
+    void markRewritten()
+    {
+        const ScopedLock lock(chunkMutex);
+        generation++;
+    }
+
+    /**
+     * Changes whenever the array is cleared or rewritten, items that were read before under the same generation are still valid.
+     */
+    juce::uint64 getGeneration() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return generation;
+    }
+
+    size_t size() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return numItems;
+    }
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    Item operator[](size_t index) const
+    {
+        Item item {};
+
+        forChunk(index / itemsPerChunk, [&item, index] (const Item* items, size_t count) {
+            if (index % itemsPerChunk < count) {
+                item = items[index % itemsPerChunk];
+            }
+        });
+
+        return item;
+    }
+
+    /**
+     * Calls function(const Item* items, size_t count) once for every chunk, in the order the items were added.
+     * The chunk is kept alive during the call, no lock is held.
+     */
+    template <typename Function>
+    void forEachChunk(Function&& function) const
+    {
+        for (size_t chunkNum = 0; forChunk(chunkNum, function); chunkNum++) {}
+    }
+
+    /**
+     * Calls function(const Item& item) for every item, in the order the items were added.
+     */
+    template <typename Function>
+    void forEach(Function&& function) const
+    {
+        forEachChunk([&function] (const Item* items, size_t count) {
+            for (size_t itemNum = 0; itemNum < count; itemNum++) {
+                function(items[itemNum]);
+            }
+        });
+    }
+
+    /**
+     * Calls function(size_t index, const Item& item) for the items from first up to, not including, last.
+     */
+    template <typename Function>
+    void forEachInRange(size_t first, size_t last, Function&& function) const
+    {
+        for (size_t chunkNum = first / itemsPerChunk; first < last; chunkNum++) {
+            auto const chunkStart = chunkNum * itemsPerChunk;
+
+            bool const exists = forChunk(chunkNum, [&] (const Item* items, size_t count) {
+                for (size_t itemNum = first - chunkStart; itemNum < count && chunkStart + itemNum < last; itemNum++) {
+                    function(chunkStart + itemNum, items[itemNum]);
+                }
+            });
+
+            if (!exists) {
+                break;
+            }
+
+            first = chunkStart + itemsPerChunk;
+        }
+    }
+
+    size_t getNumChunks() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return chunks.size();
+    }
+
+    size_t getNumSpilledChunks() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return chunks.size() - numChunksInMemory;
+    }
+
+    size_t getMemoryUsageBytes() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return numChunksInMemory * bytesPerChunk;
+    }
+
+    size_t getPeakMemoryUsageBytes() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return peakNumChunksInMemory * bytesPerChunk;
+    }
+
+    /**
+     * Fails if the temporary file could not be opened or written, from then on all chunks stay in memory.
+     * Also fails if a spilled chunk could not be mapped, its items are skipped by the readers.
+     */
+    Result getSpillResult() const
+    {
+        const ScopedLock lock(chunkMutex);
+        return spillResult;
+    }
+
+private:
+    struct Chunk {
+        size_t numItems = 0;
+        std::shared_ptr<std::vector<Item>> items;
+
+        bool spilled = false;
+        juce::int64 fileOffset = 0;
+        mutable std::shared_ptr<MemoryMappedFile> mapping;
+    };
+
+    std::vector<Chunk> chunks;
+    size_t numItems = 0;
+    size_t numChunksInMemory = 0;
+    size_t peakNumChunksInMemory = 0;
+    juce::uint64 generation = 0;
+    size_t memoryBudgetBytes = 1024 * 1024 * 1024;
+
+    std::unique_ptr<TemporaryFile> spillFile;
+    std::unique_ptr<FileOutputStream> spillStream;
+    mutable Result spillResult = Result::ok();
+
+    CriticalSection chunkMutex;
+
+    /**
+     * Writes the oldest chunks that are still in memory to the temporary file, the chunk that is being filled stays in memory.
+     */
+    void spillChunksOverBudget()
+    {
+        for (size_t chunkNum = 0; numChunksInMemory * bytesPerChunk > memoryBudgetBytes && chunkNum + 1 < chunks.size(); chunkNum++) {
+            auto& chunk = chunks[chunkNum];
+
+            if (chunk.spilled) {
+                continue;
+            }
+
+            if (spillStream == nullptr) {
+                spillFile = std::make_unique<TemporaryFile>(".chunks");
+                spillStream = std::make_unique<FileOutputStream>(spillFile->getFile());
+
+                if (spillStream->failedToOpen()) {
+                    spillResult = Result::fail("Could not open " + spillFile->getFile().getFullPathName() + ", keeping everything in memory");
+                    spillStream.reset();
+                    spillFile.reset();
+                    memoryBudgetBytes = std::numeric_limits<size_t>::max();
+                    return;
+                }
+            }
+
+            chunk.fileOffset = spillStream->getPosition();
+
+            if (!spillStream->write(chunk.items->data(), bytesPerChunk)) {
+                spillResult = Result::fail("Could not write to " + spillFile->getFile().getFullPathName() + ", keeping everything in memory");
+                memoryBudgetBytes = std::numeric_limits<size_t>::max();
+                return;
+            }
+
+            spillStream->flush();
+
+            // readers that still use the items keep them alive until they are done
+            chunk.items.reset();
+            chunk.spilled = true;
+            numChunksInMemory--;
+        }
+    }
+
+    /**
+     * Calls the function with the items of the chunk.
+     *
+     * @return False if there is no such chunk.
+     */
+    template <typename Function>
+    bool forChunk(size_t chunkNum, Function&& function) const
+    {
+        std::shared_ptr<const void> keepAlive;
+        const Item* items = nullptr;
+        size_t count = 0;
+
+        {
+            const ScopedLock lock(chunkMutex);
+
+            if (chunkNum >= chunks.size()) {
+                return false;
+            }
+
+            const auto& chunk = chunks[chunkNum];
+            count = chunk.numItems;
+
+            if (chunk.spilled) {
+                if (chunk.mapping == nullptr) {
+                    chunk.mapping = std::make_shared<MemoryMappedFile>(spillFile->getFile(),
+                                                                       Range<juce::int64>(chunk.fileOffset, chunk.fileOffset + (juce::int64) bytesPerChunk),
+                                                                       MemoryMappedFile::readOnly);
+                }
+
+                keepAlive = chunk.mapping;
+                items = static_cast<const Item*>(chunk.mapping->getData());
+
+                if (items == nullptr && spillResult.wasOk()) {
+                    spillResult = Result::fail("Could not map " + spillFile->getFile().getFullPathName() + ", secondary sources are missing");
+                }
+            } else {
+                keepAlive = chunk.items;
+                items = chunk.items->data();
+            }
+        }
+
+        if (items != nullptr && count > 0) {
+            function(items, count);
+        }
+
+        return true;
+    }
+
+    JUCE_DECLARE_NON_COPYABLE(OutOfCoreArray)
+};
@@ -0,0 +1,337 @@
+#include "PartitionedConvolver.h"
+
+PartitionedConvolver::PartitionedConvolver(const ImpulseResponse& impulseResponse, double sampleRate, int numChannels, bool normalise)
+    : processSampleRate(sampleRate)
+{
+    auto const samples = prepareImpulseResponse(impulseResponse, sampleRate, normalise);
+
+    impulseResponseLength = samples.getNumSamples();
+
+    auto const headSamples = juce::jmin(impulseResponseLength, headLength);
+    auto const tailSamples = impulseResponseLength - headSamples;
+
+    numPartitions = juce::jmax(1, (headSamples + partitionSize - 1) / partitionSize);
+    impulseResponseSpectra = transformPartitions(samples, 0, headSamples, partitionSize, fftOrder);
+
+    if (tailSamples > 0) {
+        tailSpectra = transformPartitions(samples, headLength, tailSamples, tailPartitionSize, tailFftOrder);
+    }
+
+    auto const numTailPartitions = (tailSamples + tailPartitionSize - 1) / tailPartitionSize;
+
+    channels.resize((size_t) numChannels);
+
+    for (int channelNum = 0; channelNum < numChannels; channelNum++) {
+        auto& channel = channels[(size_t) channelNum];
+
+        // a stereo impulse response is applied channel by channel, a mono one to every channel
+        auto const irChannel = (size_t) juce::jmin(channelNum, (int) impulseResponseSpectra.size() - 1);
+        channel.partitions = &impulseResponseSpectra[irChannel];
+
+        channel.fft = std::make_unique<juce::dsp::FFT>(fftOrder);
+        channel.inputBlock.resize((size_t) partitionSize);
+        channel.fftBuffer.resize((size_t) (2 * fftSize));
+        channel.inputSpectra.resize((size_t) (numPartitions * numBins));
+        channel.tailSpectrum.resize((size_t) numBins);
+        channel.overlap.resize((size_t) partitionSize);
+
+        if (numTailPartitions > 0) {
+            auto job = std::make_unique<TailJob>();
+            job->partitions = &tailSpectra[irChannel];
+            job->numPartitions = numTailPartitions;
+            job->fft = std::make_unique<juce::dsp::FFT>(tailFftOrder);
+            job->inputBlock.resize((size_t) tailPartitionSize);
+            job->fftBuffer.resize((size_t) (4 * tailPartitionSize));
+            job->inputSpectra.resize((size_t) (numTailPartitions * tailNumBins));
+            job->overlap.resize((size_t) tailPartitionSize);
+            job->outputBlock.resize((size_t) tailPartitionSize);
+
+            channel.tailInput.resize((size_t) tailPartitionSize);
+            channel.tailOutput.resize((size_t) tailPartitionSize);
+            channel.tailJob = std::move(job);
+        }
+    }
+
+    for (auto& channel : channels) {
+        if (channel.tailJob != nullptr) {
+            scheduler->add(channel.tailJob.get());
+        }
+    }
+}
+
+PartitionedConvolver::~PartitionedConvolver()
+{
+    for (auto& channel : channels) {
+        if (channel.tailJob != nullptr) {
+            scheduler->remove(channel.tailJob.get());
+        }
+    }
+}
+
+/**
+ * Spectra of the partitions of every channel, each partition zero padded to twice its size.
+ */
+std::vector<PartitionedConvolver::Spectrum> PartitionedConvolver::transformPartitions(const juce::AudioBuffer<float>& samples, int start, int length, int size, int order)
+{
+    auto const count = juce::jmax(1, (length + size - 1) / size);
+    auto const bins = size + 1;
+
+    juce::dsp::FFT fft(order);
+    std::vector<float> fftBuffer((size_t) (4 * size));
+    std::vector<Spectrum> spectra;
+
+    for (int channel = 0; channel < juce::jmax(1, samples.getNumChannels()); channel++) {
+        Spectrum channelSpectra((size_t) (count * bins));
+
+        for (int partition = 0; partition < count && channel < samples.getNumChannels(); partition++) {
+            auto const partitionLength = juce::jmin(size, length - partition * size);
+
+            std::fill(fftBuffer.begin(), fftBuffer.end(), 0.0f);
+
+            if (partitionLength > 0) {
+                std::copy_n(samples.getReadPointer(channel, start + partition * size), partitionLength, fftBuffer.begin());
+            }
+
+            fft.performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+            auto const* transformed = reinterpret_cast<const std::complex<float>*>(fftBuffer.data());
+            std::copy_n(transformed, bins, channelSpectra.begin() + partition * bins);
+        }
+
+        spectra.push_back(std::move(channelSpectra));
+    }
+
+    return spectra;
+}
+
+/**
+ * Resamples, trims silence at both ends and normalises, the same way the impulse responses were prepared for juce::dsp::Convolution.
+ */
+juce::AudioBuffer<float> PartitionedConvolver::prepareImpulseResponse(const ImpulseResponse& impulseResponse, double sampleRate, bool normalise)
+{
+    const auto& source = impulseResponse.samples;
+    auto const numChannels = juce::jmin(2, source.getNumChannels());
+
+    if (numChannels == 0 || source.getNumSamples() == 0) {
+        return {};
+    }
+
+    juce::AudioBuffer<float> samples;
+
+    if (impulseResponse.sampleRate > 0.0 && sampleRate > 0.0 && impulseResponse.sampleRate != sampleRate) {
+        auto const ratio = impulseResponse.sampleRate / sampleRate;
+        samples.setSize(numChannels, (int) std::ceil(source.getNumSamples() / ratio));
+
+        for (int channel = 0; channel < numChannels; channel++) {
+            juce::LagrangeInterpolator interpolator;
+            interpolator.process(ratio, source.getReadPointer(channel), samples.getWritePointer(channel), samples.getNumSamples(), source.getNumSamples(), 0);
+        }
+    } else {
+        samples.makeCopyOf(source);
+        samples.setSize(numChannels, samples.getNumSamples(), true);
+    }
+
+    auto const threshold = juce::Decibels::decibelsToGain(-80.0f);
+    int first = samples.getNumSamples();
+    int last = 0;
+
+    for (int channel = 0; channel < numChannels; channel++) {
+        auto const* channelSamples = samples.getReadPointer(channel);
+
+        for (int sample = 0; sample < samples.getNumSamples(); sample++) {
+            if (std::abs(channelSamples[sample]) > threshold) {
+                first = juce::jmin(first, sample);
+                last = juce::jmax(last, sample + 1);
+            }
+        }
+    }
+
+    if (last <= first) {
+        return {};
+    }
+
+    juce::AudioBuffer<float> trimmed(numChannels, last - first);
+
+    for (int channel = 0; channel < numChannels; channel++) {
+        trimmed.copyFrom(channel, 0, samples, channel, first, last - first);
+    }
+
+    if (normalise) {
+        float maxEnergy = 0.0f;
+
+        for (int channel = 0; channel < numChannels; channel++) {
+            auto const* channelSamples = trimmed.getReadPointer(channel);
+            maxEnergy = juce::jmax(maxEnergy, std::inner_product(channelSamples, channelSamples + trimmed.getNumSamples(), channelSamples, 0.0f));
+        }
+
+        if (maxEnergy > 0.0f) {
+            trimmed.applyGain(0.125f / std::sqrt(maxEnergy));
+        }
+    }
+
+    return trimmed;
+}
+
+void PartitionedConvolver::reset() noexcept
+{
+    for (auto& channel : channels) {
+        std::fill(channel.inputBlock.begin(), channel.inputBlock.end(), 0.0f);
+        std::fill(channel.inputSpectra.begin(), channel.inputSpectra.end(), std::complex<float>());
+        std::fill(channel.tailSpectrum.begin(), channel.tailSpectrum.end(), std::complex<float>());
+        std::fill(channel.overlap.begin(), channel.overlap.end(), 0.0f);
+
+        channel.inputPosition = 0;
+        channel.currentSpectrum = 0;
+
+        if (channel.tailJob != nullptr) {
+            // a worker may still be computing the last block
+            if (channel.tailJobQueued) {
+                channel.tailJob->finish();
+                channel.tailJobQueued = false;
+            }
+
+            channel.tailJob->reset();
+            std::fill(channel.tailInput.begin(), channel.tailInput.end(), 0.0f);
+            std::fill(channel.tailOutput.begin(), channel.tailOutput.end(), 0.0f);
+            channel.tailPosition = 0;
+        }
+    }
+}
+
+void PartitionedConvolver::multiplyAccumulate(const std::complex<float>* a, const std::complex<float>* b, std::complex<float>* result, int count) noexcept
+{
+    for (int bin = 0; bin < count; bin++) {
+        result[bin] += a[bin] * b[bin];
+    }
+}
+
+void PartitionedConvolver::process(int channelNum, const float* input, float* output, int numSamples) noexcept
+{
+    auto& channel = channels[(size_t) channelNum];
+    auto const* partitions = channel.partitions->data();
+    auto* bins = reinterpret_cast<std::complex<float>*>(channel.fftBuffer.data());
+
+    // the tail blocks are multiples of the head blocks, so a chunk never crosses the end of a tail block
+    for (int processed = 0; processed < numSamples;) {
+        auto const numToProcess = juce::jmin(numSamples - processed, partitionSize - channel.inputPosition);
+        bool const blockStarts = channel.inputPosition == 0;
+
+        std::copy_n(input + processed, numToProcess, channel.inputBlock.begin() + channel.inputPosition);
+
+        if (channel.tailJob != nullptr) {
+            std::copy_n(input + processed, numToProcess, channel.tailInput.begin() + channel.tailPosition);
+        }
+
+        // spectrum of the current block, as far as it is known
+        std::copy(channel.inputBlock.begin(), channel.inputBlock.end(), channel.fftBuffer.begin());
+        std::fill(channel.fftBuffer.begin() + partitionSize, channel.fftBuffer.end(), 0.0f);
+        channel.fft->performRealOnlyForwardTransform(channel.fftBuffer.data(), true);
+
+        auto* currentSpectrum = channel.inputSpectra.data() + channel.currentSpectrum * numBins;
+        std::copy_n(bins, numBins, currentSpectrum);
+
+        // the past blocks do not change while the current one is filled, their contribution is summed up once
+        if (blockStarts) {
+            std::fill(channel.tailSpectrum.begin(), channel.tailSpectrum.end(), std::complex<float>());
+
+            for (int partition = 1; partition < numPartitions; partition++) {
+                auto const past = (channel.currentSpectrum - partition + numPartitions) % numPartitions;
+                multiplyAccumulate(channel.inputSpectra.data() + past * numBins, partitions + partition * numBins, channel.tailSpectrum.data(), numBins);
+            }
+        }
+
+        std::copy(channel.tailSpectrum.begin(), channel.tailSpectrum.end(), bins);
+        multiplyAccumulate(currentSpectrum, partitions, bins, numBins);
+
+        channel.fft->performRealOnlyInverseTransform(channel.fftBuffer.data());
+
+        for (int sample = 0; sample < numToProcess; sample++) {
+            auto const position = channel.inputPosition + sample;
+            output[processed + sample] = channel.fftBuffer[(size_t) position] + channel.overlap[(size_t) position];
+        }
+
+        if (channel.tailJob != nullptr) {
+            juce::FloatVectorOperations::add(output + processed, channel.tailOutput.data() + channel.tailPosition, numToProcess);
+            channel.tailPosition += numToProcess;
+
+            if (channel.tailPosition == tailPartitionSize) {
+                advanceTail(channel);
+                channel.tailPosition = 0;
+            }
+        }
+
+        channel.inputPosition += numToProcess;
+        processed += numToProcess;
+
+        if (channel.inputPosition == partitionSize) {
+            std::copy_n(channel.fftBuffer.begin() + partitionSize, partitionSize, channel.overlap.begin());
+            std::fill(channel.inputBlock.begin(), channel.inputBlock.end(), 0.0f);
+
+            channel.inputPosition = 0;
+            channel.currentSpectrum = (channel.currentSpectrum + 1) % numPartitions;
+        }
+    }
+}
+
+/**
+ * Called when a tail block of input is complete. The block that was queued one block earlier is needed from now on,
+ * the new one is queued with the end of the next block as its deadline.
+ */
+void PartitionedConvolver::advanceTail(Channel& channel) noexcept
+{
+    auto& job = *channel.tailJob;
+
+    if (channel.tailJobQueued) {
+        if (job.finish()) {
+            numMissedDeadlines++;
+        }
+
+        std::copy(job.outputBlock.begin(), job.outputBlock.end(), channel.tailOutput.begin());
+    } else {
+        std::fill(channel.tailOutput.begin(), channel.tailOutput.end(), 0.0f);
+    }
+
+    std::copy(channel.tailInput.begin(), channel.tailInput.end(), job.inputBlock.begin());
+
+    auto const blockTicks = juce::Time::secondsToHighResolutionTicks(tailPartitionSize / processSampleRate);
+    job.queue(juce::Time::getHighResolutionTicks() + blockTicks);
+    channel.tailJobQueued = true;
+}
+
+/**
+ * The output starts headLength samples after the input block, because the tail partitions begin there.
+ */
+void PartitionedConvolver::TailJob::compute() noexcept
+{
+    auto* bins = reinterpret_cast<std::complex<float>*>(fftBuffer.data());
+
+    std::copy(inputBlock.begin(), inputBlock.end(), fftBuffer.begin());
+    std::fill(fftBuffer.begin() + tailPartitionSize, fftBuffer.end(), 0.0f);
+    fft->performRealOnlyForwardTransform(fftBuffer.data(), true);
+
+    std::copy_n(bins, tailNumBins, inputSpectra.data() + currentSpectrum * tailNumBins);
+    std::fill(bins, bins + tailNumBins, std::complex<float>());
+
+    for (int partition = 0; partition < numPartitions; partition++) {
+        auto const past = (currentSpectrum - partition + numPartitions) % numPartitions;
+        multiplyAccumulate(inputSpectra.data() + past * tailNumBins, partitions->data() + partition * tailNumBins, bins, tailNumBins);
+    }
+
+    fft->performRealOnlyInverseTransform(fftBuffer.data());
+
+    for (int sample = 0; sample < tailPartitionSize; sample++) {
+        outputBlock[(size_t) sample] = fftBuffer[(size_t) sample] + overlap[(size_t) sample];
+    }
+
+    std::copy_n(fftBuffer.begin() + tailPartitionSize, tailPartitionSize, overlap.begin());
+    currentSpectrum = (currentSpectrum + 1) % numPartitions;
+}
+
+void PartitionedConvolver::TailJob::reset() noexcept
+{
+    std::fill(inputBlock.begin(), inputBlock.end(), 0.0f);
+    std::fill(inputSpectra.begin(), inputSpectra.end(), std::complex<float>());
+    std::fill(overlap.begin(), overlap.end(), 0.0f);
+    std::fill(outputBlock.begin(), outputBlock.end(), 0.0f);
+    currentSpectrum = 0;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "ConvolutionTailScheduler.h"
+#include "ImpulseResponseExchange.h"
+#include "JuceHeader.h"
+
+/**
+ * Non-uniformly partitioned convolution without latency.
+ *
+ * The head of the impulse response is split into partitions of partitionSize samples and convolved on the audio thread.
+ * The spectra of past input blocks are kept in a frequency domain delay line, so every block costs one multiply-accumulate
+ * per partition. The current, incomplete block is transformed again on every call, which is why the output is not delayed.
+ *
+ * The tail starts after headLength samples and is split into partitions of tailPartitionSize samples. A tail block is
+ * convolved once its input is complete, but its output is only needed one block later, so the computation is handed to the
+ * worker threads of the ConvolutionTailScheduler with that block as its deadline.
+ *
+ * Creating a convolver allocates and transforms everything, it is meant to happen off the audio thread.
+ * Processing never allocates.
+ */
+class PartitionedConvolver
+{
+public:
+    static constexpr int partitionSize = 512;
+    static constexpr int tailPartitionSize = 4096;
+
+    // the tail output of a block is needed one block after its input is complete
+    static constexpr int headLength = 2 * tailPartitionSize;
+
+    /**
+     * @param impulseResponse  Resampled to the sample rate, trimmed and optionally normalised like juce::dsp::Convolution does.
+     * @param numChannels      Channels that are processed, a mono impulse response is used for all of them.
+     */
+    PartitionedConvolver(const ImpulseResponse& impulseResponse, double sampleRate, int numChannels, bool normalise);
+    ~PartitionedConvolver();
+
+    void reset() noexcept;
+
+    /**
+     * Convolves one channel, input and output may be the same.
+     */
+    void process(int channel, const float* input, float* output, int numSamples) noexcept;
+
+    int getNumChannels() const noexcept             { return (int) channels.size(); }
+    int getImpulseResponseLength() const noexcept   { return impulseResponseLength; }
+
+    // tail blocks that the audio thread had to compute or wait for
+    int getNumMissedDeadlines() const noexcept      { return numMissedDeadlines.load(); }
+
+private:
+    using Spectrum = std::vector<std::complex<float>>;
+
+    static juce::AudioBuffer<float> prepareImpulseResponse(const ImpulseResponse& impulseResponse, double sampleRate, bool normalise);
+    static std::vector<Spectrum> transformPartitions(const juce::AudioBuffer<float>& samples, int start, int length, int size, int order);
+    static void multiplyAccumulate(const std::complex<float>* a, const std::complex<float>* b, std::complex<float>* result, int count) noexcept;
+
+    static constexpr int fftOrder = 10;
+    static constexpr int fftSize = 2 * partitionSize;
+    static constexpr int numBins = partitionSize + 1;
+    static_assert((1 << fftOrder) == fftSize, "fftOrder does not match the partition size");
+
+    static constexpr int tailFftOrder = 13;
+    static constexpr int tailNumBins = tailPartitionSize + 1;
+    static_assert((1 << tailFftOrder) == 2 * tailPartitionSize, "tailFftOrder does not match the tail partition size");
+    static_assert(tailPartitionSize % partitionSize == 0, "the head blocks have to line up with the tail blocks");
+
+    /**
+     * Uniformly partitioned convolution of complete tail blocks, computed by a worker or, when it is late, by the audio thread.
+     */
+    struct TailJob : public ConvolutionTailScheduler::Job {
+        void compute() noexcept override;
+        void reset() noexcept;
+
+        const Spectrum* partitions = nullptr;       // numPartitions spectra of the impulse response channel's tail
+        int numPartitions = 0;
+
+        std::unique_ptr<juce::dsp::FFT> fft;
+        std::vector<float> inputBlock;              // written by the audio thread while the job is idle
+        std::vector<float> fftBuffer;
+        Spectrum inputSpectra;
+        std::vector<float> overlap;
+        std::vector<float> outputBlock;             // read by the audio thread once the job is finished
+        int currentSpectrum = 0;
+    };
+
+    struct Channel {
+        const Spectrum* partitions = nullptr;       // numPartitions spectra of the impulse response channel's head
+
+        std::unique_ptr<juce::dsp::FFT> fft;
+        std::vector<float> inputBlock;              // the current block, zero padded until it is complete
+        std::vector<float> fftBuffer;               // the transforms need twice fftSize floats
+        Spectrum inputSpectra;                      // numPartitions past input spectra, the delay line
+        Spectrum tailSpectrum;                      // contribution of all partitions but the first to the current block
+        std::vector<float> overlap;                 // second half of the previous block's output
+
+        int inputPosition = 0;
+        int currentSpectrum = 0;
+
+        std::unique_ptr<TailJob> tailJob;           // only if the impulse response is longer than the head
+        std::vector<float> tailInput;               // collects the input of the next tail block
+        std::vector<float> tailOutput;              // tail output of the current block
+        int tailPosition = 0;
+        bool tailJobQueued = false;
+    };
+
+    void advanceTail(Channel& channel) noexcept;
+
+    double processSampleRate = 0.0;
+    int numPartitions = 0;
+    int impulseResponseLength = 0;
+
+    std::vector<Spectrum> impulseResponseSpectra;   // head, one per impulse response channel
+    std::vector<Spectrum> tailSpectra;              // tail, one per impulse response channel, empty for short impulse responses
+    std::vector<Channel> channels;
+
+    std::atomic<int> numMissedDeadlines{0};
+
+    juce::SharedResourcePointer<ConvolutionTailScheduler> scheduler;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PartitionedConvolver)
+};
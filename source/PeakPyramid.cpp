@@ -0,0 +1,121 @@
+#include "PeakPyramid.h"
+
+bool PeakPyramid::build(std::shared_ptr<const juce::AudioBuffer<float>> buffer, double newSampleRate, const std::function<bool()>& shouldExit)
+{
+    samples = std::move(buffer);
+    sampleRate = newSampleRate;
+    levels.assign((size_t) getNumChannels(), {});
+
+    for (int channel = 0; channel < getNumChannels(); channel++) {
+        auto& channelLevels = levels[(size_t) channel];
+        auto const* channelSamples = samples->getReadPointer(channel);
+        auto const numSamples = samples->getNumSamples();
+
+        // finest level from the samples
+        std::vector<Peak> peaks;
+        peaks.reserve((size_t) (numSamples + samplesPerPeak - 1) / samplesPerPeak);
+
+        for (int first = 0; first < numSamples; first += samplesPerPeak) {
+            auto const range = juce::FloatVectorOperations::findMinAndMax(channelSamples + first, juce::jmin(samplesPerPeak, numSamples - first));
+            peaks.push_back({range.getStart(), range.getEnd()});
+
+            if ((first & 0xfffff) == 0 && shouldExit()) {
+                return false;
+            }
+        }
+
+        channelLevels.push_back(std::move(peaks));
+
+        // every coarser level halves the number of peaks, down to a single one
+        while (channelLevels.back().size() > 1) {
+            const auto& finer = channelLevels.back();
+            std::vector<Peak> coarser((finer.size() + 1) / 2);
+
+            for (size_t peak = 0; peak < coarser.size(); peak++) {
+                auto const& left = finer[2 * peak];
+                auto const& right = 2 * peak + 1 < finer.size() ? finer[2 * peak + 1] : left;
+                coarser[peak] = {juce::jmin(left.minimum, right.minimum), juce::jmax(left.maximum, right.maximum)};
+            }
+
+            channelLevels.push_back(std::move(coarser));
+
+            if (shouldExit()) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Uses the coarsest level whose peaks are not longer than the range, so at most three peaks are merged.
+ * Ranges shorter than a peak of the finest level are read from the samples.
+ */
+PeakPyramid::Peak PeakPyramid::getPeak(int channel, double startSample, double endSample) const
+{
+    auto const numSamples = getNumSamples();
+    auto const first = juce::jlimit(0, numSamples, (int) std::floor(startSample));
+    auto const last = juce::jlimit(0, numSamples, (int) std::ceil(endSample));
+
+    if (last <= first) {
+        return {};
+    }
+
+    if (last - first < samplesPerPeak) {
+        auto const range = juce::FloatVectorOperations::findMinAndMax(samples->getReadPointer(channel, first), last - first);
+        return {range.getStart(), range.getEnd()};
+    }
+
+    const auto& channelLevels = levels[(size_t) channel];
+
+    int level = 0;
+    while (level + 1 < (int) channelLevels.size() && (samplesPerPeak << (level + 1)) <= last - first) {
+        level++;
+    }
+
+    auto const samplesPerLevelPeak = samplesPerPeak << level;
+    const auto& peaks = channelLevels[(size_t) level];
+    auto const firstPeak = (size_t) (first / samplesPerLevelPeak);
+    auto const lastPeak = juce::jmin(peaks.size(), (size_t) ((last + samplesPerLevelPeak - 1) / samplesPerLevelPeak));
+
+    Peak result = peaks[firstPeak];
+
+    for (auto peak = firstPeak + 1; peak < lastPeak; peak++) {
+        result.minimum = juce::jmin(result.minimum, peaks[peak].minimum);
+        result.maximum = juce::jmax(result.maximum, peaks[peak].maximum);
+    }
+
+    return result;
+}
+
+/**
+ * Draws the channels on top of each other, one vertical line per pixel column from the minimum to the maximum.
+ */
+void PeakPyramid::drawChannels(juce::Graphics& g, juce::Rectangle<int> area, double startTimeS, double endTimeS) const
+{
+    auto const numChannels = getNumChannels();
+
+    if (numChannels == 0 || area.isEmpty() || endTimeS <= startTimeS) {
+        return;
+    }
+
+    auto const samplesPerPixel = (endTimeS - startTimeS) * sampleRate / (double) area.getWidth();
+    auto const channelHeight = area.getHeight() / numChannels;
+
+    for (int channel = 0; channel < numChannels; channel++) {
+        auto const channelArea = area.withTrimmedTop(channel * channelHeight).withHeight(channelHeight);
+        auto const centreY = (float) channelArea.getCentreY();
+        auto const halfHeight = (float) channelArea.getHeight() / 2.0f;
+
+        for (int x = 0; x < channelArea.getWidth(); x++) {
+            auto const startSample = startTimeS * sampleRate + x * samplesPerPixel;
+            auto const peak = getPeak(channel, startSample, startSample + juce::jmax(1.0, samplesPerPixel));
+
+            auto const top = centreY - juce::jlimit(-1.0f, 1.0f, peak.maximum) * halfHeight;
+            auto const bottom = centreY - juce::jlimit(-1.0f, 1.0f, peak.minimum) * halfHeight;
+
+            g.fillRect((float) (channelArea.getX() + x), top, 1.0f, juce::jmax(1.0f, bottom - top));
+        }
+    }
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Minimum and maximum of every channel of an audio buffer at a series of resolutions,
+ * every level merges two neighbouring peaks of the level below.
+ * Any range of samples is covered by a few peaks of the level that matches its length,
+ * so drawing the waveform costs the same for every length of the buffer and every zoom.
+ */
+class PeakPyramid
+{
+public:
+    struct Peak {
+        float minimum = 0.0f;
+        float maximum = 0.0f;
+    };
+
+    // samples that are merged into a peak of the finest level
+    static constexpr int samplesPerPeak = 16;
+
+    /**
+     * Shares the samples and builds the levels, can be called on any thread.
+     * The samples must not change while the pyramid exists.
+     *
+     * @param shouldExit  Polled while building, a build that is no longer needed stops early.
+     * @return Whether the pyramid is complete.
+     */
+    bool build(std::shared_ptr<const juce::AudioBuffer<float>> buffer, double sampleRate, const std::function<bool()>& shouldExit);
+
+    Peak getPeak(int channel, double startSample, double endSample) const;
+
+    void drawChannels(juce::Graphics& g, juce::Rectangle<int> area, double startTimeS, double endTimeS) const;
+
+    int getNumChannels() const          { return samples != nullptr ? samples->getNumChannels() : 0; }
+    int getNumSamples() const           { return samples != nullptr ? samples->getNumSamples() : 0; }
+    double getSampleRate() const        { return sampleRate; }
+    double getLengthSeconds() const     { return sampleRate > 0.0 ? (double) getNumSamples() / sampleRate : 0.0; }
+
+private:
+    std::shared_ptr<const juce::AudioBuffer<float>> samples;
+    double sampleRate = 0.0;
+
+    // levels[channel][level], the peaks of level n cover samplesPerPeak << n samples each
+    std::vector<std::vector<std::vector<Peak>>> levels;
+};
@@ -30,8 +30,10 @@ RaumsimulationAudioProcessorEditor::RaumsimulationAudioProcessorEditor(Raumsimul
     generateIRButton.onClick = [this] { raytracer.launchThread(Thread::Priority::high); };
 
     addAndMakeVisible(generateLSButton);
-    generateLSButton.onClick = [this] { audioProcessor.ir.makeCopyOf(audioProcessor.generateLogarithmicSweep(20.0f, 20000.0f, 1.0f, audioProcessor.globalSampleRate, 2));
-                                               impulseResponseComponent.updateThumbnail(audioProcessor.globalSampleRate); };
+    generateLSButton.onClick = [this] { audioProcessor.publishImpulseResponse(std::make_shared<const ImpulseResponse>(ImpulseResponse{
+                                                       audioProcessor.generateLogarithmicSweep(20.0f, 20000.0f, 1.0f, audioProcessor.globalSampleRate, 2),
+                                                       audioProcessor.globalSampleRate}));
+                                               impulseResponseComponent.updateThumbnail(); };
 
     settingsWindow.centreAroundComponent(this, settingsWindow.getWidth(), settingsWindow.getHeight());
     settingsWindow.setBackgroundColour(getLookAndFeel().findColour(ResizableWindow::backgroundColourId));
@@ -97,7 +97,7 @@ void RaumsimulationAudioProcessor::prepareToPlay(double sampleRate, int samplesP
 
     juce::dsp::ProcessSpec processSpec{sampleRate, (uint32) samplesPerBlock, (uint32) channels};
 
-    convolution.loadImpulseResponse(std::move(ir), processSpec.sampleRate, juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::yes, juce::dsp::Convolution::Normalise::no);
+    // rebuilds the last loaded impulse response for the new sample rate and block size
     convolution.prepare(processSpec);
 
     gain.setGainDecibels(*gainParameter);
@@ -106,6 +106,7 @@ void RaumsimulationAudioProcessor::prepareToPlay(double sampleRate, int samplesP
     globalSampleRate = sampleRate;
 
     irBufferPosition = 0;
+    play = false;
 }
 
 void RaumsimulationAudioProcessor::releaseResources()
@@ -157,6 +158,20 @@ void RaumsimulationAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer
 
     convolution.process(processContext);
 
+    if (playRequested.exchange(false)) {
+        irBufferPosition = 0;
+        play = true;
+    }
+
+    auto const* impulseResponse = irExchange.acquireForAudioThread();
+    const auto& ir = impulseResponse->samples;
+
+    // a shorter impulse response may have been published during the preview
+    if (irBufferPosition >= ir.getNumSamples() - 1) {
+        irBufferPosition = 0;
+        play = false;
+    }
+
     if (play && ir.getNumSamples() > 0) {
 
         int readChannelNum = ir.getNumChannels();
@@ -182,6 +197,8 @@ void RaumsimulationAudioProcessor::processBlock(juce::AudioBuffer<float>& buffer
         }
     }
 
+    irExchange.releaseForAudioThread();
+
     gain.process(processContext);
 }
 
@@ -224,12 +241,58 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 
 void RaumsimulationAudioProcessor::updateParameters()
 {
-    auto const irFileURL = static_cast<const juce::URL>(parameters.state.getProperty("ir_file_url"));
-    convolution.loadImpulseResponse(irFileURL.getLocalFile(), juce::dsp::Convolution::Stereo::yes, juce::dsp::Convolution::Trim::yes, 0);
-
     gain.setGainDecibels(*gainParameter);
 }
 
+/**
+ * Takes over an impulse response that was loaded from a file, it is used for the preview and the convolution.
+ * Both share the decoded samples, the convolution prepares its partitions from them in the background.
+ */
+void RaumsimulationAudioProcessor::setImpulseResponse(juce::AudioBuffer<float>&& buffer, double sampleRate)
+{
+    auto const impulseResponse = std::make_shared<const ImpulseResponse>(ImpulseResponse{std::move(buffer), sampleRate});
+    publishImpulseResponse(impulseResponse);
+    loadImpulseResponse(impulseResponse, true);
+}
+
+/**
+ * Makes a finished impulse response available to the preview and the editor without copying it,
+ * can be called on any thread except the audio thread.
+ */
+void RaumsimulationAudioProcessor::publishImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse)
+{
+    irExchange.publish(std::move(impulseResponse));
+}
+
+std::shared_ptr<const ImpulseResponse> RaumsimulationAudioProcessor::getImpulseResponse() const
+{
+    return irExchange.get();
+}
+
+void RaumsimulationAudioProcessor::setBandImpulseResponses(std::vector<std::shared_ptr<const ImpulseResponse>> bands)
+{
+    const juce::ScopedLock lock(bandsMutex);
+    bandImpulseResponses = std::move(bands);
+}
+
+std::vector<std::shared_ptr<const ImpulseResponse>> RaumsimulationAudioProcessor::getBandImpulseResponses() const
+{
+    const juce::ScopedLock lock(bandsMutex);
+    return bandImpulseResponses;
+}
+
+/**
+ * Swaps the impulse response of the convolution during playback, the partitions are prepared on a background thread
+ * and the old impulse response is faded out over the crossfade time. Can be called on any thread except the audio thread.
+ */
+void RaumsimulationAudioProcessor::loadImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse, bool normalise)
+{
+    double const crossfadeTimeMS = parameters.state.getProperty("crossfade_time_ms", 100.0);
+    convolution.setCrossfadeTime(crossfadeTimeMS / 1000.0);
+
+    convolution.loadImpulseResponse(std::move(impulseResponse), normalise);
+}
+
 void RaumsimulationAudioProcessor::reset()
 {
     convolution.reset();
@@ -238,30 +301,33 @@ void RaumsimulationAudioProcessor::reset()
 
 void RaumsimulationAudioProcessor::playIR()
 {
-    irBufferPosition = 0;
-    play = true;
+    playRequested = true;
 }
 
 void RaumsimulationAudioProcessor::clearIR()
 {
-    irBufferPosition = 0;
-    ir.clear();
-    ir.setSize(ir.getNumChannels(), 0);
+    auto const impulseResponse = irExchange.get();
+
+    auto cleared = std::make_shared<ImpulseResponse>();
+    cleared->samples.setSize(impulseResponse->samples.getNumChannels(), 0);
+    cleared->sampleRate = impulseResponse->sampleRate > 0.0 ? impulseResponse->sampleRate : globalSampleRate;
+
+    publishImpulseResponse(std::move(cleared));
 }
 
 /**
  * @see https://www.recordingblogs.com/wiki/sine-sweep
  */
-juce::AudioBuffer<float>& RaumsimulationAudioProcessor::generateLogarithmicSweep(double startFrequency, double endFrequency, double lengthS, double sampleRate, int numChannels)
+juce::AudioBuffer<float> RaumsimulationAudioProcessor::generateLogarithmicSweep(double startFrequency, double endFrequency, double lengthS, double sampleRate, int numChannels)
 {
-    auto buffer = new juce::AudioBuffer<float>(numChannels, (int) (sampleRate*lengthS));
+    juce::AudioBuffer<float> buffer(numChannels, (int) (sampleRate*lengthS));
 
-    auto* writePtrArray = buffer->getArrayOfWritePointers();
+    auto* writePtrArray = buffer.getArrayOfWritePointers();
 
     double frequencyRatio = endFrequency / startFrequency;
 
-    for (int sample = 0; sample < buffer->getNumSamples(); sample++) {
-        for (int channel = 0; channel < buffer->getNumChannels(); channel++) {
+    for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
+        for (int channel = 0; channel < buffer.getNumChannels(); channel++) {
             writePtrArray[channel][sample] = (float) sin(2 * glm::pi<float>()
                                                          * startFrequency
                                                          * lengthS
@@ -269,5 +335,5 @@ juce::AudioBuffer<float>& RaumsimulationAudioProcessor::generateLogarithmicSweep
         }
     }
 
-    return *buffer;
+    return buffer;
 }
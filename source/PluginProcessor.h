@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CrossfadingConvolution.h"
+#include "ImpulseResponseExchange.h"
 #include "JuceHeader.h"
 
 class RaumsimulationAudioProcessor  : public juce::AudioProcessor
@@ -40,20 +42,34 @@ public:
     void setStateInformation (const void* data, int sizeInBytes) override;
 
     void updateParameters();
+    void setImpulseResponse(juce::AudioBuffer<float>&& buffer, double sampleRate);
+    void publishImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse);
+    void loadImpulseResponse(std::shared_ptr<const ImpulseResponse> impulseResponse, bool normalise);
+    std::shared_ptr<const ImpulseResponse> getImpulseResponse() const;
+    void setBandImpulseResponses(std::vector<std::shared_ptr<const ImpulseResponse>> bands);
+    std::vector<std::shared_ptr<const ImpulseResponse>> getBandImpulseResponses() const;
     void reset() override;
     void playIR();
     void clearIR();
-    static juce::AudioBuffer<float>& generateLogarithmicSweep(double startFrequency, double endFrequency, double lengthS, double sampleRate, int numChannels);
-
-    juce::AudioBuffer<float> ir;
-    int irBufferPosition = 0;
-    bool play = false;
+    static juce::AudioBuffer<float> generateLogarithmicSweep(double startFrequency, double endFrequency, double lengthS, double sampleRate, int numChannels);
 
     double globalSampleRate = 0.0f;
 
 private:
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RaumsimulationAudioProcessor)
 
+    // finished impulse responses, written by the raytracer and the editor, read by the audio thread for the preview
+    ImpulseResponseExchange irExchange;
+
+    // weighed octave bands of the last render, from 125 Hz up, kept for the export
+    juce::CriticalSection bandsMutex;
+    std::vector<std::shared_ptr<const ImpulseResponse>> bandImpulseResponses;
+
+    // only touched by the audio thread, a preview is started by setting playRequested
+    int irBufferPosition = 0;
+    bool play = false;
+    std::atomic<bool> playRequested{false};
+
     juce::Random randomGenerator;
 
     juce::ValueTree settings
@@ -79,14 +95,31 @@ private:
                      { "SettingsGroup", {{ "name", "Raytracer Settings" }},
                       {
                               { "Setting", {{ "id", "rays_per_source" },     { "value", 1000.0 }}},
-                              { "Setting", {{ "id", "points_in_visualizer" },     { "value", 50.0 }}}
+                              { "Setting", {{ "id", "points_in_visualizer" },     { "value", 50.0 }}},
+                              { "Setting", {{ "id", "use_point_lod" },     { "value", true }}},
+                              { "Setting", {{ "id", "color_points_by_energy" },     { "value", false }}},
+                              { "Setting", {{ "id", "show_ray_paths" },     { "value", false }}},
+                              { "Setting", {{ "id", "use_ray_packets" },     { "value", true }}},
+                              { "Setting", {{ "id", "use_batched_occlusion" },     { "value", true }}},
+                              { "Setting", {{ "id", "cluster_sources" },     { "value", false }}},
+                              { "Setting", {{ "id", "cluster_tolerance_cm" },     { "value", 10.0 }}},
+                              { "Setting", {{ "id", "cluster_tolerance_ms" },     { "value", 0.5 }}},
+                              { "Setting", {{ "id", "use_visibility_cache" },     { "value", false }}},
+                              { "Setting", {{ "id", "patch_size_cm" },     { "value", 50.0 }}},
+                              { "Setting", {{ "id", "use_radiosity" },     { "value", false }}},
+                              { "Setting", {{ "id", "radiosity_length_ms" },     { "value", 1500.0 }}},
+                              { "Setting", {{ "id", "truncate_trace" },     { "value", false }}},
+                              { "Setting", {{ "id", "transition_time_ms" },     { "value", 0.0 }}},
+                              { "Setting", {{ "id", "secondary_source_memory_mb" },     { "value", 1024.0 }}},
+                              { "Setting", {{ "id", "use_reservoir_sampling" },     { "value", false }}}
                       }
                      },
                      { "SettingsGroup", {{ "name", "IR Settings" }},
                       {
                               { "Setting", {{ "id", "lines_in_waveform" },     { "value", 10.0 }}},
                               { "Setting", {{ "id", "stereo_ir" },     { "value", false }}},
-                              { "Setting", {{ "id", "use_white_noise" },     { "value", true }}}
+                              { "Setting", {{ "id", "use_white_noise" },     { "value", true }}},
+                              { "Setting", {{ "id", "crossfade_time_ms" },     { "value", 100.0 }}}
                       }
                      }
              }
@@ -96,7 +129,7 @@ private:
     std::atomic<float>* gainParameter = nullptr;
 
 
-    juce::dsp::Convolution convolution{dsp::Convolution::NonUniform{512}};
+    CrossfadingConvolution convolution;
     juce::dsp::Gain<float> gain;
 
     std::atomic<int> irSize{0};
@@ -0,0 +1,114 @@
+#include "PointCloudLOD.h"
+#include <queue>
+
+PointCloudLOD::PointCloudLOD(float finestVoxelSize)
+    : finestVoxelSizeM(finestVoxelSize)
+{
+}
+
+void PointCloudLOD::clear()
+{
+    for (auto& level : levels) {
+        level.clear();
+    }
+
+    numPoints = 0;
+}
+
+/**
+ * Adds the point to the voxel that contains it on every level.
+ *
+ * @param energy  Mean energy of the point, linear.
+ */
+void PointCloudLOD::add(glm::vec3 position, int order, float energy)
+{
+    for (int level = 0; level < numLevels; level++) {
+        auto& node = levels[(size_t) level][getKey(position, level)];
+
+        node.positionSum += position;
+        node.orderSum += (float) order;
+        node.energySum += energy;
+        node.count++;
+    }
+
+    numPoints++;
+}
+
+/**
+ * Starts with the voxels of the coarsest level and keeps splitting the one that covers the most pixels,
+ * until every voxel covers at most maxPixels or splitting would exceed the point budget.
+ * Voxels close to the camera are therefore shown with more detail than the ones far away.
+ *
+ * @param selection  Receives one point per selected voxel, the centroid of the points inside it.
+ */
+void PointCloudLOD::select(const ProjectedSize& projectedSize, float maxPixels, size_t pointBudget, std::vector<Point>& selection) const
+{
+    struct Candidate {
+        float pixels;
+        int level;
+        glm::ivec3 key;
+        const Node* node;
+
+        bool operator<(const Candidate& other) const { return pixels < other.pixels; }
+    };
+
+    selection.clear();
+
+    std::priority_queue<Candidate> candidates;
+    int const coarsestLevel = numLevels - 1;
+
+    for (const auto& [key, node] : levels[(size_t) coarsestLevel]) {
+        candidates.push({projectedSize(getPoint(node).position, getVoxelSize(coarsestLevel)), coarsestLevel, key, &node});
+    }
+
+    while (!candidates.empty()) {
+        auto candidate = candidates.top();
+
+        if (candidate.pixels <= maxPixels || candidate.level == 0) {
+            break;
+        }
+
+        // the children replace their parent, at most eight points are added
+        if (selection.size() + candidates.size() + 7 > pointBudget) {
+            break;
+        }
+
+        candidates.pop();
+
+        int const childLevel = candidate.level - 1;
+        const auto& children = levels[(size_t) childLevel];
+
+        for (int child = 0; child < 8; child++) {
+            glm::ivec3 childKey = 2 * candidate.key + glm::ivec3(child & 1, (child >> 1) & 1, (child >> 2) & 1);
+            auto it = children.find(childKey);
+
+            if (it == children.end()) {
+                continue;
+            }
+
+            float const pixels = projectedSize(getPoint(it->second).position, getVoxelSize(childLevel));
+
+            // small enough already, no need to keep it in the queue
+            if (pixels <= maxPixels || childLevel == 0) {
+                selection.push_back(getPoint(it->second));
+            } else {
+                candidates.push({pixels, childLevel, childKey, &it->second});
+            }
+        }
+    }
+
+    for (; !candidates.empty(); candidates.pop()) {
+        selection.push_back(getPoint(*candidates.top().node));
+    }
+}
+
+glm::ivec3 PointCloudLOD::getKey(glm::vec3 position, int level) const
+{
+    return glm::ivec3(glm::floor(position / getVoxelSize(level)));
+}
+
+PointCloudLOD::Point PointCloudLOD::getPoint(const Node& node)
+{
+    auto const count = (float) node.count;
+    return {node.positionSum / count, node.orderSum / count, node.energySum / count};
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "glm/glm.hpp"
+#include <unordered_map>
+
+/**
+ * Level of detail hierarchy over the reflection points of the visualizer.
+ * Every level hashes the points into voxels of twice the size of the level below and keeps their aggregate,
+ * so the children of a voxel are found by looking up the eight voxels it is split into.
+ * The memory grows with the covered surface area of the room, not with the number of points.
+ */
+class PointCloudLOD
+{
+public:
+    struct Point {
+        glm::vec3 position;
+        float meanOrder;
+        float meanEnergy;
+    };
+
+    // returns the size in pixels that a voxel of the given size at the given center covers on the screen
+    using ProjectedSize = std::function<float(glm::vec3 center, float voxelSizeM)>;
+
+    explicit PointCloudLOD(float finestVoxelSize = 0.05f);
+
+    void clear();
+    void add(glm::vec3 position, int order, float energy);
+
+    void select(const ProjectedSize& projectedSize, float maxPixels, size_t pointBudget, std::vector<Point>& selection) const;
+
+    juce::int64 getNumPoints() const    { return numPoints; }
+    float getVoxelSize(int level) const { return finestVoxelSizeM * (float) (1 << level); }
+
+    static constexpr int numLevels = 8;
+
+private:
+    struct Node {
+        glm::vec3 positionSum {0.0f};
+        float orderSum = 0.0f;
+        float energySum = 0.0f;
+        juce::uint32 count = 0;
+    };
+
+    struct KeyHash {
+        size_t operator()(const glm::ivec3& key) const noexcept
+        {
+            auto hash = (size_t) (juce::uint32) key.x;
+            hash = hash * 0x9e3779b1u + (size_t) (juce::uint32) key.y;
+            hash = hash * 0x9e3779b1u + (size_t) (juce::uint32) key.z;
+            return hash;
+        }
+    };
+
+    using Level = std::unordered_map<glm::ivec3, Node, KeyHash>;
+
+    float finestVoxelSizeM;
+    std::array<Level, numLevels> levels;
+    juce::int64 numPoints = 0;
+
+    glm::ivec3 getKey(glm::vec3 position, int level) const;
+    static Point getPoint(const Node& node);
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "glm/glm.hpp"
+#include <atomic>
+
+/**
+ * Ring of a fixed number of ray paths, written by the raytracer and read by the visualizer without locks.
+ * Every slot carries a sequence number that is odd while the writer changes the slot, so the reader can
+ * tell when a path was overwritten while it was copying it and skips that path.
+ * When the reader falls behind by more than the capacity, the oldest paths are lost.
+ *
+ * There must only be one writer and one reader.
+ */
+class RayPathRing
+{
+public:
+    static constexpr int maxVertices = 32;
+
+    struct Vertex {
+        glm::vec3 position;
+        float energy;               // mean energy after the reflection, linear
+    };
+
+    // the vertex index is the reflection order, the first vertex is the source
+    struct Path {
+        Vertex vertices[maxVertices];
+        int numVertices = 0;
+        juce::uint32 generation = 0;
+
+        void add(glm::vec3 position, float energy)
+        {
+            if (numVertices < maxVertices) {
+                vertices[numVertices++] = {position, energy};
+            }
+        }
+    };
+
+    explicit RayPathRing(size_t capacity = 4096)
+    : slots(capacity)
+    {
+    }
+
+    size_t getCapacity() const          { return slots.size(); }
+    juce::uint32 getGeneration() const  { return generation.load(std::memory_order_acquire); }
+
+    /**
+     * Starts a new set of paths, paths of earlier generations that are still in the ring are skipped by the reader.
+     */
+    void clear()
+    {
+        generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    void push(const Path& path)
+    {
+        auto const index = writeIndex.load(std::memory_order_relaxed);
+        auto& slot = slots[(size_t) (index % slots.size())];
+        auto const sequence = slot.sequence.load(std::memory_order_relaxed);
+
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.path = path;
+        slot.path.generation = generation.load(std::memory_order_relaxed);
+        slot.index = index;
+
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        writeIndex.store(index + 1, std::memory_order_release);
+    }
+
+    bool hasNext(juce::uint64 readIndex) const
+    {
+        return writeIndex.load(std::memory_order_acquire) > readIndex;
+    }
+
+    juce::uint64 getNumPushed() const
+    {
+        return writeIndex.load(std::memory_order_acquire);
+    }
+
+    /**
+     * Copies the next complete path after readIndex.
+     *
+     * @param readIndex  Number of paths the reader has consumed so far, advanced past the returned path.
+     * @return Whether a path was copied, false once the reader has caught up with the writer.
+     */
+    bool readNext(juce::uint64& readIndex, Path& path) const
+    {
+        for (;;) {
+            auto const written = writeIndex.load(std::memory_order_acquire);
+
+            if (readIndex >= written) {
+                return false;
+            }
+
+            // paths that have been overwritten already are lost
+            if (written - readIndex > slots.size()) {
+                readIndex = written - slots.size();
+            }
+
+            const auto& slot = slots[(size_t) (readIndex % slots.size())];
+            auto const sequenceBefore = slot.sequence.load(std::memory_order_acquire);
+
+            if ((sequenceBefore & 1) != 0) {
+                readIndex++;
+                continue;
+            }
+
+            // the copy may be torn if the writer laps the reader, the sequence check below detects that
+            path = slot.path;
+            auto const index = slot.index;
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            auto const sequenceAfter = slot.sequence.load(std::memory_order_relaxed);
+
+            if (sequenceBefore != sequenceAfter || index != readIndex) {
+                readIndex++;
+                continue;
+            }
+
+            readIndex++;
+            return true;
+        }
+    }
+
+private:
+    struct Slot {
+        std::atomic<juce::uint32> sequence {0};
+        juce::uint64 index = 0;
+        Path path;
+    };
+
+    std::vector<Slot> slots;
+    std::atomic<juce::uint64> writeIndex {0};
+    std::atomic<juce::uint32> generation {0};
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(RayPathRing)
+};
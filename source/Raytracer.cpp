@@ -22,6 +22,45 @@ Raytracer::Raytracer(RaumsimulationAudioProcessor& p, juce::AudioProcessorValueT
 void Raytracer::setRoom(const File& objFile)
 {
     room.load(objFile);
+
+    auto previousTriangles = std::move(triangles);
+    triangles.clear();
+    packetTriangles.clear();
+    triangleShapes.clear();
+
+    for (int shapeNum = 0; shapeNum < (int) room.shapes.size(); shapeNum++) {
+        const auto& mesh = room.shapes[(size_t) shapeNum]->mesh;
+
+        jassert(mesh.indices.size() % 3 == 0);
+
+        for (size_t index = 0; index + 2 < mesh.indices.size(); index += 3) {
+            Triangle triangle;
+
+            triangle.normal = mesh.normals[mesh.indices[index]];
+            triangle.pointA = mesh.vertices[mesh.indices[index + 0]];
+            triangle.pointB = mesh.vertices[mesh.indices[index + 1]];
+            triangle.pointC = mesh.vertices[mesh.indices[index + 2]];
+
+            triangles.push_back(triangle);
+            packetTriangles.push_back(PacketTriangle::fromTriangle(triangle));
+            triangleShapes.push_back(shapeNum);
+        }
+    }
+
+    // patches and cached visibilities only stay valid as long as the geometry does not change
+    bool const geometryChanged = !std::equal(triangles.begin(), triangles.end(), previousTriangles.begin(), previousTriangles.end(),
+                                             [] (const Triangle& a, const Triangle& b) {
+                                                 return a.pointA == b.pointA && a.pointB == b.pointB && a.pointC == b.pointC;
+                                             });
+
+    if (geometryChanged) {
+        patches.clear();
+        trianglePatchOffsets.clear();
+        triangleSubdivisions.clear();
+        patchSizeM = 0.0f;
+        visibilityCaches.clear();
+        radiosity.clearFormFactors();
+    }
 }
 
 void Raytracer::clear()
@@ -29,18 +68,24 @@ void Raytracer::clear()
     histograms.clear();
     secondarySources.clear();
     cubes.clear();
+    rayPaths.clear();
 }
 
 void Raytracer::run()
 {
+    {
+        const ScopedLock lock(renderSummaryMutex);
+        renderSummary.clear();
+    }
+
+    // lets the visualizer know that a render started
+    sendChangeMessage();
+
     setStatusMessage("Loading room model...");
     auto const objFileURL = static_cast<const juce::URL>(parameters.state.getProperty("obj_file_url"));
     setRoom(objFileURL.getLocalFile());
     sleep(1000);
 
-    minOrder = 1;
-    maxOrder = 1;
-
     String activeMicrophoneName;
 
     for (const auto& object : objects) {
@@ -59,40 +104,178 @@ void Raytracer::run()
         return;
     }
 
+    bool const useVisibilityCache = parameters.state.getProperty("use_visibility_cache");
+    bool const useRadiosity = parameters.state.getProperty("use_radiosity");
+
+    if (useVisibilityCache || useRadiosity) {
+        buildPatches((float) parameters.state.getProperty("patch_size_cm", 50.0) / 100.0f);
+    }
+
+    // optionally only trace the early part of the response and extrapolate the statistical late tail
+    bool const truncateTrace = parameters.state.getProperty("truncate_trace");
+    float transitionTimeMS = parameters.state.getProperty("transition_time_ms");
+
+    if (truncateTrace && transitionTimeMS <= 0.0f) {
+        transitionTimeMS = getMixingTimeMS();
+    }
+
+    maxTraceDelayMS = truncateTrace ? transitionTimeMS : std::numeric_limits<float>::max();
+
+    // neither the traced rays nor the radiosity solution depend on the receivers,
+    // as long as the rest of the scene stays the same only the final gather has to be repeated
+    String const sceneSignature = useRadiosity ? getSceneSignature() : String();
+    bool const reuseSolution = useRadiosity
+                            && sceneSignature == solvedSceneSignature
+                            && radiosity.hasFormFactors(radiosityBinWidthMS)
+                            && !secondarySources.empty();
+
+    if (reuseSolution) {
+        addToRenderSummary("Scene unchanged, reusing the traced rays and the radiosity solution");
+    }
+
     //========================= RAY TRACING =========================//
-    {
+    if (!reuseSolution) {
+        solvedSceneSignature.clear();
+        minOrder = 1;
+        maxOrder = 1;
+
         secondarySources.clear();
 
-        std::vector<Object> speakers;
+        size_t const memoryBudgetBytes = (size_t) (int) parameters.state.getProperty("secondary_source_memory_mb", 1024.0) * 1024 * 1024;
+        useReservoirSampling = parameters.state.getProperty("use_reservoir_sampling");
+
+        if (useReservoirSampling) {
+            // a hard limit instead of spilling to disk, every kept source costs its entry and its sampling key
+            secondarySources.setMemoryBudget(std::numeric_limits<size_t>::max());
+            reservoirCapacity = memoryBudgetBytes / (sizeof(CompactSecondarySource) + sizeof(std::pair<float, juce::uint32>));
+        } else {
+            secondarySources.setMemoryBudget(memoryBudgetBytes);
+            reservoirCapacity = 0;
+        }
+
+        reservoirHeap.clear();
+        reservoirHeap.shrink_to_fit();
+        offeredEnergyPerBucket.clear();
+        numOfferedSecondarySources = 0;
+        speakers.clear();
 
         for (const auto& object : objects) {
             if (object.type == Object::Type::SPEAKER && object.active) {
                 speakers.push_back(object);
+                speakers.back().directivity.prepareSampling();
             }
         }
 
+        // secondary sources are quantized relative to the bounds of the room and the speakers
+        glm::vec3 sceneMinimum = triangles.empty() ? glm::vec3(0.0f) : triangles[0].pointA;
+        glm::vec3 sceneMaximum = sceneMinimum;
+
+        for (const auto& triangle : triangles) {
+            for (auto point : {triangle.pointA, triangle.pointB, triangle.pointC}) {
+                sceneMinimum = glm::min(sceneMinimum, point);
+                sceneMaximum = glm::max(sceneMaximum, point);
+            }
+        }
+
+        for (const auto& speaker : speakers) {
+            sceneMinimum = glm::min(sceneMinimum, speaker.position);
+            sceneMaximum = glm::max(sceneMaximum, speaker.position);
+        }
+
+        secondarySourceCodec.setBounds(sceneMinimum, sceneMaximum);
+
         setStatusMessage("Casting rays...");
         raysPerSource = (int) parameters.state.getProperty("rays_per_source");
+        bool const useRayPackets = parameters.state.getProperty("use_ray_packets");
+
+        recordRayPaths = parameters.state.getProperty("show_ray_paths");
+        rayPathInterval = jmax(1, raysPerSource / rayPathsPerSource);
+        rayPaths.clear();
+
+        numRaysCast = 0;
+        auto castingStartMS = Time::getMillisecondCounterHiRes();
 
         for (int speakerNum = 0; speakerNum < speakers.size(); speakerNum++) {
             setStatusMessage("Casting Rays for source " + String(speakerNum + 1) + " / " + String(speakers.size()));
 
             // add source for direct sound
-            secondarySources.push_back({0, speakers[speakerNum].position, glm::vec3(), 0.0f, Band6Coefficients(), 0.0f});
+            recordSecondarySource({0, speakers[speakerNum].position, glm::vec3(), 0.0f, Band6Coefficients(), 0.0f});
+
+            const auto& directivity = speakers[speakerNum].directivity;
+
+            std::vector<Ray> rays;
+            std::vector<SecondarySource> secondarySourceStates;
+            rays.reserve((size_t) raysPerSource);
+            secondarySourceStates.reserve((size_t) raysPerSource);
 
             for (int rayNum = 0; rayNum < raysPerSource; rayNum++) {
-                // generate Ray at speaker position with random direction
-                Ray randomRay = {
-                        speakers[speakerNum].position,
-                        glm::normalize(glm::vec3{randomNormalDistribution(), randomNormalDistribution(), randomNormalDistribution()})
-                };
+                Ray randomRay;
+                Band6Coefficients emittedEnergy;
+
+                if (directivity.pattern == Directivity::OMNIDIRECTIONAL) {
+                    // generate Ray at speaker position with random direction
+                    randomRay = {
+                            speakers[speakerNum].position,
+                            glm::normalize(glm::vec3{randomNormalDistribution(), randomNormalDistribution(), randomNormalDistribution()})
+                    };
+                } else {
+                    // generate Ray at speaker position with a direction drawn proportionally to the directivity pattern,
+                    // the returned weight compensates for the non-uniform distribution of the rays
+                    randomRay = {
+                            speakers[speakerNum].position,
+                            directivity.sampleDirection(randomGenerator, emittedEnergy)
+                    };
+                }
 
-                trace(randomRay);
+                SecondarySource secondarySourceState;
+                secondarySourceState.energyCoefficients = emittedEnergy;
+
+                rays.push_back(randomRay);
+                secondarySourceStates.push_back(secondarySourceState);
+            }
+
+            if (useRayPackets) {
+                tracePackets(rays, secondarySourceStates,
+                             (double) speakerNum / (double) speakers.size(),
+                             (double) (speakerNum + 1) / (double) speakers.size());
+            } else {
+                for (int rayNum = 0; rayNum < raysPerSource; rayNum++) {
+                    if (recordRayPaths && rayNum % rayPathInterval == 0) {
+                        RayPathRing::Path rayPath;
+                        rayPath.add(rays[(size_t) rayNum].position, secondarySourceStates[(size_t) rayNum].energyCoefficients.getAverage());
+                        trace(rays[(size_t) rayNum], secondarySourceStates[(size_t) rayNum], &rayPath);
+                    } else {
+                        trace(rays[(size_t) rayNum], secondarySourceStates[(size_t) rayNum]);
+                    }
 
-                // update the progress bar on the dialog box
-                setProgress((float) ((speakerNum + 1) * (rayNum + 1)) / (float) (speakers.size() * raysPerSource));
+                    // update the progress bar on the dialog box
+                    setProgress((float) ((speakerNum + 1) * (rayNum + 1)) / (float) (speakers.size() * raysPerSource));
+                }
             }
         }
+
+        auto castingDurationS = (Time::getMillisecondCounterHiRes() - castingStartMS) / 1000.0;
+        auto raysPerSecond = castingDurationS > 0.0 ? (double) numRaysCast / castingDurationS : 0.0;
+
+        addToRenderSummary("Cast " + String(numRaysCast) + " rays in " + String(castingDurationS, 2) + " s (" + String(raysPerSecond, 0) + " rays/s"
+                           + (useRayPackets ? ", packets)" : ")")
+                           + (truncateTrace ? " up to " + String(transitionTimeMS, 0) + " ms" : ""));
+
+        juce::int64 const numDroppedSecondarySources = useReservoirSampling ? numOfferedSecondarySources - (juce::int64) secondarySources.size() : 0;
+
+        if (numDroppedSecondarySources > 0) {
+            setStatusMessage("Rescaling sampled secondary sources...");
+            finishReservoirSampling();
+        }
+
+        size_t const peakMemoryBytes = secondarySources.getPeakMemoryUsageBytes()
+                                     + reservoirHeap.capacity() * sizeof(std::pair<float, juce::uint32>)
+                                     + offeredEnergyPerBucket.capacity() * sizeof(Band6Coefficients);
+
+        addToRenderSummary("Stored " + String(secondarySources.size()) + " secondary sources, peak memory "
+                           + String((double) peakMemoryBytes / (1024.0 * 1024.0), 1) + " MB, "
+                           + String(secondarySources.getNumSpilledChunks()) + " of " + String(secondarySources.getNumChunks()) + " chunks spilled to disk"
+                           + (useReservoirSampling ? ", " + String(numDroppedSecondarySources) + " dropped by reservoir sampling" : ""));
     }
 
     //========================= ROOM VOLUME ESTIMATION =========================//
@@ -105,7 +288,7 @@ void Raytracer::run()
         float maxY = 0.0f;
         float maxZ = 0.0f;
 
-        for (auto secondarySource : secondarySources) {
+        forEachSecondarySource([&] (const SecondarySource& secondarySource) {
             glm::vec3 sp = secondarySource.position;
             if (sp.x < minX) minX = sp.x;
             if (sp.y < minY) minY = sp.y;
@@ -113,7 +296,7 @@ void Raytracer::run()
             if (sp.x > maxX) maxX = sp.x;
             if (sp.y > maxY) maxY = sp.y;
             if (sp.z > maxZ) maxZ = sp.z;
-        }
+        });
 
         roomVolumeM3 = (abs(minX) + abs(maxX)) * (abs(minY) + abs(maxY)) * (abs(minZ) + abs(maxZ));
         roomVolumeM3 = floor(roomVolumeM3 / 10.0f) * 10.0f;
@@ -132,6 +315,13 @@ void Raytracer::run()
         }
     }
 
+    //========================= RADIOSITY =========================//
+    if (useRadiosity && !reuseSolution) {
+        if (solveRadiosity()) {
+            solvedSceneSignature = sceneSignature;
+        }
+    }
+
     //========================= GATHERING =========================//
     {
         std::vector<Object> microphones;
@@ -139,7 +329,39 @@ void Raytracer::run()
         for (const auto& object : objects) {
             if (object.type == Object::Type::MICROPHONE && object.active) {
                 microphones.push_back(object);
-                histograms.insert(std::pair{object.name, std::vector<EnergyPortion>()});
+                // start from an empty histogram, so that repeated renders do not accumulate
+                histograms[object.name].clear();
+            }
+        }
+
+        // the diffuse energy of secondary sources on patches is handed on by the radiosity solution instead
+        auto const isGatheredDirectly = [useRadiosity] (const SecondarySource& source) {
+            return !useRadiosity || source.order == 0 || source.patch < 0;
+        };
+
+        // optionally merge secondary sources that are close in space and time, so that each cluster only costs one visibility test
+        std::vector<SecondarySource> clusteredSources;
+        bool const useClustering = parameters.state.getProperty("cluster_sources");
+
+        if (useClustering) {
+            setStatusMessage("Clustering secondary sources...");
+
+            float const toleranceM  = (float) parameters.state.getProperty("cluster_tolerance_cm") / 100.0f;
+            float const toleranceMS = (float) parameters.state.getProperty("cluster_tolerance_ms");
+
+            clusteredSources = clusterSecondarySources(isGatheredDirectly, toleranceM, toleranceMS);
+        }
+
+        bool const useBatchedOcclusion = parameters.state.getProperty("use_batched_occlusion");
+
+        if (useVisibilityCache) {
+            // receivers that moved or were removed since the last render are not needed anymore
+            for (auto cache = visibilityCaches.begin(); cache != visibilityCaches.end();) {
+                bool const isReceiver = std::any_of(microphones.begin(), microphones.end(), [&cache] (const Object& microphone) {
+                    return getVisibilityCacheKey(microphone.position) == cache->first;
+                });
+
+                cache = isReceiver ? std::next(cache) : visibilityCaches.erase(cache);
             }
         }
 
@@ -152,37 +374,103 @@ void Raytracer::run()
 
             setStatusMessage("Gathering energy contributions for receiver " + String(microphoneNum + 1) + " / " + String(microphones.size()));
 
-            for (int secondarySourceNum = 0; secondarySourceNum < secondarySources.size(); secondarySourceNum++) {
-                auto secondarySource = secondarySources[secondarySourceNum];
+            auto gatheringStartMS = Time::getMillisecondCounterHiRes();
+
+            VisibilityCache* visibilityCache = nullptr;
+
+            if (useVisibilityCache) {
+                visibilityCache = &visibilityCaches[getVisibilityCacheKey(microphone.position)];
+                visibilityCache->computed.resize((patches.size() + 63) / 64, 0);
+                visibilityCache->visible.resize((patches.size() + 63) / 64, 0);
+            }
+
+            int numComputedPatches = 0;
+            size_t numGatheredSources = 0;
+
+            if (useClustering) {
+                numComputedPatches = gatherSources(microphone, clusteredSources, visibilityCache, useBatchedOcclusion);
+                numGatheredSources = clusteredSources.size();
+
+                reportClusteringError(microphone, isGatheredDirectly, clusteredSources);
+            } else {
+                // secondary sources are streamed chunk by chunk, they do not necessarily fit into memory at once
+                size_t const numChunks = jmax((size_t) 1, secondarySources.getNumChunks());
+                size_t numChunksGathered = 0;
+                std::vector<SecondarySource> chunkSources;
+
+                secondarySources.forEachChunk([&] (const CompactSecondarySource* sources, size_t count) {
+                    // user pressed "cancel"
+                    if (threadShouldExit())
+                        return;
+
+                    chunkSources.clear();
 
-                // user pressed "cancel"
-                if (threadShouldExit())
-                    break;
+                    for (size_t sourceNum = 0; sourceNum < count; sourceNum++) {
+                        auto source = secondarySourceCodec.decode(sources[sourceNum]);
 
-                if (checkVisibility(secondarySource.position, microphone.position)) {
-                    if (secondarySource.order > 0) {
-                        // lamberts cosine law:
-                        // energy received at the observers is proportional to the cosine of the angle between the reflection vector and the surface normal
-                        glm::vec3 edgeSM = glm::normalize(microphone.position - secondarySource.position);
-                        float     angle  = glm::angle(glm::normalize(secondarySource.normal), edgeSM);
-                        secondarySource.energyCoefficients *= cos(angle);
+                        if (isGatheredDirectly(source)) {
+                            chunkSources.push_back(source);
+                        }
                     }
 
-                    secondarySource.delayMS += glm::length(secondarySource.position - microphone.position) / speedOfSoundMpS * 1000.0f;
-                    histograms.at(microphone.name).push_back({secondarySource.energyCoefficients, secondarySource.delayMS});
+                    numComputedPatches += gatherSources(microphone, chunkSources, visibilityCache, useBatchedOcclusion);
+                    numGatheredSources += chunkSources.size();
+
+                    // update the progress bar on the dialog box
+                    setProgress((double) microphoneNum / (double) microphones.size()
+                                + (double) ++numChunksGathered / (double) (microphones.size() * numChunks));
+                });
+            }
+
+            if (visibilityCache != nullptr) {
+                addToRenderSummary("Visibility cache for " + microphone.name + ": " + String(numComputedPatches) + " of " + String(patches.size())
+                                   + " patches computed, the rest were reused or not needed");
+            }
+
+            if (useRadiosity && !threadShouldExit()) {
+                setStatusMessage("Gathering diffuse energy for receiver " + String(microphoneNum + 1) + " / " + String(microphones.size()));
+
+                VisibilityCache patchVisibility;
+
+                if (visibilityCache == nullptr) {
+                    // visibility of the patches is only needed for this render
+                    patchVisibility.computed.resize((patches.size() + 63) / 64, 0);
+                    patchVisibility.visible.resize((patches.size() + 63) / 64, 0);
                 }
 
-                // update the progress bar on the dialog box
-                setProgress((float) ((microphoneNum + 1) * (secondarySourceNum + 1)) / (float) (microphones.size() * secondarySources.size()));
+                gatherRadiosity(microphone, visibilityCache != nullptr ? *visibilityCache : patchVisibility, useBatchedOcclusion);
             }
+
+            if (truncateTrace && !threadShouldExit()) {
+                extrapolateLateTail(microphone, transitionTimeMS, roomVolumeM3);
+            }
+
+            auto gatheringDurationS = (Time::getMillisecondCounterHiRes() - gatheringStartMS) / 1000.0;
+
+            addToRenderSummary("Gathered " + String(numGatheredSources) + (useClustering ? " clusters for " : " secondary sources for ") + microphone.name + " in " + String(gatheringDurationS, 2) + " s"
+                               + (useVisibilityCache ? " (visibility cache)" : useBatchedOcclusion ? " (batched occlusion)" : ""));
         }
     }
 
+    // spilled chunks can also fail to map while they are gathered
+    auto const spillResult = secondarySources.getSpillResult();
+
+    if (spillResult.failed()) {
+        addToRenderSummary(spillResult.getErrorMessage());
+    }
+
     //========================= GENERATING =========================//
     AudioBuffer<float> buffer;
     {
         setStatusMessage("Generating impulse response...");
 
+        // nothing reached the microphone, e.g. because the render was cancelled before the direct sound was gathered
+        if (histograms.at(activeMicrophoneName).empty()) {
+            setStatusMessage("No energy reached the active microphone. Terminating...");
+            sleep(1000);
+            return;
+        }
+
         std::sort(histograms.at(activeMicrophoneName).begin(), histograms.at(activeMicrophoneName).end(), EnergyPortion::byDelay);
 
         double latestReflectionS = histograms.at(activeMicrophoneName)[histograms.at(activeMicrophoneName).size() - 1].delayMS / 1000.0f;
@@ -261,32 +549,43 @@ void Raytracer::run()
         sleep(1000);
     }
 
-    audioProcessor.ir = buffer;
-    impulseResponseComponent.updateThumbnail(audioProcessor.globalSampleRate);
+    // published impulse responses are shared with the audio thread and the editor, they are never written again
+    auto const publish = [this] (AudioBuffer<float>&& samples) {
+        auto impulseResponse = std::make_shared<const ImpulseResponse>(ImpulseResponse{std::move(samples), audioProcessor.globalSampleRate});
+        audioProcessor.publishImpulseResponse(impulseResponse);
+        impulseResponseComponent.updateThumbnail();
+        return impulseResponse;
+    };
+
+    auto const diracSequence = publish(std::move(buffer));
+    const auto& diracs = diracSequence->samples;
 
     {
-        AudioBuffer<float> gainCurveBuffers[6] = {buffer, buffer, buffer, buffer, buffer, buffer};
+        AudioBuffer<float> gainCurveBuffers[6] = {diracs, diracs, diracs, diracs, diracs, diracs};
 
         auto energyPortions = histograms.at(activeMicrophoneName);
         std::sort(energyPortions.begin(), energyPortions.end(), EnergyPortion::byDelay);
 
         float gain = 0.0f;
-        for (int sample = 0; sample < buffer.getNumSamples(); sample++) {
+        for (int sample = 0; sample < diracs.getNumSamples(); sample++) {
             double startTimeMS = sample / audioProcessor.globalSampleRate * 1000.0f;
             double endTimeMS = startTimeMS + 1000.0f/audioProcessor.globalSampleRate;
             auto slice = extractHistogramSlice(startTimeMS, endTimeMS, energyPortions);
 
-            for (int channel = 0; channel < buffer.getNumChannels(); channel++) {
+            for (int channel = 0; channel < diracs.getNumChannels(); channel++) {
                 for (int i = 0; i < 6; i++) {
-                    setStatusMessage("Calculating energy envelopes for sample " + String(sample+1) + "/" + String(audioProcessor.ir.getNumSamples()));
+                    setStatusMessage("Calculating energy envelopes for sample " + String(sample+1) + "/" + String(diracs.getNumSamples()));
                     auto *writePtrArray = gainCurveBuffers[i].getArrayOfWritePointers();
 
                     if (!slice.empty()) {
                         gain = 0.0f;
+                        int numMembers = 0;
                         for (int ep = 0; ep < slice.size(); ep++) {
                             gain += slice[ep].energyCoefficients[i];
+                            numMembers += slice[ep].numMembers;
                         }
-                        gain /= (float) slice.size();
+                        // a cluster carries the summed energy of its members, so it counts as all of them
+                        gain /= (float) numMembers;
                     } else {
                         float decayMS = 10.0f;
                         float durationMS = (float) (endTimeMS - startTimeMS);
@@ -299,10 +598,10 @@ void Raytracer::run()
             }
 
             // update the progress bar on the dialog box
-            setProgress((float) sample / (float) buffer.getNumSamples());
+            setProgress((float) sample / (float) diracs.getNumSamples());
         }
 
-        AudioBuffer<float> bandBuffers[6] = {buffer, buffer, buffer, buffer, buffer, buffer};
+        AudioBuffer<float> bandBuffers[6] = {diracs, diracs, diracs, diracs, diracs, diracs};
 
         for (int i = 0; i < 6; i++) {
             double centerFrequency = pow(2, i)*125;
@@ -346,41 +645,46 @@ void Raytracer::run()
             bandBuffers[i].reverse(0, bandBuffers[i].getNumSamples() - 1);
         }
 
+        // the filtered bands are moved into the published impulse responses, the weighing reads them from there
+        std::shared_ptr<const ImpulseResponse> filteredBands[6];
+
         for (int i = 0; i < 6; i++) {
             setStatusMessage("Showing filtered band " + String(i+1) + "/6 (" + String(pow(2, i)*125) + " Hz)");
-            audioProcessor.ir = bandBuffers[i];
-            impulseResponseComponent.updateThumbnail(audioProcessor.globalSampleRate);
+            filteredBands[i] = publish(std::move(bandBuffers[i]));
             sleep(1000);
         }
 
-        audioProcessor.ir.clear();
-
+        // the weighed bands are written into the gain curves, they are not needed afterwards
         for (int i = 0; i < 6; i++) {
             setStatusMessage("Weighing band " + String(i+1) + "/6 (" + String(pow(2, i)*125) + " Hz)");
-            auto *writePtrArray = bandBuffers[i].getArrayOfWritePointers();
-            auto *readPtrArray = gainCurveBuffers[i].getArrayOfReadPointers();
-            for (int channel = 0; channel < bandBuffers[i].getNumChannels(); channel++) {
-                for (int sample = 0; sample < bandBuffers[i].getNumSamples(); sample++) {
+            auto *writePtrArray = gainCurveBuffers[i].getArrayOfWritePointers();
+            auto *readPtrArray = filteredBands[i]->samples.getArrayOfReadPointers();
+            for (int channel = 0; channel < gainCurveBuffers[i].getNumChannels(); channel++) {
+                for (int sample = 0; sample < gainCurveBuffers[i].getNumSamples(); sample++) {
                     writePtrArray[channel][sample] *= readPtrArray[channel][sample];
                 }
             }
         }
 
+        std::shared_ptr<const ImpulseResponse> weighedBands[6];
+
         for (int i = 0; i < 6; i++) {
             setStatusMessage("Showing weighed band " + String(i+1) + "/6 (" + String(pow(2, i)*125) + " Hz)");
-            audioProcessor.ir = bandBuffers[i];
-            impulseResponseComponent.updateThumbnail(audioProcessor.globalSampleRate);
+            weighedBands[i] = publish(std::move(gainCurveBuffers[i]));
             sleep(1000);
         }
 
-        buffer = bandBuffers[0];
+        audioProcessor.setBandImpulseResponses(std::vector<std::shared_ptr<const ImpulseResponse>>(std::begin(weighedBands), std::end(weighedBands)));
+
+        buffer.setSize(diracs.getNumChannels(), diracs.getNumSamples());
+        buffer.clear();
 
-        for (int i = 1; i < 6; i++) {
+        for (int i = 0; i < 6; i++) {
             setStatusMessage("Adding weighed bands...");
             auto *writePtrArray = buffer.getArrayOfWritePointers();
-            auto *readPtrArray = bandBuffers[i].getArrayOfReadPointers();
-            for (int channel = 0; channel < bandBuffers[i].getNumChannels(); channel++) {
-                for (int sample = 0; sample < bandBuffers[i].getNumSamples(); sample++) {
+            auto *readPtrArray = weighedBands[i]->samples.getArrayOfReadPointers();
+            for (int channel = 0; channel < weighedBands[i]->samples.getNumChannels(); channel++) {
+                for (int sample = 0; sample < weighedBands[i]->samples.getNumSamples(); sample++) {
                     writePtrArray[channel][sample] += readPtrArray[channel][sample];
                 }
             }
@@ -393,7 +697,8 @@ void Raytracer::run()
             }
         }
 
-        audioProcessor.ir = buffer;
+        // the finished impulse response is faded in while the audio keeps playing
+        audioProcessor.loadImpulseResponse(publish(std::move(buffer)), false);
 
         /**
         for (int i = 0; i < 6; i++) {
@@ -420,89 +725,344 @@ void Raytracer::run()
         sleep(1000);
     }
 
-    impulseResponseComponent.updateThumbnail(audioProcessor.globalSampleRate);
-
     sleep(1000);
 }
 
-void Raytracer::trace(Raytracer::Ray ray)
+/**
+ * Follows a single ray through the room until its energy has decayed by 60 dB or it leaves the room.
+ *
+ * @param secondarySource   State of the ray so far, starts with the emitted energy for primary rays.
+ * @param rayPath           If not null, receives the hit points and is handed to the visualizer once the ray ends.
+ */
+void Raytracer::trace(Raytracer::Ray ray, SecondarySource secondarySource, RayPathRing::Path* rayPath)
 {
-    SecondarySource secondarySource;
-
-    while (secondarySource.energyCoefficients.getRelativeVolumeDB() > -60.0f) {
+    while (secondarySource.energyCoefficients.getRelativeVolumeDB() > -60.0f && secondarySource.delayMS < maxTraceDelayMS) {
         Hit hit = calculateBounce(ray);
 
-        if (hit.hitSurface) {
-            // records secondary source
-            secondarySource.order++;
-            secondarySource.position = hit.hitPoint;
-            secondarySource.normal = hit.normal;
-            secondarySource.scatterCoefficient = hit.materialProperties.roughness;
-            secondarySource.delayMS += hit.distance / speedOfSoundMpS * 1000.0f;
-            secondarySource.energyCoefficients *= -hit.materialProperties.absorptionCoefficients;
+        if (!hit.hitSurface) {
+            break;
+        }
 
-            auto recordedSecondarySource = secondarySource;
-            recordedSecondarySource.energyCoefficients *= hit.materialProperties.roughness;
+        bool const continues = reflectRay(ray, secondarySource, hit);
 
-            if (recordedSecondarySource.order < minOrder) {
-                minOrder = recordedSecondarySource.order;
-                sendChangeMessage();
-            }
+        if (rayPath != nullptr) {
+            rayPath->add(hit.hitPoint, secondarySource.energyCoefficients.getAverage());
+        }
+
+        if (!continues) {
+            break;
+        }
+    }
+
+    if (rayPath != nullptr) {
+        rayPaths.push(*rayPath);
+    }
+}
+
+/**
+ * Traces all rays of a source, primary rays and first order reflections are sorted by direction and
+ * intersected as packets. Packets whose directions diverge too much and all higher order reflections
+ * fall back to single ray traversal.
+ */
+void Raytracer::tracePackets(std::vector<Ray>& rays, std::vector<SecondarySource>& secondarySourceStates, double progressStart, double progressEnd)
+{
+    std::vector<int> activeRays;
+
+    for (int rayNum = 0; rayNum < (int) rays.size(); rayNum++) {
+        if (secondarySourceStates[(size_t) rayNum].energyCoefficients.getRelativeVolumeDB() > -60.0f) {
+            activeRays.push_back(rayNum);
+        }
+    }
+
+    const int numPacketGenerations = 2;
+    const double progressPerGeneration = (progressEnd - progressStart) / (numPacketGenerations + 1);
+
+    // paths of the sampled rays, indexed by ray
+    std::vector<RayPathRing::Path> sampledRayPaths;
+    std::vector<int> rayPathNums;
+
+    if (recordRayPaths) {
+        rayPathNums.assign(rays.size(), -1);
+
+        for (size_t rayNum = 0; rayNum < rays.size(); rayNum += (size_t) rayPathInterval) {
+            rayPathNums[rayNum] = (int) sampledRayPaths.size();
+            sampledRayPaths.emplace_back();
+            sampledRayPaths.back().add(rays[rayNum].position, secondarySourceStates[rayNum].energyCoefficients.getAverage());
+        }
+    }
+
+    auto const getRayPath = [&] (int rayNum) -> RayPathRing::Path* {
+        if (!recordRayPaths || rayPathNums[(size_t) rayNum] < 0) {
+            return nullptr;
+        }
+
+        return &sampledRayPaths[(size_t) rayPathNums[(size_t) rayNum]];
+    };
 
-            if (recordedSecondarySource.order > maxOrder) {
-                maxOrder = recordedSecondarySource.order;
-                sendChangeMessage();
+    for (int generation = 0; generation < numPacketGenerations && !activeRays.empty(); generation++) {
+        // neighboring directions end up next to each other
+        std::vector<std::pair<juce::uint32, int>> sortedRays;
+        sortedRays.reserve(activeRays.size());
+
+        for (int rayNum : activeRays) {
+            sortedRays.emplace_back(RaytracerUtils::directionKey(rays[(size_t) rayNum].direction), rayNum);
+        }
+
+        std::sort(sortedRays.begin(), sortedRays.end());
+
+        std::vector<int> continuingRays;
+
+        for (size_t first = 0; first < sortedRays.size(); first += RayPacket::size) {
+            // user pressed "cancel"
+            if (threadShouldExit())
+                return;
+
+            size_t count = jmin((size_t) RayPacket::size, sortedRays.size() - first);
+            Hit hits[RayPacket::size];
+
+            if (count == RayPacket::size && isCoherent(rays, sortedRays, first, count)) {
+                RayPacket packet;
+
+                for (int lane = 0; lane < RayPacket::size; lane++) {
+                    const auto& ray = rays[(size_t) sortedRays[first + (size_t) lane].second];
+
+                    packet.positionX[lane]  = ray.position.x;
+                    packet.positionY[lane]  = ray.position.y;
+                    packet.positionZ[lane]  = ray.position.z;
+                    packet.directionX[lane] = ray.direction.x;
+                    packet.directionY[lane] = ray.direction.y;
+                    packet.directionZ[lane] = ray.direction.z;
+                    packet.distance[lane]   = Hit().distance;
+                    packet.triangle[lane]   = -1;
+                }
+
+                numRaysCast += RayPacket::size;
+                intersectPacket(packet, packetTriangles);
+
+                for (int lane = 0; lane < RayPacket::size; lane++) {
+                    if (packet.triangle[lane] >= 0) {
+                        hits[lane] = getTriangleHit(rays[(size_t) sortedRays[first + (size_t) lane].second], packet.triangle[lane], packet.distance[lane]);
+                    }
+                }
+            } else {
+                for (size_t lane = 0; lane < count; lane++) {
+                    hits[lane] = calculateBounce(rays[(size_t) sortedRays[first + lane].second]);
+                }
             }
 
-            secondarySources.push_back(recordedSecondarySource);
+            for (size_t lane = 0; lane < count; lane++) {
+                int rayNum = sortedRays[first + lane].second;
+                bool continues = false;
+
+                if (hits[lane].hitSurface) {
+                    continues = reflectRay(rays[(size_t) rayNum], secondarySourceStates[(size_t) rayNum], hits[lane]);
+                }
 
-            ray.position = hit.hitPoint;
+                if (continues) {
+                    continuingRays.push_back(rayNum);
+                }
 
-            // calculate diffuse and specular portion of reflection
-            glm::vec3 specularReflection = reflect(ray.direction, hit.normal);
-            glm::vec3 diffuseReflection = glm::normalize(glm::vec3{randomNormalDistribution(), randomNormalDistribution(), randomNormalDistribution()});
+                if (auto* rayPath = getRayPath(rayNum)) {
+                    if (hits[lane].hitSurface) {
+                        rayPath->add(hits[lane].hitPoint, secondarySourceStates[(size_t) rayNum].energyCoefficients.getAverage());
+                    }
 
-            // dot product of normal and vector is negative if the angle between them is greater than 90 degrees
-            if (dot(hit.normal, diffuseReflection) < 0) {
-                // reflection would not be in the same hemisphere, so invert it
-                diffuseReflection *= -1;
+                    if (!continues) {
+                        rayPaths.push(*rayPath);
+                    }
+                }
             }
-            ray.direction = normalize(mix(specularReflection, diffuseReflection, hit.materialProperties.roughness));
-            secondarySource.energyCoefficients *= 1-hit.materialProperties.roughness;
-        } else {
-            break;
+
+            // update the progress bar on the dialog box
+            setProgress(progressStart + progressPerGeneration * (generation + (double) (first + count) / (double) sortedRays.size()));
         }
+
+        activeRays = std::move(continuingRays);
+    }
+
+    // the remaining rays have scattered too much to stay coherent
+    for (size_t rayNum = 0; rayNum < activeRays.size(); rayNum++) {
+        // user pressed "cancel"
+        if (threadShouldExit())
+            return;
+
+        trace(rays[(size_t) activeRays[rayNum]], secondarySourceStates[(size_t) activeRays[rayNum]], getRayPath(activeRays[rayNum]));
+
+        // update the progress bar on the dialog box
+        setProgress(progressStart + progressPerGeneration * (numPacketGenerations + (double) (rayNum + 1) / (double) activeRays.size()));
     }
 }
 
+/**
+ * Records the secondary source at the hit point and turns the ray into its reflection.
+ *
+ * @return Whether the reflected ray still carries enough energy and is early enough to be traced further.
+ */
+bool Raytracer::reflectRay(Ray& ray, SecondarySource& secondarySource, const Hit& hit)
+{
+    // records secondary source
+    secondarySource.order++;
+    secondarySource.position = hit.hitPoint;
+    secondarySource.normal = hit.normal;
+    secondarySource.scatterCoefficient = hit.materialProperties.roughness;
+    secondarySource.delayMS += hit.distance / speedOfSoundMpS * 1000.0f;
+    secondarySource.energyCoefficients *= -hit.materialProperties.absorptionCoefficients;
+    secondarySource.patch = getPatch(hit.triangle, hit.hitPoint);
+
+    auto recordedSecondarySource = secondarySource;
+    recordedSecondarySource.energyCoefficients *= hit.materialProperties.roughness;
+
+    if (recordedSecondarySource.order < minOrder) {
+        minOrder = recordedSecondarySource.order;
+        sendChangeMessage();
+    }
+
+    if (recordedSecondarySource.order > maxOrder) {
+        maxOrder = recordedSecondarySource.order;
+        sendChangeMessage();
+    }
+
+    recordSecondarySource(recordedSecondarySource);
+
+    ray.position = hit.hitPoint;
+
+    // calculate diffuse and specular portion of reflection
+    glm::vec3 specularReflection = glm::reflect(ray.direction, hit.normal);
+    glm::vec3 diffuseReflection = glm::normalize(glm::vec3{randomNormalDistribution(), randomNormalDistribution(), randomNormalDistribution()});
+
+    // dot product of normal and vector is negative if the angle between them is greater than 90 degrees
+    if (dot(hit.normal, diffuseReflection) < 0) {
+        // reflection would not be in the same hemisphere, so invert it
+        diffuseReflection *= -1;
+    }
+    ray.direction = normalize(mix(specularReflection, diffuseReflection, hit.materialProperties.roughness));
+    secondarySource.energyCoefficients *= 1-hit.materialProperties.roughness;
+
+    return secondarySource.energyCoefficients.getRelativeVolumeDB() > -60.0f && secondarySource.delayMS < maxTraceDelayMS;
+}
+
 Raytracer::Hit Raytracer::calculateBounce(Ray ray)
+{
+    numRaysCast++;
+
+    Hit hit = intersect(ray, triangles);
+
+    if (hit.triangle >= 0) {
+        hit.materialProperties = room.shapes[(size_t) triangleShapes[(size_t) hit.triangle]]->materialProperties;
+    }
+
+    return hit;
+}
+
+/**
+ * @return The closest hit of the ray with any of the triangles, its triangle is the index into the list.
+ */
+Raytracer::Hit Raytracer::intersect(Ray ray, const std::vector<Triangle>& sceneTriangles)
 {
     Hit hit;
 
-    for (WavefrontObjFile::Shape* shape : room.shapes) {
+    for (int triangleNum = 0; triangleNum < (int) sceneTriangles.size(); triangleNum++) {
+        Hit triangleHit = collisionTriangle(ray, sceneTriangles[(size_t) triangleNum]);
 
-        jassert(shape->mesh.indices.size() % 3 == 0);
+        if (triangleHit.hitSurface && triangleHit.distance < hit.distance) {
+            hit = triangleHit;
+            hit.triangle = triangleNum;
+        }
+    }
 
-        for (int index = 0; index < shape->mesh.indices.size(); index += 3) {
-            Triangle triangle;
+    return hit;
+}
+
+/**
+ * Intersects all lanes of a packet with every triangle of the room. Each triangle is loaded once per packet
+ * and the lane loop is branch free, so the compiler can map it onto SIMD registers.
+ * Lanes keep the closest hit that is nearer than their initial distance.
+ *
+ * @see collisionTriangle
+ */
+void Raytracer::intersectPacket(RayPacket& packet, const std::vector<PacketTriangle>& sceneTriangles)
+{
+    for (int triangleNum = 0; triangleNum < (int) sceneTriangles.size(); triangleNum++) {
+        const auto& triangle = sceneTriangles[(size_t) triangleNum];
 
-            triangle.normal = shape->mesh.normals[shape->mesh.indices[index]];
-            triangle.pointA = shape->mesh.vertices[shape->mesh.indices[index + 0]];
-            triangle.pointB = shape->mesh.vertices[shape->mesh.indices[index + 1]];
-            triangle.pointC = shape->mesh.vertices[shape->mesh.indices[index + 2]];
+        for (int lane = 0; lane < RayPacket::size; lane++) {
+            float det  = -(packet.directionX[lane] * triangle.normal.x + packet.directionY[lane] * triangle.normal.y + packet.directionZ[lane] * triangle.normal.z);
 
-            Hit triangleHit = collisionTriangle(ray, triangle);
+            float apX  = packet.positionX[lane] - triangle.pointA.x;
+            float apY  = packet.positionY[lane] - triangle.pointA.y;
+            float apZ  = packet.positionZ[lane] - triangle.pointA.z;
 
-            if (triangleHit.hitSurface && triangleHit.distance < hit.distance) {
-                triangleHit.materialProperties = shape->materialProperties;
-                hit = triangleHit;
-            }
+            float dapX = apY * packet.directionZ[lane] - apZ * packet.directionY[lane];
+            float dapY = apZ * packet.directionX[lane] - apX * packet.directionZ[lane];
+            float dapZ = apX * packet.directionY[lane] - apY * packet.directionX[lane];
+
+            float inverseDet = 1.0f / det;
+
+            float u =  (triangle.edgeAC.x * dapX + triangle.edgeAC.y * dapY + triangle.edgeAC.z * dapZ) * inverseDet;
+            float v = -(triangle.edgeAB.x * dapX + triangle.edgeAB.y * dapY + triangle.edgeAB.z * dapZ) * inverseDet;
+            float t =  (apX * triangle.normal.x + apY * triangle.normal.y + apZ * triangle.normal.z) * inverseDet;
+
+            bool isCloserHit = det != 0.0f
+                            && t   >= 0.0001f
+                            && u   >= 0.0f
+                            && v   >= 0.0f
+                            && u+v <= 1.0f
+                            && t   <  packet.distance[lane];
+
+            packet.distance[lane] = isCloserHit ? t           : packet.distance[lane];
+            packet.triangle[lane] = isCloserHit ? triangleNum : packet.triangle[lane];
         }
     }
+}
+
+Raytracer::PacketTriangle Raytracer::PacketTriangle::fromTriangle(const Triangle& triangle)
+{
+    glm::vec3 edgeAB = triangle.pointB - triangle.pointA;
+    glm::vec3 edgeAC = triangle.pointC - triangle.pointA;
+
+    return {triangle.pointA, edgeAB, edgeAC, glm::cross(edgeAB, edgeAC)};
+}
+
+Raytracer::Hit Raytracer::getTriangleHit(Ray ray, int triangleNum, float distance) const
+{
+    Hit hit;
+
+    hit.hitSurface = true;
+    hit.distance = distance;
+    hit.hitPoint = ray.position + distance * ray.direction;
+    hit.normal = triangles[(size_t) triangleNum].normal;
+    hit.materialProperties = room.shapes[(size_t) triangleShapes[(size_t) triangleNum]]->materialProperties;
+    hit.triangle = triangleNum;
 
     return hit;
 }
 
+/**
+ * @return Whether all directions of the packet lie within a narrow cone around their mean direction.
+ */
+bool Raytracer::isCoherent(const std::vector<Ray>& rays, const std::vector<std::pair<juce::uint32, int>>& sortedRays, size_t first, size_t count)
+{
+    glm::vec3 meanDirection = {0.0f, 0.0f, 0.0f};
+
+    for (size_t lane = 0; lane < count; lane++) {
+        meanDirection += rays[(size_t) sortedRays[first + lane].second].direction;
+    }
+
+    if (glm::length(meanDirection) == 0.0f) {
+        return false;
+    }
+
+    meanDirection = glm::normalize(meanDirection);
+
+    for (size_t lane = 0; lane < count; lane++) {
+        if (glm::dot(meanDirection, rays[(size_t) sortedRays[first + lane].second].direction) < packetCoherenceCosine) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 /**
  * @return A random float from a normal distribution with mean 0 and standard deviation of 1
  * @see https://stackoverflow.com/a/6178290
@@ -564,24 +1124,968 @@ Raytracer::Hit Raytracer::collisionTriangle(Raytracer::Ray ray, Raytracer::Trian
 }
 
 /**
- * Simple visibility check that uses the geometry of the currently loaded room.
+ * Adds the energy a visible secondary source contributes to the histogram of the microphone.
  */
-bool Raytracer::checkVisibility(glm::vec3 positionA, glm::vec3 positionB)
+void Raytracer::addContribution(const Object& microphone, SecondarySource secondarySource)
 {
-    Ray edgeAB = {
-            positionA,
-            glm::normalize(positionB - positionA)
-    };
+    histograms.at(microphone.name).push_back(getContribution(microphone, secondarySource));
+}
 
-    Hit hit = calculateBounce(edgeAB);
+/**
+ * @return The energy of the secondary source that arrives at the microphone and its delay, assuming it is visible.
+ */
+Raytracer::EnergyPortion Raytracer::getContribution(const Object& microphone, SecondarySource secondarySource) const
+{
+    if (secondarySource.order > 0) {
+        // lamberts cosine law:
+        // energy received at the observers is proportional to the cosine of the angle between the reflection vector and the surface normal
+        glm::vec3 edgeSM = glm::normalize(microphone.position - secondarySource.position);
+        float     angle  = glm::angle(glm::normalize(secondarySource.normal), edgeSM);
+        secondarySource.energyCoefficients *= cos(angle);
+    } else {
+        // direct sound: weigh with the directivity of the emitting speaker towards the receiver,
+        // positions are quantized, so the emitting speaker is the closest one
+        const Object* emittingSpeaker = nullptr;
+        float closestDistance = std::numeric_limits<float>::max();
 
-    if (hit.hitSurface && hit.distance < glm::length(positionB - positionA)) {
-        return false;
-    }
+        for (const auto& speaker : speakers) {
+            float distance = glm::length(speaker.position - secondarySource.position);
+
+            if (distance < closestDistance) {
+                emittingSpeaker = &speaker;
+                closestDistance = distance;
+            }
+        }
+
+        if (emittingSpeaker != nullptr) {
+            secondarySource.energyCoefficients *= emittingSpeaker->directivity.getGain(microphone.position - emittingSpeaker->position);
+        }
+    }
+
+    secondarySource.delayMS += glm::length(secondarySource.position - microphone.position) / speedOfSoundMpS * 1000.0f;
+    return {secondarySource.energyCoefficients, secondarySource.delayMS, secondarySource.numMembers};
+}
+
+/**
+ * Stores a secondary source. With reservoir sampling, sources beyond the capacity compete for a place
+ * with a key of u^(1/w) for a uniform random u and their mean energy w, so sources with more energy are more
+ * likely to be kept. The direct sound is always kept.
+ *
+ * @see Efraimidis, Spirakis, Weighted random sampling with a reservoir
+ */
+void Raytracer::recordSecondarySource(const SecondarySource& secondarySource)
+{
+    if (!useReservoirSampling) {
+        secondarySources.push_back(secondarySourceCodec.encode(secondarySource));
+        return;
+    }
+
+    numOfferedSecondarySources++;
+
+    // the direct sound stays outside the reservoir, so it is kept even if the capacity is exhausted
+    if (secondarySource.order == 0) {
+        secondarySources.push_back(secondarySourceCodec.encode(secondarySource));
+        return;
+    }
+
+    // offered energy over time, so that the kept sources can be scaled up to it afterwards
+    auto const bucket = (size_t) jmax(0.0f, secondarySource.delayMS / reservoirBucketMS);
+
+    if (bucket >= offeredEnergyPerBucket.size()) {
+        Band6Coefficients noEnergy;
+        noEnergy *= 0.0f;
+        offeredEnergyPerBucket.resize(bucket + 1, noEnergy);
+    }
+
+    offeredEnergyPerBucket[bucket] += secondarySource.energyCoefficients;
+
+    auto energy = secondarySource.energyCoefficients;
+    float const weight = energy.getAverage();
+
+    // keys are compared in log space, log(u^(1/w)) = log(u) / w
+    float const key = weight > 0.0f ? std::log(jmax(randomGenerator.nextFloat(), std::numeric_limits<float>::min())) / weight
+                                    : -std::numeric_limits<float>::infinity();
+
+    // min-heap, the front holds the source that is replaced next
+    auto const hasGreaterKey = [] (const std::pair<float, juce::uint32>& a, const std::pair<float, juce::uint32>& b) {
+        return a.first > b.first;
+    };
+
+    if (secondarySources.size() < reservoirCapacity) {
+        if (reservoirHeap.capacity() == 0) {
+            reservoirHeap.reserve(reservoirCapacity);
+        }
+
+        reservoirHeap.emplace_back(key, (juce::uint32) secondarySources.size());
+        std::push_heap(reservoirHeap.begin(), reservoirHeap.end(), hasGreaterKey);
+        secondarySources.push_back(secondarySourceCodec.encode(secondarySource));
+        return;
+    }
+
+    if (reservoirHeap.empty() || key <= reservoirHeap.front().first) {
+        return;
+    }
+
+    std::pop_heap(reservoirHeap.begin(), reservoirHeap.end(), hasGreaterKey);
+    juce::uint32 const slot = reservoirHeap.back().second;
+    reservoirHeap.back() = {key, slot};
+    std::push_heap(reservoirHeap.begin(), reservoirHeap.end(), hasGreaterKey);
+
+    secondarySources.set(slot, secondarySourceCodec.encode(secondarySource));
+
+    // the visualizer keeps showing the replaced sources until it is told to start over
+    auto const nowMS = Time::getMillisecondCounter();
+
+    if (nowMS - lastReservoirRewriteMS >= reservoirRewriteIntervalMS) {
+        secondarySources.markRewritten();
+        lastReservoirRewriteMS = nowMS;
+    }
+}
+
+/**
+ * Scales the energy of the kept secondary sources per band and per delay bucket,
+ * so that their total matches the energy of all sources that were offered to the reservoir.
+ */
+void Raytracer::finishReservoirSampling()
+{
+    Band6Coefficients noEnergy;
+    noEnergy *= 0.0f;
+
+    std::vector<Band6Coefficients> keptEnergyPerBucket(offeredEnergyPerBucket.size(), noEnergy);
+
+    forEachSecondarySource([&] (const SecondarySource& secondarySource) {
+        auto const bucket = (size_t) jmax(0.0f, secondarySource.delayMS / reservoirBucketMS);
+
+        if (secondarySource.order > 0 && bucket < keptEnergyPerBucket.size()) {
+            keptEnergyPerBucket[bucket] += secondarySource.energyCoefficients;
+        }
+    });
+
+    for (size_t sourceNum = 0; sourceNum < secondarySources.size(); sourceNum++) {
+        auto secondarySource = getSecondarySource(sourceNum);
+        auto const bucket = (size_t) jmax(0.0f, secondarySource.delayMS / reservoirBucketMS);
+
+        if (secondarySource.order == 0 || bucket >= keptEnergyPerBucket.size()) {
+            continue;
+        }
+
+        for (int band = 0; band < 6; band++) {
+            if (keptEnergyPerBucket[bucket][band] > 0.0f) {
+                secondarySource.energyCoefficients[band] *= offeredEnergyPerBucket[bucket][band] / keptEnergyPerBucket[bucket][band];
+            }
+        }
+
+        secondarySources.set(sourceNum, secondarySourceCodec.encode(secondarySource));
+    }
+
+    secondarySources.markRewritten();
+}
+
+/**
+ * Merges secondary sources that lie in the same grid cell of the spatial tolerance, arrive within the same
+ * delay tolerance and belong to surfaces facing the same way into one representative. The representative sits
+ * at the energy weighted mean position and delay of its members and carries their summed energy and their number.
+ */
+std::vector<Raytracer::SecondarySource> Raytracer::clusterSecondarySources(const std::function<bool(const SecondarySource&)>& include, float toleranceM, float toleranceMS)
+{
+    toleranceM  = jmax(toleranceM, 0.001f);
+    toleranceMS = jmax(toleranceMS, 0.001f);
+
+    struct Accumulator {
+        SecondarySource representative;
+        SecondarySource firstMember;
+        glm::vec3 weightedPosition = {0.0f, 0.0f, 0.0f};
+        glm::vec3 weightedNormal = {0.0f, 0.0f, 0.0f};
+        double weightedDelayMS = 0.0;
+        double weightedScatterCoefficient = 0.0;
+        double weight = 0.0;
+        int numMembers = 0;
+    };
+
+    std::vector<Accumulator> accumulators;
+    std::unordered_map<ClusterKey, size_t, ClusterKey::Hasher> clusterIndices;
+
+    auto const getKey = [toleranceM, toleranceMS] (const SecondarySource& source) {
+        glm::vec3 absoluteNormal = glm::abs(source.normal);
+        int normalAxis = absoluteNormal.x >= absoluteNormal.y && absoluteNormal.x >= absoluteNormal.z ? 0
+                       : absoluteNormal.y >= absoluteNormal.z                                          ? 1
+                                                                                                       : 2;
+        if (source.normal[normalAxis] < 0.0f) {
+            normalAxis += 3;
+        }
+
+        return ClusterKey {glm::ivec3(glm::floor(source.position / toleranceM)),
+                           (int) std::floor(source.delayMS / toleranceMS),
+                           normalAxis};
+    };
+
+    size_t numSources = 0;
+
+    forEachSecondarySource([&] (const SecondarySource& source) {
+        if (!include(source)) {
+            return;
+        }
+
+        size_t clusterNum;
+
+        // direct sound is never merged, every source of order 0 gets a cluster of its own
+        if (source.order == 0) {
+            clusterNum = accumulators.size();
+            accumulators.emplace_back();
+            accumulators.back().representative.order = 0;
+            accumulators.back().representative.energyCoefficients *= 0.0f;
+        } else {
+            auto inserted = clusterIndices.emplace(getKey(source), accumulators.size());
+            clusterNum = inserted.first->second;
+
+            if (inserted.second) {
+                accumulators.emplace_back();
+                accumulators.back().representative.order = source.order;
+                accumulators.back().representative.energyCoefficients *= 0.0f;
+            }
+        }
+
+        auto& accumulator = accumulators[clusterNum];
+        auto energy = source.energyCoefficients;
+        double weight = (double) energy.getAverage() + 1.0e-12;
+
+        accumulator.representative.order = jmin(accumulator.representative.order, source.order);
+        accumulator.representative.energyCoefficients += source.energyCoefficients;
+        accumulator.weightedPosition += (float) weight * source.position;
+        accumulator.weightedNormal += (float) weight * source.normal;
+        accumulator.weightedDelayMS += weight * source.delayMS;
+        accumulator.weightedScatterCoefficient += weight * source.scatterCoefficient;
+        accumulator.weight += weight;
+
+        if (accumulator.numMembers++ == 0) {
+            accumulator.firstMember = source;
+        }
+
+        numSources++;
+    });
+
+    std::vector<SecondarySource> clusters;
+    clusters.reserve(accumulators.size());
+
+    for (auto& accumulator : accumulators) {
+        // sources that were not merged are passed on unchanged
+        if (accumulator.numMembers == 1) {
+            clusters.push_back(accumulator.firstMember);
+            continue;
+        }
+
+        auto& representative = accumulator.representative;
+
+        // members face the same way and lie close to each other, so the patch of one of them stands in for all
+        representative.patch = accumulator.firstMember.patch;
+
+        representative.position = accumulator.weightedPosition / (float) accumulator.weight;
+        representative.normal = glm::length(accumulator.weightedNormal) > 0.0f ? glm::normalize(accumulator.weightedNormal) : accumulator.weightedNormal;
+        representative.delayMS = (float) (accumulator.weightedDelayMS / accumulator.weight);
+        representative.scatterCoefficient = (float) (accumulator.weightedScatterCoefficient / accumulator.weight);
+        representative.numMembers = accumulator.numMembers;
+
+        clusters.push_back(representative);
+    }
+
+    addToRenderSummary("Clustered " + String(numSources) + " secondary sources into " + String(clusters.size()));
+
+    return clusters;
+}
+
+/**
+ * Compares the energy envelopes that the clusters and the original secondary sources produce at the microphone,
+ * per band in bins of clusteringErrorBinMS, and adds the relative RMS error to the render summary. Like the generation,
+ * the energy of a bin is divided by the number of sources it stands for, so clusters count as all of their members.
+ * Occlusion is left out, the members of a cluster lie on the same surface and see the microphone alike.
+ */
+void Raytracer::reportClusteringError(const Object& microphone, const std::function<bool(const SecondarySource&)>& include, const std::vector<SecondarySource>& clusters)
+{
+    struct Bin {
+        std::array<double, 6> energy {};
+        int numMembers = 0;
+    };
+
+    using Bins = std::vector<Bin>;
+
+    auto const accumulate = [this, &microphone] (Bins& bins, const SecondarySource& source) {
+        auto portion = getContribution(microphone, source);
+        auto const bin = (size_t) jmax(0.0f, portion.delayMS / clusteringErrorBinMS);
+
+        if (bin >= bins.size()) {
+            bins.resize(bin + 1);
+        }
+
+        for (int band = 0; band < 6; band++) {
+            bins[bin].energy[(size_t) band] += portion.energyCoefficients[band];
+        }
+
+        bins[bin].numMembers += portion.numMembers;
+    };
+
+    auto const getEnvelope = [] (const Bin& bin, size_t band) {
+        return bin.numMembers > 0 ? bin.energy[band] / bin.numMembers : 0.0;
+    };
+
+    Bins originalBins;
+    Bins clusteredBins;
+
+    forEachSecondarySource([&] (const SecondarySource& source) {
+        if (include(source)) {
+            accumulate(originalBins, source);
+        }
+    });
+
+    for (const auto& cluster : clusters) {
+        accumulate(clusteredBins, cluster);
+    }
+
+    clusteredBins.resize(jmax(originalBins.size(), clusteredBins.size()));
+    originalBins.resize(clusteredBins.size());
+
+    double meanError = 0.0;
+    double maxError = 0.0;
+
+    for (size_t band = 0; band < 6; band++) {
+        double squaredDifference = 0.0;
+        double squaredEnergy = 0.0;
+
+        for (size_t bin = 0; bin < originalBins.size(); bin++) {
+            double original = getEnvelope(originalBins[bin], band);
+            double difference = getEnvelope(clusteredBins[bin], band) - original;
+            squaredDifference += difference * difference;
+            squaredEnergy += original * original;
+        }
+
+        double error = squaredEnergy > 0.0 ? std::sqrt(squaredDifference / squaredEnergy) : 0.0;
+        meanError += error / 6.0;
+        maxError = jmax(maxError, error);
+    }
+
+    addToRenderSummary("Energy envelope error of the clusters for " + microphone.name + ": " + String(meanError * 100.0, 2) + " % mean, "
+                       + String(maxError * 100.0, 2) + " % worst band, in bins of " + String(clusteringErrorBinMS, 0) + " ms");
+}
+
+/**
+ * Tests the visibility of the sources from the microphone in Morton order and adds the contributions of the visible ones.
+ *
+ * @return The number of patches whose visibility had to be computed for the visibility cache.
+ */
+int Raytracer::gatherSources(const Object& microphone, const std::vector<SecondarySource>& sources, VisibilityCache* visibilityCache, bool batched)
+{
+    // consecutive visibility rays start close to each other and see the same part of the room
+    std::vector<int> gatherOrder = getMortonOrder(sources);
+    int numComputedPatches = 0;
+
+    if (visibilityCache != nullptr) {
+        numComputedPatches = updateVisibilityCache(*visibilityCache, microphone.position, sources, gatherOrder, batched);
+    }
+
+    for (size_t first = 0; first < gatherOrder.size(); first += RayPacket::size) {
+        // user pressed "cancel"
+        if (threadShouldExit())
+            break;
+
+        size_t count = jmin((size_t) RayPacket::size, gatherOrder.size() - first);
+        bool visible[RayPacket::size];
+
+        if (visibilityCache != nullptr) {
+            for (size_t lane = 0; lane < count; lane++) {
+                const auto& source = sources[(size_t) gatherOrder[first + lane]];
+
+                visible[lane] = source.patch >= 0 ? visibilityCache->isVisible(source.patch)
+                                                  : checkVisibility(source.position, microphone.position);
+            }
+        } else if (batched && count == RayPacket::size) {
+            std::array<glm::vec3, RayPacket::size> positions;
+
+            for (size_t lane = 0; lane < count; lane++) {
+                positions[lane] = sources[(size_t) gatherOrder[first + lane]].position;
+            }
+
+            checkVisibility(positions, microphone.position, visible);
+        } else {
+            for (size_t lane = 0; lane < count; lane++) {
+                visible[lane] = checkVisibility(sources[(size_t) gatherOrder[first + lane]].position, microphone.position);
+            }
+        }
+
+        for (size_t lane = 0; lane < count; lane++) {
+            if (visible[lane]) {
+                addContribution(microphone, sources[(size_t) gatherOrder[first + lane]]);
+            }
+        }
+    }
+
+    return numComputedPatches;
+}
+
+/**
+ * @return The indices of the secondary sources sorted along a 3D Morton curve through their bounding box.
+ */
+std::vector<int> Raytracer::getMortonOrder(const std::vector<SecondarySource>& sources)
+{
+    std::vector<int> order;
+
+    if (sources.empty()) {
+        return order;
+    }
+
+    glm::vec3 minimum = sources[0].position;
+    glm::vec3 maximum = sources[0].position;
+
+    for (const auto& source : sources) {
+        minimum = glm::min(minimum, source.position);
+        maximum = glm::max(maximum, source.position);
+    }
+
+    glm::vec3 extent = maximum - minimum;
+    const float gridSize = (float) ((1 << 21) - 1);
+
+    std::vector<std::pair<juce::uint64, int>> keys;
+    keys.reserve(sources.size());
+
+    for (int sourceNum = 0; sourceNum < (int) sources.size(); sourceNum++) {
+        glm::vec3 relative = sources[(size_t) sourceNum].position - minimum;
+
+        auto x = (juce::uint32) (extent.x > 0.0f ? relative.x / extent.x * gridSize : 0.0f);
+        auto y = (juce::uint32) (extent.y > 0.0f ? relative.y / extent.y * gridSize : 0.0f);
+        auto z = (juce::uint32) (extent.z > 0.0f ? relative.z / extent.z * gridSize : 0.0f);
+
+        keys.emplace_back(RaytracerUtils::mortonCode3D(x, y, z), sourceNum);
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    order.reserve(keys.size());
+    for (const auto& key : keys) {
+        order.push_back(key.second);
+    }
+
+    return order;
+}
+
+/**
+ * Simple visibility check that uses the geometry of the currently loaded room.
+ */
+bool Raytracer::checkVisibility(glm::vec3 positionA, glm::vec3 positionB)
+{
+    Ray edgeAB = {
+            positionA,
+            glm::normalize(positionB - positionA)
+    };
+
+    Hit hit = calculateBounce(edgeAB);
+
+    if (hit.hitSurface && hit.distance < glm::length(positionB - positionA)) {
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Subdivides every triangle of the room into patches whose edges are at most sizeM long.
+ * A triangle with n subdivisions is split along its edges AB and AC into a grid of n*(n+1)/2 cells.
+ * Patches are only rebuilt when the geometry or the patch size changed since the last call.
+ */
+void Raytracer::buildPatches(float sizeM)
+{
+    sizeM = jmax(sizeM, 0.01f);
+
+    if (sizeM == patchSizeM && trianglePatchOffsets.size() == triangles.size()) {
+        return;
+    }
+
+    patches.clear();
+    trianglePatchOffsets.clear();
+    triangleSubdivisions.clear();
+    visibilityCaches.clear();
+    radiosity.clearFormFactors();
+    patchSizeM = sizeM;
+
+    for (int triangleNum = 0; triangleNum < (int) triangles.size(); triangleNum++) {
+        const auto& triangle = triangles[(size_t) triangleNum];
+
+        glm::vec3 edgeAB = triangle.pointB - triangle.pointA;
+        glm::vec3 edgeAC = triangle.pointC - triangle.pointA;
+
+        float longestEdgeM = jmax(glm::length(edgeAB), glm::length(edgeAC), glm::length(triangle.pointC - triangle.pointB));
+        int subdivisions = jlimit(1, 64, (int) std::ceil(longestEdgeM / sizeM));
+        float triangleArea = 0.5f * glm::length(glm::cross(edgeAB, edgeAC));
+
+        trianglePatchOffsets.push_back((int) patches.size());
+        triangleSubdivisions.push_back(subdivisions);
+
+        for (int i = 0; i < subdivisions; i++) {
+            for (int j = 0; j < subdivisions - i; j++) {
+                // cells on the diagonal are cut in half by the edge BC, use the centroid of the remaining half
+                bool isDiagonal = i + j == subdivisions - 1;
+                float offset = isDiagonal ? 1.0f / 3.0f : 0.5f;
+                float u = ((float) i + offset) / (float) subdivisions;
+                float v = ((float) j + offset) / (float) subdivisions;
+
+                // cells off the diagonal cover twice the area of the ones on it
+                float area = triangleArea * (isDiagonal ? 1.0f : 2.0f) / (float) (subdivisions * subdivisions);
+
+                patches.push_back({triangle.pointA + u * edgeAB + v * edgeAC, glm::normalize(triangle.normal), area, triangleNum});
+            }
+        }
+    }
+}
+
+/**
+ * @return The index of the patch of the triangle that contains the point, or -1 if there are no patches.
+ */
+int Raytracer::getPatch(int triangleNum, glm::vec3 point) const
+{
+    if (triangleNum < 0 || triangleNum >= (int) trianglePatchOffsets.size()) {
+        return -1;
+    }
+
+    const auto& triangle = packetTriangles[(size_t) triangleNum];
+    int const subdivisions = triangleSubdivisions[(size_t) triangleNum];
+    int const offset = trianglePatchOffsets[(size_t) triangleNum];
+
+    // barycentric coordinates of the point along AB and AC
+    glm::vec3 ap = point - triangle.pointA;
+    float abab = glm::dot(triangle.edgeAB, triangle.edgeAB);
+    float abac = glm::dot(triangle.edgeAB, triangle.edgeAC);
+    float acac = glm::dot(triangle.edgeAC, triangle.edgeAC);
+    float apab = glm::dot(ap, triangle.edgeAB);
+    float apac = glm::dot(ap, triangle.edgeAC);
+    float denominator = abab * acac - abac * abac;
+
+    if (denominator == 0.0f) {
+        return offset;
+    }
+
+    float u = (acac * apab - abac * apac) / denominator;
+    float v = (abab * apac - abac * apab) / denominator;
+
+    int i = jlimit(0, subdivisions - 1,     (int) (u * (float) subdivisions));
+    int j = jlimit(0, subdivisions - 1 - i, (int) (v * (float) subdivisions));
+
+    // row i holds subdivisions - i cells
+    return offset + i * subdivisions - i * (i - 1) / 2 + j;
+}
+
+glm::ivec3 Raytracer::getVisibilityCacheKey(glm::vec3 receiverPosition)
+{
+    return glm::ivec3(glm::round(receiverPosition * 1000.0f));
+}
+
+/**
+ * Computes the visibility of all patches the sources lie on that are not cached yet for the receiver.
+ * Patches are resolved in the given order, so that batched occlusion queries start close to each other.
+ *
+ * @return The number of patches whose visibility had to be computed.
+ */
+int Raytracer::updateVisibilityCache(VisibilityCache& cache, glm::vec3 receiverPosition, const std::vector<SecondarySource>& sources, const std::vector<int>& order, bool batched)
+{
+    std::vector<int> pendingPatches;
+
+    for (int sourceNum : order) {
+        int patch = sources[(size_t) sourceNum].patch;
+
+        if (patch >= 0 && !cache.isComputed(patch)) {
+            cache.setComputed(patch);
+            pendingPatches.push_back(patch);
+        }
+    }
+
+    resolvePatchVisibility(cache, receiverPosition, pendingPatches, batched);
+
+    return (int) pendingPatches.size();
+}
+
+/**
+ * Computes the visibility of the patches from the receiver and stores it in the cache.
+ * The patches have to be marked as computed by the caller.
+ */
+void Raytracer::resolvePatchVisibility(VisibilityCache& cache, glm::vec3 receiverPosition, const std::vector<int>& pendingPatches, bool batched)
+{
+    for (size_t first = 0; first < pendingPatches.size(); first += RayPacket::size) {
+        size_t count = jmin((size_t) RayPacket::size, pendingPatches.size() - first);
+        bool visible[RayPacket::size];
+
+        if (batched && count == RayPacket::size) {
+            std::array<glm::vec3, RayPacket::size> positions;
+
+            for (size_t lane = 0; lane < count; lane++) {
+                positions[lane] = patches[(size_t) pendingPatches[first + lane]].center;
+            }
+
+            checkVisibility(positions, receiverPosition, visible);
+        } else {
+            for (size_t lane = 0; lane < count; lane++) {
+                visible[lane] = checkVisibility(patches[(size_t) pendingPatches[first + lane]].center, receiverPosition);
+            }
+        }
+
+        for (size_t lane = 0; lane < count; lane++) {
+            if (visible[lane]) {
+                cache.setVisible(pendingPatches[first + lane]);
+            }
+        }
+    }
+}
+
+/**
+ * Estimates the mixing time from the volume of the bounding box of the room, after which the
+ * reflection density is high enough for the response to be described statistically.
+ *
+ * @see Lindau, Kosanke, Weinzierl, Perceptual Evaluation of Model- and Signal-Based Predictors of the Mixing Time in Binaural Room Impulse Responses
+ */
+float Raytracer::getMixingTimeMS() const
+{
+    if (triangles.empty()) {
+        return 100.0f;
+    }
+
+    glm::vec3 minimum = triangles[0].pointA;
+    glm::vec3 maximum = triangles[0].pointA;
+
+    for (const auto& triangle : triangles) {
+        for (auto point : {triangle.pointA, triangle.pointB, triangle.pointC}) {
+            minimum = glm::min(minimum, point);
+            maximum = glm::max(maximum, point);
+        }
+    }
+
+    glm::vec3 size = maximum - minimum;
+    float volumeM3 = size.x * size.y * size.z;
+
+    // 95 % of listeners do not perceive a difference after this time
+    return 0.0117f * volumeM3 + 50.1f;
+}
+
+/**
+ * Replaces the energy portions after the transition time by an exponential decay per band. The decay rate is
+ * fitted by linear regression to the logarithm of the mean energy in 5 ms bins over the second half of the traced part.
+ * Bands without a usable fit fall back to the reverberation time by Sabine.
+ * One energy portion is generated per sample, until the slowest band has decayed by 60 dB.
+ */
+void Raytracer::extrapolateLateTail(const Object& microphone, float transitionTimeMS, float roomVolumeM3)
+{
+    auto& energyPortions = histograms.at(microphone.name);
+
+    // arrivals after the transition time are incomplete, as their rays have not been traced any further
+    energyPortions.erase(std::remove_if(energyPortions.begin(), energyPortions.end(), [transitionTimeMS] (const EnergyPortion& portion) {
+        return portion.delayMS >= transitionTimeMS;
+    }), energyPortions.end());
+
+    const float binWidthMS = 5.0f;
+    float const fitStartMS = 0.5f * transitionTimeMS;
+    int const numBins = jmax(1, (int) ((transitionTimeMS - fitStartMS) / binWidthMS));
+
+    std::vector<Band6Coefficients> binSums((size_t) numBins);
+    std::vector<int> binCounts((size_t) numBins, 0);
+
+    for (auto& binSum : binSums) {
+        binSum *= 0.0f;
+    }
+
+    for (const auto& portion : energyPortions) {
+        int bin = (int) ((portion.delayMS - fitStartMS) / binWidthMS);
+
+        if (portion.delayMS >= fitStartMS && bin < numBins) {
+            binSums[(size_t) bin] += portion.energyCoefficients;
+            binCounts[(size_t) bin]++;
+        }
+    }
+
+    // total absorption area per band, only needed if the fit fails
+    Band6Coefficients absorptionAreaM2;
+    absorptionAreaM2 *= 0.0f;
+
+    for (size_t triangleNum = 0; triangleNum < triangles.size(); triangleNum++) {
+        const auto& triangle = triangles[triangleNum];
+        float areaM2 = 0.5f * glm::length(glm::cross(triangle.pointB - triangle.pointA, triangle.pointC - triangle.pointA));
+
+        auto absorption = room.shapes[(size_t) triangleShapes[triangleNum]]->materialProperties.absorptionCoefficients;
+        absorption *= areaM2;
+        absorptionAreaM2 += absorption;
+    }
+
+    Band6Coefficients levels;
+    float decayRatesPerMS[6];
+    int numFittedBands = 0;
+
+    for (int band = 0; band < 6; band++) {
+        double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+        int numPoints = 0;
+
+        for (int bin = 0; bin < numBins; bin++) {
+            float meanEnergy = binCounts[(size_t) bin] > 0 ? binSums[(size_t) bin][band] / (float) binCounts[(size_t) bin] : 0.0f;
+
+            if (meanEnergy > 0.0f) {
+                double x = (double) fitStartMS + ((double) bin + 0.5) * binWidthMS;
+                double y = std::log((double) meanEnergy);
+
+                sumX += x;
+                sumY += y;
+                sumXX += x * x;
+                sumXY += x * y;
+                numPoints++;
+            }
+        }
+
+        double const denominator = numPoints * sumXX - sumX * sumX;
+        double const slope = numPoints >= 3 && denominator != 0.0 ? (numPoints * sumXY - sumX * sumY) / denominator : 0.0;
+
+        if (slope < 0.0) {
+            double intercept = (sumY - slope * sumX) / numPoints;
+
+            decayRatesPerMS[band] = (float) -slope;
+            levels[band] = (float) std::exp(intercept + slope * transitionTimeMS);
+            numFittedBands++;
+        } else {
+            // energy decays by 60 dB within the reverberation time
+            float reverberationTimeMS = 1000.0f * 0.161f * roomVolumeM3 / jmax(absorptionAreaM2[band], 0.001f);
+
+            decayRatesPerMS[band] = std::log(1.0e6f) / jmax(reverberationTimeMS, 1.0f);
+            levels[band] = numPoints > 0 ? (float) std::exp(sumY / numPoints) : 0.0f;
+        }
+    }
+
+    float const slowestDecayRatePerMS = *std::min_element(decayRatesPerMS, decayRatesPerMS + 6);
+    float const tailLengthMS = jmin(std::log(1.0e6f) / slowestDecayRatePerMS, 10000.0f);
+
+    double const sampleLengthMS = 1000.0 / audioProcessor.globalSampleRate;
+    auto const numTailSamples = (size_t) (tailLengthMS / sampleLengthMS);
+
+    energyPortions.reserve(energyPortions.size() + numTailSamples);
+
+    for (size_t sample = 0; sample < numTailSamples; sample++) {
+        float timeMS = (float) (((double) sample + 0.5) * sampleLengthMS);
+        Band6Coefficients energy;
+
+        for (int band = 0; band < 6; band++) {
+            energy[band] = levels[band] * std::exp(-decayRatesPerMS[band] * timeMS);
+        }
+
+        energyPortions.push_back({energy, transitionTimeMS + timeMS});
+    }
+
+    String reverberationTimes;
+
+    for (int band = 0; band < 6; band++) {
+        reverberationTimes << (band > 0 ? " / " : "") << String(std::log(1.0e6f) / decayRatesPerMS[band] / 1000.0f, 2);
+    }
+
+    addToRenderSummary("Extrapolated late tail for " + microphone.name + " after " + String(transitionTimeMS, 0) + " ms ("
+                       + String(numFittedBands) + " of 6 bands fitted), T60 " + reverberationTimes + " s");
+}
+
+/**
+ * @return A description of everything the traced rays and the radiosity solution depend on, except for the receivers.
+ */
+String Raytracer::getSceneSignature()
+{
+    String signature;
+
+    signature << (int) triangles.size() << ";" << parameters.state.getProperty("rays_per_source").toString()
+              << ";" << (int) (bool) parameters.state.getProperty("truncate_trace") << ";" << parameters.state.getProperty("transition_time_ms").toString()
+              << ";" << parameters.state.getProperty("patch_size_cm").toString()
+              << ";" << parameters.state.getProperty("radiosity_length_ms").toString()
+              << ";" << (int) (bool) parameters.state.getProperty("use_reservoir_sampling") << ";" << parameters.state.getProperty("secondary_source_memory_mb").toString();
+
+    for (const auto& shape : room.shapes) {
+        for (int band = 0; band < 6; band++) {
+            signature << ";" << shape->materialProperties.absorptionCoefficients[band];
+        }
+
+        signature << ";" << shape->materialProperties.roughness;
+    }
+
+    for (const auto& object : objects) {
+        if (object.type == Object::Type::SPEAKER && object.active) {
+            signature << ";" << object.name
+                      << ";" << object.position.x << "," << object.position.y << "," << object.position.z
+                      << ";" << object.rotation.x << "," << object.rotation.y << "," << object.rotation.z
+                      << ";" << (int) object.directivity.pattern << ";" << object.directivity.balloonFile;
+        }
+    }
+
+    return signature;
+}
+
+/**
+ * Computes the form factors between the patches if the geometry changed, injects the diffuse energy of the
+ * traced secondary sources and exchanges it between the patches.
+ *
+ * @return False if the user cancelled.
+ */
+bool Raytracer::solveRadiosity()
+{
+    auto const progress = [this] (double value) {
+        setProgress(value);
+        return !threadShouldExit();
+    };
+
+    if (!radiosity.hasFormFactors(radiosityBinWidthMS)) {
+        setStatusMessage("Computing form factors between " + String(patches.size()) + " patches...");
+
+        std::vector<AcousticRadiosity::Patch> radiosityPatches;
+        radiosityPatches.reserve(patches.size());
+
+        for (const auto& patch : patches) {
+            radiosityPatches.push_back({patch.center, patch.normal, patch.area});
+        }
+
+        auto formFactorsStartMS = Time::getMillisecondCounterHiRes();
+
+        auto const isVisible = [this] (glm::vec3 from, glm::vec3 to) {
+            return checkVisibility(from, to);
+        };
+
+        if (!radiosity.computeFormFactors(radiosityPatches, speedOfSoundMpS, radiosityBinWidthMS, isVisible, progress)) {
+            return false;
+        }
+
+        addToRenderSummary("Computed " + String(radiosity.getNumLinks()) + " form factors between " + String(patches.size()) + " patches in "
+                           + String((Time::getMillisecondCounterHiRes() - formFactorsStartMS) / 1000.0, 2) + " s");
+    }
+
+    setStatusMessage("Exchanging diffuse energy between patches...");
+
+    auto propagationStartMS = Time::getMillisecondCounterHiRes();
+
+    // limit the histograms to 256 MB
+    float const lengthMS = parameters.state.getProperty("radiosity_length_ms", 1500.0);
+    size_t const maxNumBins = (size_t) 64 * 1024 * 1024 / jmax((size_t) 1, patches.size() * 6);
+    int const numBins = (int) jmin((size_t) std::ceil(lengthMS / radiosityBinWidthMS), maxNumBins);
+
+    radiosity.reset(numBins);
+
+    forEachSecondarySource([this] (const SecondarySource& secondarySource) {
+        if (secondarySource.order > 0 && secondarySource.patch >= 0) {
+            radiosity.inject(secondarySource.patch, secondarySource.delayMS, secondarySource.energyCoefficients);
+        }
+    });
+
+    std::vector<Band6Coefficients> reflectances;
+    reflectances.reserve(patches.size());
+
+    for (const auto& patch : patches) {
+        reflectances.push_back(-room.shapes[(size_t) triangleShapes[(size_t) patch.triangle]]->materialProperties.absorptionCoefficients);
+    }
+
+    if (!radiosity.propagate(reflectances, progress)) {
+        return false;
+    }
+
+    addToRenderSummary("Exchanged diffuse energy over " + String((float) numBins * radiosityBinWidthMS / 1000.0f, 2) + " s in "
+                       + String((Time::getMillisecondCounterHiRes() - propagationStartMS) / 1000.0, 2) + " s");
 
     return true;
 }
 
+/**
+ * Adds the energy leaving every patch that can see the microphone to its histogram.
+ * Like secondary sources, the energy of a patch is weighted with the cosine between its normal and the microphone.
+ */
+void Raytracer::gatherRadiosity(const Object& microphone, VisibilityCache& cache, bool batched)
+{
+    if (radiosity.getNumPatches() != (int) patches.size()) {
+        return;
+    }
+
+    std::vector<int> pendingPatches;
+
+    for (int patch = 0; patch < (int) patches.size(); patch++) {
+        if (radiosity.hasEnergy(patch) && !cache.isComputed(patch)) {
+            cache.setComputed(patch);
+            pendingPatches.push_back(patch);
+        }
+    }
+
+    resolvePatchVisibility(cache, microphone.position, pendingPatches, batched);
+
+    auto& histogram = histograms.at(microphone.name);
+
+    for (int patchNum = 0; patchNum < (int) patches.size(); patchNum++) {
+        if (!radiosity.hasEnergy(patchNum) || !cache.isVisible(patchNum)) {
+            continue;
+        }
+
+        const auto& patch = patches[(size_t) patchNum];
+        glm::vec3 edgePM = microphone.position - patch.center;
+        float distanceM = glm::length(edgePM);
+
+        if (distanceM == 0.0f) {
+            continue;
+        }
+
+        float cosine = glm::dot(patch.normal, edgePM / distanceM);
+
+        if (cosine <= 0.0f) {
+            continue;
+        }
+
+        float const propagationDelayMS = distanceM / speedOfSoundMpS * 1000.0f;
+
+        for (int bin = 0; bin < radiosity.getNumBins(); bin++) {
+            auto energy = radiosity.getEnergy(patchNum, bin);
+
+            if (energy.getAverage() < AcousticRadiosity::minimumEnergy) {
+                continue;
+            }
+
+            energy *= cosine;
+            histogram.push_back({energy, ((float) bin + 0.5f) * radiosity.getBinWidthMS() + propagationDelayMS});
+        }
+    }
+}
+
+String Raytracer::getRenderSummary()
+{
+    const ScopedLock lock(renderSummaryMutex);
+    return renderSummary.joinIntoString("\n");
+}
+
+void Raytracer::addToRenderSummary(const String& line)
+{
+    {
+        const ScopedLock lock(renderSummaryMutex);
+        renderSummary.add(line);
+    }
+
+    sendChangeMessage();
+}
+
+/**
+ * Batched visibility check of several positions towards the same target. The occlusion rays are
+ * intersected together as one packet, which pays off when the positions lie close to each other.
+ */
+void Raytracer::checkVisibility(const std::array<glm::vec3, RayPacket::size>& positionsA, glm::vec3 positionB, bool (&visible)[RayPacket::size])
+{
+    RayPacket packet;
+
+    for (int lane = 0; lane < RayPacket::size; lane++) {
+        glm::vec3 edgeAB = positionB - positionsA[(size_t) lane];
+        glm::vec3 direction = glm::normalize(edgeAB);
+
+        packet.positionX[lane]  = positionsA[(size_t) lane].x;
+        packet.positionY[lane]  = positionsA[(size_t) lane].y;
+        packet.positionZ[lane]  = positionsA[(size_t) lane].z;
+        packet.directionX[lane] = direction.x;
+        packet.directionY[lane] = direction.y;
+        packet.directionZ[lane] = direction.z;
+        packet.distance[lane]   = glm::length(edgeAB);
+        packet.triangle[lane]   = -1;
+    }
+
+    numRaysCast += RayPacket::size;
+    intersectPacket(packet, packetTriangles);
+
+    for (int lane = 0; lane < RayPacket::size; lane++) {
+        // only hits closer than the target are registered
+        visible[lane] = packet.triangle[lane] < 0;
+    }
+}
+
 void Raytracer::saveObjects()
 {
     parameters.state.getOrCreateChildWithName("Objects", nullptr).removeAllChildren(nullptr);
@@ -600,6 +2104,19 @@ void Raytracer::saveObjects()
 
         objectTree.appendChild(positionTree, nullptr);
 
+        ValueTree rotationTree("Rotation");
+        rotationTree.setProperty("X", object.rotation.x, nullptr);
+        rotationTree.setProperty("Y", object.rotation.y, nullptr);
+        rotationTree.setProperty("Z", object.rotation.z, nullptr);
+
+        objectTree.appendChild(rotationTree, nullptr);
+
+        ValueTree directivityTree("Directivity");
+        directivityTree.setProperty("Pattern", object.directivity.pattern, nullptr);
+        directivityTree.setProperty("BalloonFile", object.directivity.balloonFile, nullptr);
+
+        objectTree.appendChild(directivityTree, nullptr);
+
         parameters.state.getOrCreateChildWithName("Objects", nullptr).appendChild(objectTree, nullptr);
     }
 }
@@ -622,6 +2139,22 @@ void Raytracer::restoreObjects()
         object.position.y = positionTree.getProperty("Y");
         object.position.z = positionTree.getProperty("Z");
 
+        auto rotationTree = childTree.getChildWithName("Rotation");
+
+        object.rotation.x = rotationTree.getProperty("X");
+        object.rotation.y = rotationTree.getProperty("Y");
+        object.rotation.z = rotationTree.getProperty("Z");
+        object.directivity.setRotation(object.rotation);
+
+        auto directivityTree = childTree.getChildWithName("Directivity");
+
+        object.directivity.pattern = static_cast<Directivity::Pattern>((int) directivityTree.getProperty("Pattern"));
+        object.directivity.balloonFile = directivityTree.getProperty("BalloonFile");
+
+        if (object.directivity.balloonFile.isNotEmpty()) {
+            object.directivity.loadBalloon(File(object.directivity.balloonFile));
+        }
+
         objects.push_back(object);
     }
 }
@@ -676,3 +2209,355 @@ std::vector<glm::ivec3> Raytracer::findNeighbors(glm::ivec3 cube)
 
     return neighbors;
 }
+
+/**
+ * Derives the main axis and the up vector of the directivity pattern from the object rotation.
+ * Unrotated objects radiate along the X axis with Z pointing up.
+ */
+void Raytracer::Directivity::setRotation(glm::vec3 rotationDegrees)
+{
+    glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(rotationDegrees.z), glm::vec3{0.0f, 0.0f, 1.0f})
+                             * glm::rotate(glm::mat4(1.0f), glm::radians(rotationDegrees.y), glm::vec3{0.0f, 1.0f, 0.0f})
+                             * glm::rotate(glm::mat4(1.0f), glm::radians(rotationDegrees.x), glm::vec3{1.0f, 0.0f, 0.0f});
+
+    orientation = glm::normalize(glm::vec3(rotationMatrix * glm::vec4{1.0f, 0.0f, 0.0f, 0.0f}));
+    up          = glm::normalize(glm::vec3(rotationMatrix * glm::vec4{0.0f, 0.0f, 1.0f, 0.0f}));
+}
+
+/**
+ * Loads balloon data from a text file with one measurement per line:
+ * @code
+ * azimuth elevation level                          // broadband level in dB
+ * azimuth elevation level125 level250 ... level4k  // one level in dB per band
+ * @endcode
+ * Angles are given in degrees relative to the main axis, lines starting with # are ignored.
+ * The measurements are resampled to the internal grid by nearest neighbour lookup.
+ */
+Result Raytracer::Directivity::loadBalloon(const File& file)
+{
+    if (!file.existsAsFile()) {
+        return Result::fail("Balloon file " + file.getFullPathName() + " does not exist.");
+    }
+
+    StringArray lines;
+    file.readLines(lines);
+
+    std::vector<glm::vec3> sampleDirections;
+    std::vector<Band6Coefficients> sampleGains;
+
+    for (const auto& rawLine : lines) {
+        auto line = rawLine.upToFirstOccurrenceOf("#", false, false).trim();
+
+        if (line.isEmpty())
+            continue;
+
+        auto tokens = StringArray::fromTokens(line, " \t,;", "");
+        tokens.removeEmptyStrings();
+
+        if (tokens.size() != 3 && tokens.size() != 8) {
+            return Result::fail("Malformed line in balloon file: " + line);
+        }
+
+        float azimuth   = glm::radians(tokens[0].getFloatValue());
+        float elevation = glm::radians(tokens[1].getFloatValue());
+
+        sampleDirections.push_back({cos(elevation) * cos(azimuth), cos(elevation) * sin(azimuth), sin(elevation)});
+
+        Band6Coefficients gain;
+        for (int band = 0; band < 6; band++) {
+            float levelDB = tokens[tokens.size() == 3 ? 2 : 2 + band].getFloatValue();
+            gain[band] = pow(10.0f, levelDB / 10.0f);
+        }
+
+        sampleGains.push_back(gain);
+    }
+
+    if (sampleDirections.empty()) {
+        return Result::fail("Balloon file " + file.getFullPathName() + " contains no measurements.");
+    }
+
+    std::vector<Band6Coefficients> resampledBalloon((size_t) (balloonAzimuthSteps * balloonElevationSteps));
+
+    for (int elevationStep = 0; elevationStep < balloonElevationSteps; elevationStep++) {
+        for (int azimuthStep = 0; azimuthStep < balloonAzimuthSteps; azimuthStep++) {
+            float azimuth   = glm::radians(360.0f * (float) azimuthStep / (float) balloonAzimuthSteps);
+            float elevation = glm::radians(180.0f * (float) elevationStep / (float) (balloonElevationSteps - 1) - 90.0f);
+
+            glm::vec3 gridDirection = {cos(elevation) * cos(azimuth), cos(elevation) * sin(azimuth), sin(elevation)};
+
+            size_t nearest = 0;
+            float nearestDot = -2.0f;
+            for (size_t sample = 0; sample < sampleDirections.size(); sample++) {
+                float sampleDot = glm::dot(gridDirection, sampleDirections[sample]);
+                if (sampleDot > nearestDot) {
+                    nearestDot = sampleDot;
+                    nearest = sample;
+                }
+            }
+
+            resampledBalloon[(size_t) (elevationStep * balloonAzimuthSteps + azimuthStep)] = sampleGains[nearest];
+        }
+    }
+
+    balloon = std::move(resampledBalloon);
+    balloonFile = file.getFullPathName();
+
+    return Result::ok();
+}
+
+/**
+ * @return The energy gain per band in the given direction relative to the main axis of the pattern.
+ */
+Band6Coefficients Raytracer::Directivity::getGain(glm::vec3 direction) const
+{
+    Band6Coefficients gain;
+
+    if (pattern == OMNIDIRECTIONAL || glm::length(direction) == 0.0f) {
+        return gain;
+    }
+
+    direction = glm::normalize(direction);
+    float cosTheta = glm::dot(direction, orientation);
+
+    // first order patterns are a weighted sum of an omnidirectional and a figure-of-eight portion
+    float omnidirectionalPortion = 1.0f;
+
+    switch (pattern) {
+        case SUBCARDIOID:   omnidirectionalPortion = 0.70f;  break;
+        case CARDIOID:      omnidirectionalPortion = 0.50f;  break;
+        case SUPERCARDIOID: omnidirectionalPortion = 0.366f; break;
+        case HYPERCARDIOID: omnidirectionalPortion = 0.25f;  break;
+        case BALLOON: {
+            glm::vec3 side = glm::cross(up, orientation);
+            return getBalloonGain({cosTheta, glm::dot(direction, side), glm::dot(direction, up)});
+        }
+        case OMNIDIRECTIONAL:
+        default:
+            break;
+    }
+
+    // the pattern describes sound pressure, the rays carry energy
+    float pressure = omnidirectionalPortion + (1.0f - omnidirectionalPortion) * cosTheta;
+    gain *= pressure * pressure;
+
+    return gain;
+}
+
+Band6Coefficients Raytracer::Directivity::getBalloonGain(glm::vec3 localDirection) const
+{
+    if (balloon.empty()) {
+        return {};
+    }
+
+    float azimuthDeg = glm::degrees(atan2(localDirection.y, localDirection.x));
+    if (azimuthDeg < 0.0f) azimuthDeg += 360.0f;
+    float elevationDeg = glm::degrees(asin(glm::clamp(localDirection.z, -1.0f, 1.0f)));
+
+    // bilinear interpolation between the neighboring grid points
+    float azimuthIndex   = azimuthDeg / (360.0f / (float) balloonAzimuthSteps);
+    float elevationIndex = (elevationDeg + 90.0f) / (180.0f / (float) (balloonElevationSteps - 1));
+
+    int   azimuth0   = (int) floor(azimuthIndex) % balloonAzimuthSteps;
+    int   azimuth1   = (azimuth0 + 1) % balloonAzimuthSteps;
+    float azimuthFraction = azimuthIndex - floor(azimuthIndex);
+
+    int   elevation0 = jlimit(0, balloonElevationSteps - 1, (int) floor(elevationIndex));
+    int   elevation1 = jmin(elevation0 + 1, balloonElevationSteps - 1);
+    float elevationFraction = elevationIndex - floor(elevationIndex);
+
+    const auto& gain00 = balloon[(size_t) (elevation0 * balloonAzimuthSteps + azimuth0)];
+    const auto& gain01 = balloon[(size_t) (elevation0 * balloonAzimuthSteps + azimuth1)];
+    const auto& gain10 = balloon[(size_t) (elevation1 * balloonAzimuthSteps + azimuth0)];
+    const auto& gain11 = balloon[(size_t) (elevation1 * balloonAzimuthSteps + azimuth1)];
+
+    Band6Coefficients gain;
+    for (int band = 0; band < 6; band++) {
+        gain[band] = (1.0f - elevationFraction) * ((1.0f - azimuthFraction) * gain00[band] + azimuthFraction * gain01[band])
+                   +         elevationFraction  * ((1.0f - azimuthFraction) * gain10[band] + azimuthFraction * gain11[band]);
+    }
+
+    return gain;
+}
+
+/**
+ * Builds the emission table that is used to draw ray directions proportionally to the band averaged pattern.
+ * A small uniform portion is mixed in, so that directions that only carry energy off the bin centres are still sampled.
+ */
+void Raytracer::Directivity::prepareSampling()
+{
+    binProbabilities.clear();
+    cumulativeProbabilities.clear();
+
+    if (pattern == OMNIDIRECTIONAL) {
+        return;
+    }
+
+    const int numBins = samplingCosSteps * samplingPhiSteps;
+    binProbabilities.resize((size_t) numBins);
+
+    float totalGain = 0.0f;
+    for (int cosStep = 0; cosStep < samplingCosSteps; cosStep++) {
+        for (int phiStep = 0; phiStep < samplingPhiSteps; phiStep++) {
+            float cosTheta = -1.0f + 2.0f * ((float) cosStep + 0.5f) / (float) samplingCosSteps;
+            float phi = 2.0f * glm::pi<float>() * ((float) phiStep + 0.5f) / (float) samplingPhiSteps;
+
+            float gain = getGain(toWorld(cosTheta, phi)).getAverage();
+            binProbabilities[(size_t) (cosStep * samplingPhiSteps + phiStep)] = gain;
+            totalGain += gain;
+        }
+    }
+
+    float uniformPortion = totalGain > 0.0f ? 0.1f : 1.0f;
+    float cumulativeProbability = 0.0f;
+
+    for (auto& probability : binProbabilities) {
+        probability = (totalGain > 0.0f ? (1.0f - uniformPortion) * probability / totalGain : 0.0f) + uniformPortion / (float) numBins;
+        cumulativeProbability += probability;
+        cumulativeProbabilities.push_back(cumulativeProbability);
+    }
+
+    cumulativeProbabilities.back() = 1.0f;
+}
+
+/**
+ * Draws a direction from the emission table.
+ *
+ * @param weight    Receives the energy the ray has to carry per band. Every bin covers the same solid angle,
+ *                  so the weight is the pattern gain divided by the probability density relative to uniform emission.
+ */
+glm::vec3 Raytracer::Directivity::sampleDirection(juce::Random& random, Band6Coefficients& weight) const
+{
+    jassert(!cumulativeProbabilities.empty());
+
+    const int numBins = samplingCosSteps * samplingPhiSteps;
+
+    int bin = (int) (std::upper_bound(cumulativeProbabilities.begin(), cumulativeProbabilities.end(), random.nextFloat()) - cumulativeProbabilities.begin());
+    bin = jmin(bin, numBins - 1);
+
+    int cosStep = bin / samplingPhiSteps;
+    int phiStep = bin % samplingPhiSteps;
+
+    float cosTheta = -1.0f + 2.0f * ((float) cosStep + random.nextFloat()) / (float) samplingCosSteps;
+    float phi = 2.0f * glm::pi<float>() * ((float) phiStep + random.nextFloat()) / (float) samplingPhiSteps;
+
+    glm::vec3 direction = toWorld(cosTheta, phi);
+
+    weight = getGain(direction);
+    weight *= 1.0f / (binProbabilities[(size_t) bin] * (float) numBins);
+
+    return direction;
+}
+
+glm::vec3 Raytracer::Directivity::toWorld(float cosTheta, float phi) const
+{
+    glm::vec3 side = glm::cross(up, orientation);
+    float sinTheta = sqrt(jmax(0.0f, 1.0f - cosTheta * cosTheta));
+
+    return glm::normalize(cosTheta * orientation + sinTheta * (cos(phi) * side + sin(phi) * up));
+}
+
+void Raytracer::SecondarySourceCodec::setBounds(glm::vec3 newMinimum, glm::vec3 newMaximum)
+{
+    // leave some room for hit points that are slightly off the surface
+    glm::vec3 margin = 0.01f * (newMaximum - newMinimum) + 0.01f;
+
+    minimum = newMinimum - margin;
+    extent = newMaximum - newMinimum + 2.0f * margin;
+}
+
+/**
+ * Positions are quantized to 16 bit per axis, the normal to 12 bit per component of its octahedral encoding.
+ * Band energies are stored logarithmically in steps of 0.75 dB from -150 dB to +40.5 dB.
+ */
+Raytracer::CompactSecondarySource Raytracer::SecondarySourceCodec::encode(const SecondarySource& source) const
+{
+    CompactSecondarySource compact;
+
+    for (int axis = 0; axis < 3; axis++) {
+        float relative = extent[axis] > 0.0f ? (source.position[axis] - minimum[axis]) / extent[axis] : 0.0f;
+        compact.position[axis] = (juce::uint16) std::lround(jlimit(0.0f, 1.0f, relative) * 65535.0f);
+    }
+
+    for (int band = 0; band < 6; band++) {
+        compact.energy[band] = encodeEnergy(source.energyCoefficients[band]);
+    }
+
+    glm::vec2 normal = RaytracerUtils::octahedralEncode(source.normal);
+    auto normalX = (juce::uint32) std::lround(jlimit(0.0f, 1.0f, normal.x * 0.5f + 0.5f) * 4095.0f);
+    auto normalY = (juce::uint32) std::lround(jlimit(0.0f, 1.0f, normal.y * 0.5f + 0.5f) * 4095.0f);
+    auto scatter = (juce::uint32) std::lround(jlimit(0.0f, 1.0f, source.scatterCoefficient) * 255.0f);
+    compact.normalAndScatter = normalX | (normalY << 12) | (scatter << 24);
+
+    // patches that do not fit into 24 bit are treated as if there was no patch
+    auto order = (juce::uint32) jlimit(0, 255, source.order);
+    auto patch = source.patch >= 0 && source.patch < 0xffffff ? (juce::uint32) (source.patch + 1) : 0u;
+    compact.orderAndPatch = order | (patch << 8);
+
+    compact.delayMS = source.delayMS;
+
+    return compact;
+}
+
+Raytracer::SecondarySource Raytracer::SecondarySourceCodec::decode(const CompactSecondarySource& compact) const
+{
+    SecondarySource source;
+
+    for (int axis = 0; axis < 3; axis++) {
+        source.position[axis] = minimum[axis] + (float) compact.position[axis] / 65535.0f * extent[axis];
+    }
+
+    for (int band = 0; band < 6; band++) {
+        source.energyCoefficients[band] = decodeEnergy(compact.energy[band]);
+    }
+
+    source.scatterCoefficient = (float) (compact.normalAndScatter >> 24) / 255.0f;
+    source.order = (int) (compact.orderAndPatch & 0xff);
+
+    // the direct sound does not lie on a surface, so it has no normal
+    if (source.order > 0) {
+        glm::vec2 normal = {(float) (compact.normalAndScatter & 0xfff) / 4095.0f * 2.0f - 1.0f,
+                            (float) ((compact.normalAndScatter >> 12) & 0xfff) / 4095.0f * 2.0f - 1.0f};
+        source.normal = RaytracerUtils::octahedralDecode(normal);
+
+        // rounding can move the point up to half a step per axis behind its surface, where it would be occluded by it,
+        // so it is moved in front of the surface by more than that
+        source.position += glm::length(extent) / 65535.0f * source.normal;
+    } else {
+        source.normal = glm::vec3(0.0f);
+    }
+
+    source.patch = (int) (compact.orderAndPatch >> 8) - 1;
+    source.delayMS = compact.delayMS;
+
+    return source;
+}
+
+juce::uint8 Raytracer::SecondarySourceCodec::encodeEnergy(float energy)
+{
+    if (energy <= 0.0f) {
+        return 0;
+    }
+
+    float code = (10.0f * std::log10(energy) + 150.0f) / 0.75f + 1.0f;
+
+    if (code < 1.0f) {
+        return 0;
+    }
+
+    return (juce::uint8) jmin(255L, std::lround(code));
+}
+
+float Raytracer::SecondarySourceCodec::decodeEnergy(juce::uint8 code)
+{
+    static const auto table = [] {
+        std::array<float, 256> energies {};
+
+        for (int index = 1; index < 256; index++) {
+            energies[(size_t) index] = std::pow(10.0f, (-150.0f + (float) (index - 1) * 0.75f) / 10.0f);
+        }
+
+        return energies;
+    }();
+
+    return table[code];
+}
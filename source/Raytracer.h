@@ -1,9 +1,13 @@
 # pragma once
 
+#include "AcousticRadiosity.h"
 #include "CustomDatatypes.h"
 #include "ImpulseResponseComponent.h"
 #include "JuceHeader.h"
+#include "OutOfCoreArray.h"
 #include "PluginProcessor.h"
+#include "RayPathRing.h"
+#include "RaytracerUtility.h"
 #include "WavefrontObjParser.h"
 #include "glm/ext.hpp"
 #include "glm/glm.hpp"
@@ -20,6 +24,7 @@ public:
         glm::vec3 hitPoint;
         glm::vec3 normal;
         MaterialProperties materialProperties;
+        int triangle = -1;
     };
 
     struct SecondarySource {
@@ -29,11 +34,39 @@ public:
         float scatterCoefficient;
         Band6Coefficients energyCoefficients;
         float delayMS = 0.0f;
+        int patch = -1;
+        int numMembers = 1;                 // secondary sources a cluster stands in for, not stored in compact form
+    };
+
+    // quantized secondary source that takes up 24 instead of 60 bytes
+    struct CompactSecondarySource {
+        juce::uint16 position[3];           // fixed point relative to the scene bounds
+        juce::uint8  energy[6];             // 0 for no energy, otherwise -150 dB + (code - 1) * 0.75 dB
+        juce::uint32 normalAndScatter;      // 12 bit octahedral x, 12 bit octahedral y, 8 bit scatter coefficient
+        juce::uint32 orderAndPatch;         // 8 bit order, 24 bit patch + 1
+        float        delayMS;
+    };
+
+    static_assert(sizeof(CompactSecondarySource) == 24, "CompactSecondarySource is expected to be tightly packed");
+
+    struct SecondarySourceCodec {
+        glm::vec3 minimum = {-100.0f, -100.0f, -100.0f};
+        glm::vec3 extent = {200.0f, 200.0f, 200.0f};
+
+        void setBounds(glm::vec3 newMinimum, glm::vec3 newMaximum);
+
+        CompactSecondarySource encode(const SecondarySource& source) const;
+        SecondarySource decode(const CompactSecondarySource& compact) const;
+
+    private:
+        static juce::uint8 encodeEnergy(float energy);
+        static float decodeEnergy(juce::uint8 code);
     };
 
     struct EnergyPortion {
         Band6Coefficients energyCoefficients;
         float delayMS = 0.0f;
+        int numMembers = 1;                 // generation averages the portions of a sample by their members
 
         static bool byTotalEnergy (EnergyPortion a, EnergyPortion b)
         {
@@ -58,11 +91,41 @@ public:
 
     struct Directivity {
         enum Pattern {
-            OMNIDIRECTIONAL
+            OMNIDIRECTIONAL,
+            SUBCARDIOID,
+            CARDIOID,
+            SUPERCARDIOID,
+            HYPERCARDIOID,
+            BALLOON
         };
 
         Pattern pattern = OMNIDIRECTIONAL;
-        glm::vec3 orientation;
+        glm::vec3 orientation = {1.0f, 0.0f, 0.0f};
+        glm::vec3 up = {0.0f, 0.0f, 1.0f};
+
+        // tabulated energy gains on a regular azimuth/elevation grid, only used by the BALLOON pattern
+        static constexpr int balloonAzimuthSteps = 72;
+        static constexpr int balloonElevationSteps = 37;
+        String balloonFile;
+        std::vector<Band6Coefficients> balloon;
+
+        void setRotation(glm::vec3 rotationDegrees);
+        Result loadBalloon(const File& file);
+
+        Band6Coefficients getGain(glm::vec3 direction) const;
+
+        void prepareSampling();
+        glm::vec3 sampleDirection(juce::Random& random, Band6Coefficients& weight) const;
+
+    private:
+        // equal-area emission table: bins are uniform in cos(theta) and phi around the orientation axis
+        static constexpr int samplingCosSteps = 32;
+        static constexpr int samplingPhiSteps = 64;
+        std::vector<float> binProbabilities;
+        std::vector<float> cumulativeProbabilities;
+
+        glm::vec3 toWorld(float cosTheta, float phi) const;
+        Band6Coefficients getBalloonGain(glm::vec3 localDirection) const;
     };
 
     struct Object {
@@ -75,6 +138,8 @@ public:
         Type type;
         bool active = false;
         glm::vec3 position = {0.0f, 0.0f, 0.0f};
+        glm::vec3 rotation = {0.0f, 0.0f, 0.0f};
+        Directivity directivity;
     };
 
     int raysPerSource = 1000;
@@ -92,35 +157,79 @@ public:
         glm::vec3 normal;
     };
 
+    // triangle with precomputed edges, as read by the packet intersection
+    struct PacketTriangle {
+        glm::vec3 pointA, edgeAB, edgeAC, normal;
+
+        static PacketTriangle fromTriangle(const Triangle& triangle);
+    };
+
+    // rays with neighboring directions that are intersected with the geometry together,
+    // stored as structure of arrays so that the lanes map onto SIMD registers
+    struct RayPacket {
+        static constexpr int size = 8;
+
+        alignas(32) float positionX[size], positionY[size], positionZ[size];
+        alignas(32) float directionX[size], directionY[size], directionZ[size];
+        alignas(32) float distance[size];
+        alignas(32) int   triangle[size];
+    };
+
     void run() override;
     void setRoom(const File& objFile);
     void clear();
     void saveObjects();
     void restoreObjects();
+    String getRenderSummary();
+
+    // intersection with a triangle list, without materials, also used by the RaytracerBenchmark
+    static Hit intersect(Ray ray, const std::vector<Triangle>& sceneTriangles);
+    static void intersectPacket(RayPacket& packet, const std::vector<PacketTriangle>& sceneTriangles);
 
     std::vector<Object> objects;
     std::map<String, std::vector<EnergyPortion>> histograms;
 
     std::vector<EnergyPortion> extractHistogramSlice(double startTimeMS, double endTimeMS, const std::vector<EnergyPortion>& energyPortions)
     {
-        // energyPortions has to be sorted byDelay
+        // energyPortions has to be sorted byDelay, so the start of the slice can be found by binary search
 
         std::vector<EnergyPortion> result;
 
-        for (auto& energyPortion : energyPortions) {
-            if (endTimeMS < energyPortion.delayMS) {
-                break;
-            }
+        auto energyPortion = std::upper_bound(energyPortions.begin(), energyPortions.end(), startTimeMS, [] (double timeMS, const EnergyPortion& portion) {
+            return timeMS < portion.delayMS;
+        });
 
-            if (startTimeMS < energyPortion.delayMS && energyPortion.delayMS < endTimeMS) {
-                result.push_back(energyPortion);
-            }
+        for (; energyPortion != energyPortions.end() && energyPortion->delayMS < endTimeMS; energyPortion++) {
+            result.push_back(*energyPortion);
         }
 
         return result;
     }
 
-    std::vector<SecondarySource> secondarySources;
+    // can grow beyond the available memory, so it is stored quantized, spilled to disk and has to be read chunk by chunk
+    OutOfCoreArray<CompactSecondarySource> secondarySources;
+    SecondarySourceCodec secondarySourceCodec;
+
+    SecondarySource getSecondarySource(size_t index) const
+    {
+        return secondarySourceCodec.decode(secondarySources[index]);
+    }
+
+    template <typename Function>
+    void forEachSecondarySource(Function&& function) const
+    {
+        secondarySources.forEach([this, &function] (const CompactSecondarySource& compact) {
+            function(secondarySourceCodec.decode(compact));
+        });
+    }
+
+    template <typename Function>
+    void forEachSecondarySourceInRange(size_t first, size_t last, Function&& function) const
+    {
+        secondarySources.forEachInRange(first, last, [this, &function] (size_t index, const CompactSecondarySource& compact) {
+            function(index, secondarySourceCodec.decode(compact));
+        });
+    }
 
     struct Hash {
         static unsigned cantor(unsigned int a, unsigned int b) {
@@ -145,6 +254,9 @@ public:
     std::unordered_set<glm::ivec3, Hash> cubes;
     int cubeSizeCM = 100;
 
+    // polylines of a sample of the traced rays, only recorded while the visualizer shows them
+    RayPathRing rayPaths;
+
 private:
 
     RaumsimulationAudioProcessor& audioProcessor;
@@ -160,9 +272,122 @@ private:
     float flood(glm::ivec3 startPoint);
     std::vector<glm::ivec3> findNeighbors(glm::ivec3 cube);
 
-    void trace(Ray ray);
+    std::vector<Object> speakers;
+
+    // flattened room geometry, rebuilt whenever the room is loaded
+    std::vector<Triangle> triangles;
+    std::vector<PacketTriangle> packetTriangles;
+    std::vector<int> triangleShapes;
+
+    // surfaces subdivided into patches of roughly equal size, whose visibility from a receiver is cached
+    struct Patch {
+        glm::vec3 center;
+        glm::vec3 normal;
+        float area;
+        int triangle;
+    };
+
+    struct VisibilityCache {
+        std::vector<juce::uint64> computed;
+        std::vector<juce::uint64> visible;
+
+        bool isComputed(int patch) const { return (computed[(size_t) patch / 64] >> ((size_t) patch % 64)) & 1; }
+        bool isVisible(int patch) const  { return (visible[(size_t) patch / 64] >> ((size_t) patch % 64)) & 1; }
+        void setComputed(int patch)      { computed[(size_t) patch / 64] |= (juce::uint64) 1 << ((size_t) patch % 64); }
+        void setVisible(int patch)       { visible[(size_t) patch / 64] |= (juce::uint64) 1 << ((size_t) patch % 64); }
+    };
+
+    std::vector<Patch> patches;
+    std::vector<int> trianglePatchOffsets;
+    std::vector<int> triangleSubdivisions;
+    float patchSizeM = 0.0f;
+
+    // keyed by the receiver position in millimeters, so a moved receiver starts with an empty cache
+    std::unordered_map<glm::ivec3, VisibilityCache, Hash> visibilityCaches;
+
+    // diffuse energy exchange between the patches, replaces the diffuse part of the traced rays when enabled
+    AcousticRadiosity radiosity;
+    static constexpr float radiosityBinWidthMS = 4.0f;
+    String solvedSceneSignature;
+
+    // rays are only followed up to this delay, the rest of the energy envelope is extrapolated
+    float maxTraceDelayMS = std::numeric_limits<float>::max();
+
+    // weighted reservoir sampling of the recorded secondary sources, keeps the memory below the budget
+    bool useReservoirSampling = false;
+    size_t reservoirCapacity = 0;
+    std::vector<std::pair<float, juce::uint32>> reservoirHeap;
+    std::vector<Band6Coefficients> offeredEnergyPerBucket;
+    juce::int64 numOfferedSecondarySources = 0;
+    static constexpr float reservoirBucketMS = 5.0f;
+    juce::uint32 lastReservoirRewriteMS = 0;
+    static constexpr juce::uint32 reservoirRewriteIntervalMS = 1000;
+
+    bool recordRayPaths = false;
+    int rayPathInterval = 1;
+    static constexpr int rayPathsPerSource = 256;
+
+    static constexpr float packetCoherenceCosine = 0.8f;
+    juce::int64 numRaysCast = 0;
+
+    CriticalSection renderSummaryMutex;
+    StringArray renderSummary;
+    void addToRenderSummary(const String& line);
+
+    void trace(Ray ray, SecondarySource secondarySource, RayPathRing::Path* rayPath = nullptr);
+    void tracePackets(std::vector<Ray>& rays, std::vector<SecondarySource>& secondarySourceStates, double progressStart, double progressEnd);
+    bool reflectRay(Ray& ray, SecondarySource& secondarySource, const Hit& hit);
     Hit calculateBounce(Ray ray);
+    Hit getTriangleHit(Ray ray, int triangleNum, float distance) const;
     bool checkVisibility(glm::vec3 positionA, glm::vec3 positionB);
+    void checkVisibility(const std::array<glm::vec3, RayPacket::size>& positionsA, glm::vec3 positionB, bool (&visible)[RayPacket::size]);
+    void addContribution(const Object& microphone, SecondarySource secondarySource);
+    EnergyPortion getContribution(const Object& microphone, SecondarySource secondarySource) const;
+
+    void recordSecondarySource(const SecondarySource& secondarySource);
+    void finishReservoirSampling();
+
+    void buildPatches(float sizeM);
+    int getPatch(int triangleNum, glm::vec3 point) const;
+    static glm::ivec3 getVisibilityCacheKey(glm::vec3 receiverPosition);
+    int updateVisibilityCache(VisibilityCache& cache, glm::vec3 receiverPosition, const std::vector<SecondarySource>& sources, const std::vector<int>& order, bool batched);
+    void resolvePatchVisibility(VisibilityCache& cache, glm::vec3 receiverPosition, const std::vector<int>& pendingPatches, bool batched);
+
+    float getMixingTimeMS() const;
+    void extrapolateLateTail(const Object& microphone, float transitionTimeMS, float roomVolumeM3);
+
+    String getSceneSignature();
+    bool solveRadiosity();
+    void gatherRadiosity(const Object& microphone, VisibilityCache& cache, bool batched);
+
+    static std::vector<int> getMortonOrder(const std::vector<SecondarySource>& sources);
+
+    struct ClusterKey {
+        glm::ivec3 cell;
+        int delayBin;
+        int normalAxis;
+
+        bool operator==(const ClusterKey& other) const
+        {
+            return cell == other.cell && delayBin == other.delayBin && normalAxis == other.normalAxis;
+        }
+
+        struct Hasher {
+            size_t operator()(const ClusterKey& key) const
+            {
+                auto hash = (size_t) Hash()(key.cell);
+                hash = hash * 31 + (size_t) Hash::mirror(key.delayBin);
+                hash = hash * 31 + (size_t) key.normalAxis;
+                return hash;
+            }
+        };
+    };
+
+    std::vector<SecondarySource> clusterSecondarySources(const std::function<bool(const SecondarySource&)>& include, float toleranceM, float toleranceMS);
+    void reportClusteringError(const Object& microphone, const std::function<bool(const SecondarySource&)>& include, const std::vector<SecondarySource>& clusters);
+    static constexpr float clusteringErrorBinMS = 1.0f;
+    int gatherSources(const Object& microphone, const std::vector<SecondarySource>& sources, VisibilityCache* visibilityCache, bool batched);
 
     static Hit collisionTriangle(Ray ray, Triangle triangle);
+    static bool isCoherent(const std::vector<Ray>& rays, const std::vector<std::pair<juce::uint32, int>>& sortedRays, size_t first, size_t count);
 };
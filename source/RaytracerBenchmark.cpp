@@ -0,0 +1,204 @@
+#include "RaytracerBenchmark.h"
+#include "Raytracer.h"
+
+namespace
+{
+    struct Scene {
+        juce::String name;
+        std::vector<Raytracer::Triangle> triangles;
+    };
+
+    Scene loadModel(const juce::String& name, const char* data, int size)
+    {
+        WavefrontObjFile model;
+        model.load(juce::String::createStringFromData(data, size));
+
+        Scene scene{name, {}};
+
+        for (const auto* shape : model.shapes) {
+            const auto& mesh = shape->mesh;
+
+            for (size_t index = 0; index + 2 < mesh.indices.size(); index += 3) {
+                scene.triangles.push_back({mesh.vertices[mesh.indices[index + 0]],
+                                           mesh.vertices[mesh.indices[index + 1]],
+                                           mesh.vertices[mesh.indices[index + 2]],
+                                           mesh.normals[mesh.indices[index]]});
+            }
+        }
+
+        return scene;
+    }
+
+    /**
+     * A 10 x 8 x 4 m room, every wall is split into a grid of equal triangles facing inwards.
+     */
+    Scene createSyntheticRoom(int minimumTriangles)
+    {
+        auto const gridSize = (int) std::ceil(std::sqrt(minimumTriangles / 12.0));
+        glm::vec3 const size = {10.0f, 8.0f, 4.0f};
+
+        Scene scene{"Synthetic room", {}};
+        scene.triangles.reserve((size_t) (12 * gridSize * gridSize));
+
+        for (int axis = 0; axis < 3; axis++) {
+            for (int side = 0; side < 2; side++) {
+                auto const axisU = (axis + 1) % 3;
+                auto const axisV = (axis + 2) % 3;
+
+                glm::vec3 normal = {0.0f, 0.0f, 0.0f};
+                normal[axis] = side == 0 ? 1.0f : -1.0f;
+
+                auto const corner = [&] (int u, int v) {
+                    glm::vec3 point;
+                    point[axis] = side == 0 ? 0.0f : size[axis];
+                    point[axisU] = size[axisU] * (float) u / (float) gridSize;
+                    point[axisV] = size[axisV] * (float) v / (float) gridSize;
+                    return point;
+                };
+
+                for (int u = 0; u < gridSize; u++) {
+                    for (int v = 0; v < gridSize; v++) {
+                        scene.triangles.push_back({corner(u, v), corner(u + 1, v), corner(u + 1, v + 1), normal});
+                        scene.triangles.push_back({corner(u, v), corner(u + 1, v + 1), corner(u, v + 1), normal});
+                    }
+                }
+            }
+        }
+
+        return scene;
+    }
+
+    /**
+     * Uniformly distributed directions from the center of the scene, sorted so that neighboring directions follow each other.
+     */
+    std::vector<Raytracer::Ray> createPrimaryRays(const Scene& scene, int count, juce::Random& random)
+    {
+        glm::vec3 minimum = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 maximum = glm::vec3(std::numeric_limits<float>::lowest());
+
+        for (const auto& triangle : scene.triangles) {
+            minimum = glm::min(minimum, glm::min(triangle.pointA, glm::min(triangle.pointB, triangle.pointC)));
+            maximum = glm::max(maximum, glm::max(triangle.pointA, glm::max(triangle.pointB, triangle.pointC)));
+        }
+
+        glm::vec3 const center = 0.5f * (minimum + maximum);
+        std::vector<std::pair<juce::uint32, glm::vec3>> directions;
+
+        for (int rayNum = 0; rayNum < count; rayNum++) {
+            auto const z = random.nextFloat() * 2.0f - 1.0f;
+            auto const phi = random.nextFloat() * juce::MathConstants<float>::twoPi;
+            auto const radius = std::sqrt(1.0f - z * z);
+
+            glm::vec3 const direction = {radius * std::cos(phi), radius * std::sin(phi), z};
+            directions.emplace_back(RaytracerUtils::directionKey(direction), direction);
+        }
+
+        std::sort(directions.begin(), directions.end(), [] (const auto& a, const auto& b) { return a.first < b.first; });
+
+        std::vector<Raytracer::Ray> rays;
+
+        for (const auto& direction : directions) {
+            rays.push_back({center, direction.second});
+        }
+
+        return rays;
+    }
+}
+
+RaytracerBenchmark::RaytracerBenchmark(juce::Component* componentToCentreAround)
+    : juce::ThreadWithProgressWindow("Raytracer Benchmark", true, true, 10000, "Cancel", componentToCentreAround)
+{
+}
+
+void RaytracerBenchmark::run()
+{
+    juce::Random random;
+    results.clear();
+
+    std::vector<Scene> scenes;
+    scenes.push_back(loadModel("raum001", BinaryData::raum001_obj, BinaryData::raum001_objSize));
+    scenes.push_back(loadModel("head", BinaryData::head_obj, BinaryData::head_objSize));
+    scenes.push_back(loadModel("head_small", BinaryData::head_small_obj, BinaryData::head_small_objSize));
+    scenes.push_back(loadModel("ball", BinaryData::ball_obj, BinaryData::ball_objSize));
+    scenes.push_back(loadModel("ball_small", BinaryData::ball_small_obj, BinaryData::ball_small_objSize));
+
+    setStatusMessage("Creating a synthetic room...");
+    scenes.push_back(createSyntheticRoom(numSyntheticTriangles));
+
+    auto const numMeasurements = 2 * (int) scenes.size();
+
+    for (int sceneNum = 0; sceneNum < (int) scenes.size(); sceneNum++) {
+        const auto& scene = scenes[(size_t) sceneNum];
+
+        std::vector<Raytracer::PacketTriangle> packetTriangles;
+        packetTriangles.reserve(scene.triangles.size());
+
+        for (const auto& triangle : scene.triangles) {
+            packetTriangles.push_back(Raytracer::PacketTriangle::fromTriangle(triangle));
+        }
+
+        auto const rays = createPrimaryRays(scene, numRays, random);
+        double raysPerSecond[2] = {0.0, 0.0};
+
+        for (int usePackets = 0; usePackets < 2; usePackets++) {
+            setStatusMessage("Tracing " + scene.name + (usePackets ? " with ray packets..." : " with single rays..."));
+
+            auto const measurementNum = 2 * sceneNum + usePackets;
+            auto const startMS = juce::Time::getMillisecondCounterHiRes();
+            double elapsedS = 0.0;
+            juce::int64 numRaysCast = 0;
+
+            // the rays are repeated until the time is up, one packet at a time
+            for (size_t first = 0; elapsedS < secondsPerMeasurement; first = (first + Raytracer::RayPacket::size) % rays.size()) {
+                if (threadShouldExit()) {
+                    return;
+                }
+
+                if (usePackets) {
+                    Raytracer::RayPacket packet;
+
+                    for (int lane = 0; lane < Raytracer::RayPacket::size; lane++) {
+                        const auto& ray = rays[first + (size_t) lane];
+
+                        packet.positionX[lane]  = ray.position.x;
+                        packet.positionY[lane]  = ray.position.y;
+                        packet.positionZ[lane]  = ray.position.z;
+                        packet.directionX[lane] = ray.direction.x;
+                        packet.directionY[lane] = ray.direction.y;
+                        packet.directionZ[lane] = ray.direction.z;
+                        packet.distance[lane]   = Raytracer::Hit().distance;
+                        packet.triangle[lane]   = -1;
+                    }
+
+                    Raytracer::intersectPacket(packet, packetTriangles);
+                } else {
+                    for (int lane = 0; lane < Raytracer::RayPacket::size; lane++) {
+                        Raytracer::intersect(rays[first + (size_t) lane], scene.triangles);
+                    }
+                }
+
+                numRaysCast += Raytracer::RayPacket::size;
+                elapsedS = (juce::Time::getMillisecondCounterHiRes() - startMS) / 1000.0;
+
+                setProgress((measurementNum + juce::jmin(1.0, elapsedS / secondsPerMeasurement)) / numMeasurements);
+            }
+
+            raysPerSecond[usePackets] = (double) numRaysCast / elapsedS;
+        }
+
+        results.add(scene.name + " (" + juce::String(scene.triangles.size()) + " triangles): single rays " + juce::String(raysPerSecond[0], 0)
+                    + " rays/s, packets " + juce::String(raysPerSecond[1], 0) + " rays/s, "
+                    + juce::String(raysPerSecond[1] / raysPerSecond[0], 2) + "x");
+    }
+}
+
+void RaytracerBenchmark::threadComplete(bool userPressedCancel)
+{
+    if (userPressedCancel) {
+        return;
+    }
+
+    juce::AlertWindow::showMessageBoxAsync(juce::MessageBoxIconType::InfoIcon, "Raytracer Benchmark",
+                                           "Intersection throughput of primary rays from the center of each scene, on one thread.\n\n"
+                                           + results.joinIntoString("\n"));
+}
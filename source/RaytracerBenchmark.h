@@ -0,0 +1,24 @@
+#pragma once
+
+#include "JuceHeader.h"
+
+/**
+ * Measures the rays per second of the single ray and the packet intersection on the bundled models and on a synthetic
+ * room of about a million triangles. All rays start in the center of the scene and are sorted by direction like the
+ * primary rays of a render, so the figures are those of the primary emission.
+ */
+class RaytracerBenchmark : public juce::ThreadWithProgressWindow
+{
+public:
+    explicit RaytracerBenchmark(juce::Component* componentToCentreAround);
+
+    void run() override;
+    void threadComplete(bool userPressedCancel) override;
+
+private:
+    static constexpr int numSyntheticTriangles = 1 << 20;
+    static constexpr int numRays = 1 << 14;
+    static constexpr double secondsPerMeasurement = 2.0;
+
+    juce::StringArray results;
+};
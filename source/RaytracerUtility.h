@@ -0,0 +1,102 @@
+#pragma once
+
+#include "JuceHeader.h"
+#include "glm/glm.hpp"
+
+struct RaytracerUtils
+{
+    /**
+     * Interleaves the lower 16 bits of x and y, so that values close to each other in 2D stay close in 1D.
+     */
+    static juce::uint32 mortonCode2D(juce::uint32 x, juce::uint32 y)
+    {
+        return spreadBits2D(x) | (spreadBits2D(y) << 1);
+    }
+
+    /**
+     * Interleaves the lower 21 bits of x, y and z.
+     */
+    static juce::uint64 mortonCode3D(juce::uint32 x, juce::uint32 y, juce::uint32 z)
+    {
+        return spreadBits3D(x) | (spreadBits3D(y) << 1) | (spreadBits3D(z) << 2);
+    }
+
+    /**
+     * Maps a unit vector onto the octahedron and unfolds it into the square [-1, 1]^2.
+     *
+     * @see https://jcgt.org/published/0003/02/01/
+     */
+    static glm::vec2 octahedralEncode(glm::vec3 direction)
+    {
+        float sum = std::abs(direction.x) + std::abs(direction.y) + std::abs(direction.z);
+
+        if (sum == 0.0f)
+            return {0.0f, 0.0f};
+
+        float x = direction.x / sum;
+        float y = direction.y / sum;
+
+        if (direction.z < 0.0f) {
+            float foldedX = (1.0f - std::abs(y)) * signNotZero(x);
+            float foldedY = (1.0f - std::abs(x)) * signNotZero(y);
+            x = foldedX;
+            y = foldedY;
+        }
+
+        return {x, y};
+    }
+
+    static glm::vec3 octahedralDecode(glm::vec2 encoded)
+    {
+        glm::vec3 direction = {encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y)};
+
+        if (direction.z < 0.0f) {
+            float unfoldedX = (1.0f - std::abs(encoded.y)) * signNotZero(encoded.x);
+            float unfoldedY = (1.0f - std::abs(encoded.x)) * signNotZero(encoded.y);
+            direction.x = unfoldedX;
+            direction.y = unfoldedY;
+        }
+
+        return glm::normalize(direction);
+    }
+
+    /**
+     * @return A key that sorts directions pointing the same way next to each other.
+     */
+    static juce::uint32 directionKey(glm::vec3 direction)
+    {
+        glm::vec2 encoded = octahedralEncode(direction);
+
+        auto x = (juce::uint32) juce::jlimit(0.0f, 65535.0f, (encoded.x * 0.5f + 0.5f) * 65535.0f);
+        auto y = (juce::uint32) juce::jlimit(0.0f, 65535.0f, (encoded.y * 0.5f + 0.5f) * 65535.0f);
+
+        return mortonCode2D(x, y);
+    }
+
+private:
+    static float signNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    static juce::uint32 spreadBits2D(juce::uint32 value)
+    {
+        value &= 0x0000ffff;
+        value = (value | (value << 8)) & 0x00ff00ff;
+        value = (value | (value << 4)) & 0x0f0f0f0f;
+        value = (value | (value << 2)) & 0x33333333;
+        value = (value | (value << 1)) & 0x55555555;
+        return value;
+    }
+
+    static juce::uint64 spreadBits3D(juce::uint64 value)
+    {
+        value &= 0x1fffff;
+        value = (value | (value << 32)) & 0x1f00000000ffffULL;
+        value = (value | (value << 16)) & 0x1f0000ff0000ffULL;
+        value = (value | (value << 8))  & 0x100f00f00f00f00fULL;
+        value = (value | (value << 4))  & 0x10c30c30c30c30c3ULL;
+        value = (value | (value << 2))  & 0x1249249249249249ULL;
+        return value;
+    }
+};
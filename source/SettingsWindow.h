@@ -1,7 +1,9 @@
 #pragma once
 
+#include "ConvolutionBenchmark.h"
 #include "JuceHeader.h"
 #include "PluginProcessor.h"
+#include "RaytracerBenchmark.h"
 
 class SettingsWindow : public juce::DocumentWindow,
                        public ChangeBroadcaster
@@ -17,7 +19,7 @@ private:
         explicit SettingsComponent(SettingsWindow& pw)
         : parentWindow(pw)
         {
-            setSize(400, 300);
+            setSize(400, 775);
 
             addAndMakeVisible(generalSettingsLabel);
             generalSettingsLabel.setFont(juce::Font(16.0f, juce::Font::bold));
@@ -53,11 +55,151 @@ private:
             pointsInVisualizerSlider.setSliderStyle(juce::Slider::LinearBar);
             pointsInVisualizerSlider.setTextValueSuffix("%");
             pointsInVisualizerSlider.setRange(0.0f, 100.0f, 10.0f);
-            pointsInVisualizerSlider.setTooltip("Percentage of reflection points that are shown in the visualizer.");
+            pointsInVisualizerSlider.setTooltip("Percentage of reflection points that are shown in the visualizer, with level of detail the share of the largest point budget.");
             pointsInVisualizerSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("points_in_visualizer", pointsInVisualizerSlider.getValue(), nullptr); };
             double pointsInVisualizer = parentWindow.parameters.state.getProperty("points_in_visualizer");
             pointsInVisualizerSlider.setValue(pointsInVisualizer, dontSendNotification);
 
+            addAndMakeVisible(pointLODLabel);
+            addAndMakeVisible(pointLODToggle);
+            pointLODToggle.setTooltip("Whether to merge nearby reflection points in the visualizer, with more detail where the view is closer.");
+            pointLODToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_point_lod", pointLODToggle.getToggleState(), nullptr);  };
+            bool usePointLOD = parentWindow.parameters.state.getProperty("use_point_lod");
+            pointLODToggle.setToggleState(usePointLOD, dontSendNotification);
+
+            addAndMakeVisible(colorPointsByEnergyLabel);
+            addAndMakeVisible(colorPointsByEnergyToggle);
+            colorPointsByEnergyToggle.setTooltip("Whether to color the reflection points by their energy instead of their reflection order.");
+            colorPointsByEnergyToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("color_points_by_energy", colorPointsByEnergyToggle.getToggleState(), nullptr);  };
+            bool colorPointsByEnergy = parentWindow.parameters.state.getProperty("color_points_by_energy");
+            colorPointsByEnergyToggle.setToggleState(colorPointsByEnergy, dontSendNotification);
+
+            addAndMakeVisible(rayPathsLabel);
+            addAndMakeVisible(rayPathsToggle);
+            rayPathsToggle.setTooltip("Whether to record the paths of a sample of the rays during the next render and show them in the visualizer.");
+            rayPathsToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("show_ray_paths", rayPathsToggle.getToggleState(), nullptr);  };
+            bool showRayPaths = parentWindow.parameters.state.getProperty("show_ray_paths");
+            rayPathsToggle.setToggleState(showRayPaths, dontSendNotification);
+
+            addAndMakeVisible(rayPacketsLabel);
+            addAndMakeVisible(rayPacketsToggle);
+            rayPacketsToggle.setTooltip("Whether to intersect primary and first order rays with similar directions together as packets.");
+            rayPacketsToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_ray_packets", rayPacketsToggle.getToggleState(), nullptr);  };
+            bool useRayPackets = parentWindow.parameters.state.getProperty("use_ray_packets");
+            rayPacketsToggle.setToggleState(useRayPackets, dontSendNotification);
+
+            addAndMakeVisible(batchedOcclusionLabel);
+            addAndMakeVisible(batchedOcclusionToggle);
+            batchedOcclusionToggle.setTooltip("Whether to test the visibility of neighboring secondary sources together as packets while gathering.");
+            batchedOcclusionToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_batched_occlusion", batchedOcclusionToggle.getToggleState(), nullptr);  };
+            bool useBatchedOcclusion = parentWindow.parameters.state.getProperty("use_batched_occlusion");
+            batchedOcclusionToggle.setToggleState(useBatchedOcclusion, dontSendNotification);
+
+            addAndMakeVisible(clusterSourcesLabel);
+            addAndMakeVisible(clusterSourcesToggle);
+            clusterSourcesToggle.setTooltip("Whether to merge secondary sources that are close in space and time before gathering.");
+            clusterSourcesToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("cluster_sources", clusterSourcesToggle.getToggleState(), nullptr);  };
+            bool clusterSources = parentWindow.parameters.state.getProperty("cluster_sources");
+            clusterSourcesToggle.setToggleState(clusterSources, dontSendNotification);
+
+            addAndMakeVisible(clusterToleranceCMLabel);
+            addAndMakeVisible(clusterToleranceCMSlider);
+            clusterToleranceCMSlider.setSliderStyle(juce::Slider::LinearBar);
+            clusterToleranceCMSlider.setTextValueSuffix("cm");
+            clusterToleranceCMSlider.setRange(1.0f, 100.0f, 1.0f);
+            clusterToleranceCMSlider.setTooltip("Size of the grid cells in which secondary sources are merged.");
+            clusterToleranceCMSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("cluster_tolerance_cm", clusterToleranceCMSlider.getValue(), nullptr); };
+            double clusterToleranceCM = parentWindow.parameters.state.getProperty("cluster_tolerance_cm");
+            clusterToleranceCMSlider.setValue(clusterToleranceCM, dontSendNotification);
+
+            addAndMakeVisible(clusterToleranceMSLabel);
+            addAndMakeVisible(clusterToleranceMSSlider);
+            clusterToleranceMSSlider.setSliderStyle(juce::Slider::LinearBar);
+            clusterToleranceMSSlider.setTextValueSuffix("ms");
+            clusterToleranceMSSlider.setRange(0.1f, 10.0f, 0.1f);
+            clusterToleranceMSSlider.setTooltip("Maximum difference in delay between secondary sources that are merged.");
+            clusterToleranceMSSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("cluster_tolerance_ms", clusterToleranceMSSlider.getValue(), nullptr); };
+            double clusterToleranceMS = parentWindow.parameters.state.getProperty("cluster_tolerance_ms");
+            clusterToleranceMSSlider.setValue(clusterToleranceMS, dontSendNotification);
+
+            addAndMakeVisible(visibilityCacheLabel);
+            addAndMakeVisible(visibilityCacheToggle);
+            visibilityCacheToggle.setTooltip("Whether to cache which wall patches can see a receiver between renders.");
+            visibilityCacheToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_visibility_cache", visibilityCacheToggle.getToggleState(), nullptr);  };
+            bool useVisibilityCache = parentWindow.parameters.state.getProperty("use_visibility_cache");
+            visibilityCacheToggle.setToggleState(useVisibilityCache, dontSendNotification);
+
+            addAndMakeVisible(patchSizeLabel);
+            addAndMakeVisible(patchSizeSlider);
+            patchSizeSlider.setSliderStyle(juce::Slider::LinearBar);
+            patchSizeSlider.setTextValueSuffix("cm");
+            patchSizeSlider.setRange(10.0f, 200.0f, 10.0f);
+            patchSizeSlider.setTooltip("Maximum edge length of the patches the room surfaces are subdivided into.");
+            patchSizeSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("patch_size_cm", patchSizeSlider.getValue(), nullptr); };
+            double patchSize = parentWindow.parameters.state.getProperty("patch_size_cm");
+            patchSizeSlider.setValue(patchSize, dontSendNotification);
+
+            addAndMakeVisible(radiosityLabel);
+            addAndMakeVisible(radiosityToggle);
+            radiosityToggle.setTooltip("Whether to exchange the diffusely reflected energy between the wall patches instead of gathering it from the rays directly. "
+                                       "Receivers can then be moved without tracing the rays again.");
+            radiosityToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_radiosity", radiosityToggle.getToggleState(), nullptr);  };
+            bool useRadiosity = parentWindow.parameters.state.getProperty("use_radiosity");
+            radiosityToggle.setToggleState(useRadiosity, dontSendNotification);
+
+            addAndMakeVisible(radiosityLengthLabel);
+            addAndMakeVisible(radiosityLengthSlider);
+            radiosityLengthSlider.setSliderStyle(juce::Slider::LinearBar);
+            radiosityLengthSlider.setTextValueSuffix("ms");
+            radiosityLengthSlider.setRange(100.0f, 5000.0f, 100.0f);
+            radiosityLengthSlider.setTooltip("Length of the diffuse energy histograms of the wall patches.");
+            radiosityLengthSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("radiosity_length_ms", radiosityLengthSlider.getValue(), nullptr); };
+            double radiosityLength = parentWindow.parameters.state.getProperty("radiosity_length_ms");
+            radiosityLengthSlider.setValue(radiosityLength, dontSendNotification);
+
+            addAndMakeVisible(truncateTraceLabel);
+            addAndMakeVisible(truncateTraceToggle);
+            truncateTraceToggle.setTooltip("Whether to only trace rays up to the transition time and extrapolate the late tail from the decay of every band.");
+            truncateTraceToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("truncate_trace", truncateTraceToggle.getToggleState(), nullptr);  };
+            bool truncateTrace = parentWindow.parameters.state.getProperty("truncate_trace");
+            truncateTraceToggle.setToggleState(truncateTrace, dontSendNotification);
+
+            addAndMakeVisible(transitionTimeLabel);
+            addAndMakeVisible(transitionTimeSlider);
+            transitionTimeSlider.setSliderStyle(juce::Slider::LinearBar);
+            transitionTimeSlider.setTextValueSuffix("ms");
+            transitionTimeSlider.setRange(0.0f, 300.0f, 5.0f);
+            transitionTimeSlider.setTooltip("Delay after which the late tail is extrapolated. At 0 ms the mixing time is estimated from the room volume.");
+            transitionTimeSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("transition_time_ms", transitionTimeSlider.getValue(), nullptr); };
+            double transitionTime = parentWindow.parameters.state.getProperty("transition_time_ms");
+            transitionTimeSlider.setValue(transitionTime, dontSendNotification);
+
+            addAndMakeVisible(secondarySourceMemoryLabel);
+            addAndMakeVisible(secondarySourceMemorySlider);
+            secondarySourceMemorySlider.setSliderStyle(juce::Slider::LinearBar);
+            secondarySourceMemorySlider.setTextValueSuffix("MB");
+            secondarySourceMemorySlider.setRange(64.0f, 16384.0f, 64.0f);
+            secondarySourceMemorySlider.setSkewFactorFromMidPoint(1024.0f);
+            secondarySourceMemorySlider.setTooltip("Memory that secondary sources may occupy before they are moved to a temporary file on disk or sampled.");
+            secondarySourceMemorySlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("secondary_source_memory_mb", secondarySourceMemorySlider.getValue(), nullptr); };
+            double secondarySourceMemory = parentWindow.parameters.state.getProperty("secondary_source_memory_mb");
+            secondarySourceMemorySlider.setValue(secondarySourceMemory, dontSendNotification);
+
+            addAndMakeVisible(reservoirSamplingLabel);
+            addAndMakeVisible(reservoirSamplingToggle);
+            reservoirSamplingToggle.setTooltip("Whether to keep a representative sample of the secondary sources once the memory budget is reached, instead of moving them to disk.");
+            reservoirSamplingToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_reservoir_sampling", reservoirSamplingToggle.getToggleState(), nullptr);  };
+            bool useReservoirSampling = parentWindow.parameters.state.getProperty("use_reservoir_sampling");
+            reservoirSamplingToggle.setToggleState(useReservoirSampling, dontSendNotification);
+
+            addAndMakeVisible(raytracerBenchmarkLabel);
+            addAndMakeVisible(raytracerBenchmarkButton);
+            raytracerBenchmarkButton.setTooltip("Measures the rays per second of single rays and ray packets on the bundled models and a synthetic room.");
+            raytracerBenchmarkButton.onClick = [this] { if (raytracerBenchmark != nullptr && raytracerBenchmark->isThreadRunning())
+                                                            return;
+                                                        raytracerBenchmark = std::make_unique<RaytracerBenchmark>(this);
+                                                        raytracerBenchmark->launchThread(); };
+
 
             addAndMakeVisible(irSettingsLabel);
             irSettingsLabel.setFont(juce::Font(16.0f, juce::Font::bold));
@@ -85,6 +227,24 @@ private:
             whiteNoiseToggle.onStateChange = [this] { parentWindow.parameters.state.setProperty("use_white_noise", whiteNoiseToggle.getToggleState(), nullptr);  };
             bool useWhiteNoise = parentWindow.parameters.state.getProperty("use_white_noise");
             whiteNoiseToggle.setToggleState(useWhiteNoise, dontSendNotification);
+
+            addAndMakeVisible(crossfadeTimeLabel);
+            addAndMakeVisible(crossfadeTimeSlider);
+            crossfadeTimeSlider.setSliderStyle(juce::Slider::LinearBar);
+            crossfadeTimeSlider.setTextValueSuffix("ms");
+            crossfadeTimeSlider.setRange(0.0f, 2000.0f, 10.0f);
+            crossfadeTimeSlider.setTooltip("Time over which a newly loaded or generated impulse response is faded in during playback.");
+            crossfadeTimeSlider.onValueChange = [this] { parentWindow.parameters.state.setProperty("crossfade_time_ms", crossfadeTimeSlider.getValue(), nullptr); };
+            double crossfadeTime = parentWindow.parameters.state.getProperty("crossfade_time_ms", 100.0);
+            crossfadeTimeSlider.setValue(crossfadeTime, dontSendNotification);
+
+            addAndMakeVisible(benchmarkLabel);
+            addAndMakeVisible(benchmarkButton);
+            benchmarkButton.setTooltip("Measures the CPU load of the convolution for impulse responses of different lengths.");
+            benchmarkButton.onClick = [this] { if (convolutionBenchmark != nullptr && convolutionBenchmark->isThreadRunning())
+                                                   return;
+                                               convolutionBenchmark = std::make_unique<ConvolutionBenchmark>(parentWindow.audioProcessor.globalSampleRate, this);
+                                               convolutionBenchmark->launchThread(); };
         };
 
         void paint(juce::Graphics& /*g*/) override
@@ -110,7 +270,7 @@ private:
             }
 
             {   // Raytracer Settings
-                auto raytracerSettingsArea = area.removeFromTop(75);
+                auto raytracerSettingsArea = area.removeFromTop(500);
                 raytracerSettingsLabel.         setBounds(raytracerSettingsArea.removeFromTop(25));
 
                 auto raysPerSourceArea = raytracerSettingsArea.removeFromTop(25);
@@ -120,10 +280,78 @@ private:
                 auto pointsInVisualizerArea = raytracerSettingsArea.removeFromTop(25);
                 pointsInVisualizerLabel.        setBounds(pointsInVisualizerArea.removeFromLeft((int) (labelWidthRatio * (float) pointsInVisualizerArea.getWidth())));
                 pointsInVisualizerSlider.       setBounds(pointsInVisualizerArea);
+
+                auto pointLODArea = raytracerSettingsArea.removeFromTop(25);
+                pointLODLabel.                  setBounds(pointLODArea.removeFromLeft((int) (labelWidthRatio * (float) pointLODArea.getWidth())));
+                pointLODToggle.                 setBounds(pointLODArea);
+
+                auto colorPointsByEnergyArea = raytracerSettingsArea.removeFromTop(25);
+                colorPointsByEnergyLabel.       setBounds(colorPointsByEnergyArea.removeFromLeft((int) (labelWidthRatio * (float) colorPointsByEnergyArea.getWidth())));
+                colorPointsByEnergyToggle.      setBounds(colorPointsByEnergyArea);
+
+                auto rayPathsArea = raytracerSettingsArea.removeFromTop(25);
+                rayPathsLabel.                  setBounds(rayPathsArea.removeFromLeft((int) (labelWidthRatio * (float) rayPathsArea.getWidth())));
+                rayPathsToggle.                 setBounds(rayPathsArea);
+
+                auto rayPacketsArea = raytracerSettingsArea.removeFromTop(25);
+                rayPacketsLabel.                setBounds(rayPacketsArea.removeFromLeft((int) (labelWidthRatio * (float) rayPacketsArea.getWidth())));
+                rayPacketsToggle.               setBounds(rayPacketsArea);
+
+                auto batchedOcclusionArea = raytracerSettingsArea.removeFromTop(25);
+                batchedOcclusionLabel.          setBounds(batchedOcclusionArea.removeFromLeft((int) (labelWidthRatio * (float) batchedOcclusionArea.getWidth())));
+                batchedOcclusionToggle.         setBounds(batchedOcclusionArea);
+
+                auto clusterSourcesArea = raytracerSettingsArea.removeFromTop(25);
+                clusterSourcesLabel.            setBounds(clusterSourcesArea.removeFromLeft((int) (labelWidthRatio * (float) clusterSourcesArea.getWidth())));
+                clusterSourcesToggle.           setBounds(clusterSourcesArea);
+
+                auto clusterToleranceCMArea = raytracerSettingsArea.removeFromTop(25);
+                clusterToleranceCMLabel.        setBounds(clusterToleranceCMArea.removeFromLeft((int) (labelWidthRatio * (float) clusterToleranceCMArea.getWidth())));
+                clusterToleranceCMSlider.       setBounds(clusterToleranceCMArea);
+
+                auto clusterToleranceMSArea = raytracerSettingsArea.removeFromTop(25);
+                clusterToleranceMSLabel.        setBounds(clusterToleranceMSArea.removeFromLeft((int) (labelWidthRatio * (float) clusterToleranceMSArea.getWidth())));
+                clusterToleranceMSSlider.       setBounds(clusterToleranceMSArea);
+
+                auto visibilityCacheArea = raytracerSettingsArea.removeFromTop(25);
+                visibilityCacheLabel.           setBounds(visibilityCacheArea.removeFromLeft((int) (labelWidthRatio * (float) visibilityCacheArea.getWidth())));
+                visibilityCacheToggle.          setBounds(visibilityCacheArea);
+
+                auto patchSizeArea = raytracerSettingsArea.removeFromTop(25);
+                patchSizeLabel.                 setBounds(patchSizeArea.removeFromLeft((int) (labelWidthRatio * (float) patchSizeArea.getWidth())));
+                patchSizeSlider.                setBounds(patchSizeArea);
+
+                auto radiosityArea = raytracerSettingsArea.removeFromTop(25);
+                radiosityLabel.                 setBounds(radiosityArea.removeFromLeft((int) (labelWidthRatio * (float) radiosityArea.getWidth())));
+                radiosityToggle.                setBounds(radiosityArea);
+
+                auto radiosityLengthArea = raytracerSettingsArea.removeFromTop(25);
+                radiosityLengthLabel.           setBounds(radiosityLengthArea.removeFromLeft((int) (labelWidthRatio * (float) radiosityLengthArea.getWidth())));
+                radiosityLengthSlider.          setBounds(radiosityLengthArea);
+
+                auto truncateTraceArea = raytracerSettingsArea.removeFromTop(25);
+                truncateTraceLabel.             setBounds(truncateTraceArea.removeFromLeft((int) (labelWidthRatio * (float) truncateTraceArea.getWidth())));
+                truncateTraceToggle.            setBounds(truncateTraceArea);
+
+                auto transitionTimeArea = raytracerSettingsArea.removeFromTop(25);
+                transitionTimeLabel.            setBounds(transitionTimeArea.removeFromLeft((int) (labelWidthRatio * (float) transitionTimeArea.getWidth())));
+                transitionTimeSlider.           setBounds(transitionTimeArea);
+
+                auto secondarySourceMemoryArea = raytracerSettingsArea.removeFromTop(25);
+                secondarySourceMemoryLabel.     setBounds(secondarySourceMemoryArea.removeFromLeft((int) (labelWidthRatio * (float) secondarySourceMemoryArea.getWidth())));
+                secondarySourceMemorySlider.    setBounds(secondarySourceMemoryArea);
+
+                auto reservoirSamplingArea = raytracerSettingsArea.removeFromTop(25);
+                reservoirSamplingLabel.         setBounds(reservoirSamplingArea.removeFromLeft((int) (labelWidthRatio * (float) reservoirSamplingArea.getWidth())));
+                reservoirSamplingToggle.        setBounds(reservoirSamplingArea);
+
+                auto raytracerBenchmarkArea = raytracerSettingsArea.removeFromTop(25);
+                raytracerBenchmarkLabel.        setBounds(raytracerBenchmarkArea.removeFromLeft((int) (labelWidthRatio * (float) raytracerBenchmarkArea.getWidth())));
+                raytracerBenchmarkButton.       setBounds(raytracerBenchmarkArea);
             }
 
             {   // IR Settings
-                auto irSettingsArea = area.removeFromTop(100);
+                auto irSettingsArea = area.removeFromTop(150);
                 irSettingsLabel.                setBounds(irSettingsArea.removeFromTop(25));
 
                 auto linesInWaveformArea = irSettingsArea.removeFromTop(25);
@@ -137,6 +365,14 @@ private:
                 auto whiteNoiseArea = irSettingsArea.removeFromTop(25);
                 whiteNoiseLabel.                setBounds(whiteNoiseArea.removeFromLeft((int) (labelWidthRatio * (float) whiteNoiseArea.getWidth())));
                 whiteNoiseToggle.               setBounds(whiteNoiseArea);
+
+                auto crossfadeTimeArea = irSettingsArea.removeFromTop(25);
+                crossfadeTimeLabel.             setBounds(crossfadeTimeArea.removeFromLeft((int) (labelWidthRatio * (float) crossfadeTimeArea.getWidth())));
+                crossfadeTimeSlider.            setBounds(crossfadeTimeArea);
+
+                auto benchmarkArea = irSettingsArea.removeFromTop(25);
+                benchmarkLabel.                 setBounds(benchmarkArea.removeFromLeft((int) (labelWidthRatio * (float) benchmarkArea.getWidth())));
+                benchmarkButton.                setBounds(benchmarkArea);
             }
         }
 
@@ -155,6 +391,41 @@ private:
         Slider          raysPerSourceSlider;
         Label           pointsInVisualizerLabel{{}, "Points in Visualizer"};
         Slider          pointsInVisualizerSlider;
+        Label           pointLODLabel{{}, "Visualizer Level of Detail"};
+        ToggleButton    pointLODToggle;
+        Label           colorPointsByEnergyLabel{{}, "Color Points by Energy"};
+        ToggleButton    colorPointsByEnergyToggle;
+        Label           rayPathsLabel{{}, "Visualize Ray Paths"};
+        ToggleButton    rayPathsToggle;
+        Label           rayPacketsLabel{{}, "Trace Ray Packets"};
+        ToggleButton    rayPacketsToggle;
+        Label           batchedOcclusionLabel{{}, "Batch Occlusion Queries"};
+        ToggleButton    batchedOcclusionToggle;
+        Label           clusterSourcesLabel{{}, "Cluster Secondary Sources"};
+        ToggleButton    clusterSourcesToggle;
+        Label           clusterToleranceCMLabel{{}, "Cluster Spatial Tolerance"};
+        Slider          clusterToleranceCMSlider;
+        Label           clusterToleranceMSLabel{{}, "Cluster Delay Tolerance"};
+        Slider          clusterToleranceMSSlider;
+        Label           visibilityCacheLabel{{}, "Cache Patch Visibility"};
+        ToggleButton    visibilityCacheToggle;
+        Label           patchSizeLabel{{}, "Patch Size"};
+        Slider          patchSizeSlider;
+        Label           radiosityLabel{{}, "Radiosity Diffuse Field"};
+        ToggleButton    radiosityToggle;
+        Label           radiosityLengthLabel{{}, "Radiosity Length"};
+        Slider          radiosityLengthSlider;
+        Label           truncateTraceLabel{{}, "Extrapolate Late Tail"};
+        ToggleButton    truncateTraceToggle;
+        Label           transitionTimeLabel{{}, "Transition Time"};
+        Slider          transitionTimeSlider;
+        Label           secondarySourceMemoryLabel{{}, "Secondary Source Memory"};
+        Slider          secondarySourceMemorySlider;
+        Label           reservoirSamplingLabel{{}, "Sample Over Memory Budget"};
+        ToggleButton    reservoirSamplingToggle;
+        Label           raytracerBenchmarkLabel{{}, "Raytracer Benchmark"};
+        TextButton      raytracerBenchmarkButton{"Run"};
+        std::unique_ptr<RaytracerBenchmark> raytracerBenchmark;
 
         Label           irSettingsLabel{{}, "Impulse Response"};
         Label           linesInWaveformLabel{{}, "Lines in waveform display"};
@@ -163,6 +434,11 @@ private:
         ToggleButton    stereoToggle;
         Label           whiteNoiseLabel{{}, "Use white noise"};
         ToggleButton    whiteNoiseToggle;
+        Label           crossfadeTimeLabel{{}, "Crossfade Time"};
+        Slider          crossfadeTimeSlider;
+        Label           benchmarkLabel{{}, "Convolution Benchmark"};
+        TextButton      benchmarkButton{"Run"};
+        std::unique_ptr<ConvolutionBenchmark> convolutionBenchmark;
     };
 
     void closeButtonPressed() override;
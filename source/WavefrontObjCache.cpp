@@ -0,0 +1,334 @@
+#include "WavefrontObjParser.h"
+
+/**
+ * Layout of a .rsmesh file, all values are stored in native byte order:
+ *
+ * @code
+ * Header
+ * ShapeRecord[numShapes]
+ * arrays referenced by the shape records, each one aligned to 16 bytes
+ * @endcode
+ *
+ * The arrays have exactly the layout of the vectors in WavefrontObjFile::Mesh and Surface, so they can be
+ * used straight from a memory mapping. Strings are stored as UTF-8 without terminator.
+ * The acceleration section is reserved for precomputed acceleration structures and empty as long as there are none.
+ */
+namespace
+{
+    constexpr char rsmeshMagic[8] = {'R', 'S', 'M', 'E', 'S', 'H', '\0', '\0'};
+    constexpr juce::uint32 rsmeshVersion = 1;
+    constexpr juce::uint32 rsmeshByteOrderMark = 0x01020304;
+    constexpr juce::uint64 rsmeshAlignment = 16;
+
+    struct RsmeshHeader {
+        char magic[8];
+        juce::uint32 version;
+        juce::uint32 byteOrderMark;
+        juce::uint64 sourceSize;
+        juce::uint64 sourceHash;
+        juce::uint64 numShapes;
+        juce::uint64 fileSize;
+        juce::uint64 accelerationOffset;
+        juce::uint64 accelerationSize;
+    };
+
+    struct RsmeshArray {
+        juce::uint64 offset;
+        juce::uint64 count;
+    };
+
+    struct RsmeshShape {
+        RsmeshArray name;               // char
+        RsmeshArray material;           // char
+        float absorptionCoefficients[6];
+        float roughness;
+        juce::uint32 reserved;
+        RsmeshArray vertices;           // glm::vec3
+        RsmeshArray normals;            // glm::vec3
+        RsmeshArray indices;            // WavefrontObjFile::Index
+        RsmeshArray surfaceSizes;       // juce::uint32, number of vertices of every surface
+        RsmeshArray surfaceNormals;     // glm::vec3, one per surface
+        RsmeshArray surfaceVertices;    // glm::vec3, the vertices of all surfaces after each other
+    };
+
+    static_assert(sizeof(RsmeshHeader) == 64, "The header layout is part of the file format");
+    static_assert(sizeof(RsmeshShape) == 160, "The shape record layout is part of the file format");
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "Vertices are stored as three packed floats");
+
+    template <typename Item>
+    void copyArray(std::vector<Item>& target, const char* data, const RsmeshArray& array)
+    {
+        target.resize((size_t) array.count);
+
+        if (array.count > 0) {
+            memcpy(target.data(), data + array.offset, (size_t) array.count * sizeof(Item));
+        }
+    }
+}
+
+/**
+ * Hashes the content of a file word by word, fast enough to be done on every load.
+ */
+juce::uint64 WavefrontObjFile::hashContent(const void* data, size_t size)
+{
+    auto* bytes = static_cast<const juce::uint8*>(data);
+    juce::uint64 hash = 0xcbf29ce484222325ull ^ (juce::uint64) size;
+    size_t offset = 0;
+
+    for (; offset + 8 <= size; offset += 8) {
+        juce::uint64 word;
+        memcpy(&word, bytes + offset, 8);
+
+        hash = (hash ^ word) * 0x100000001b3ull;
+        hash ^= hash >> 29;
+    }
+
+    for (; offset < size; offset++) {
+        hash = (hash ^ bytes[offset]) * 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+/**
+ * Places the cache next to the OBJ file if that directory is writable and falls back to a cache directory
+ * in the user's application data, where the content hash keeps caches of different files apart.
+ *
+ * @return The locations in the order they should be tried.
+ */
+Array<File> WavefrontObjFile::getMeshCacheFiles(const File& objFile, juce::uint64 contentHash)
+{
+    Array<File> cacheFiles;
+
+    auto const besideObjFile = objFile.withFileExtension("rsmesh");
+
+    if (besideObjFile.existsAsFile() || objFile.getParentDirectory().hasWriteAccess()) {
+        cacheFiles.add(besideObjFile);
+    }
+
+    cacheFiles.add(File::getSpecialLocation(File::userApplicationDataDirectory)
+                       .getChildFile("Raumsimulation")
+                       .getChildFile("MeshCache")
+                       .getChildFile(objFile.getFileNameWithoutExtension() + "_" + String::toHexString((juce::int64) contentHash) + ".rsmesh"));
+
+    return cacheFiles;
+}
+
+/**
+ * Replaces the shapes with the ones stored in the cache file.
+ *
+ * @return False if the file does not exist, is damaged or belongs to a different OBJ file.
+ */
+bool WavefrontObjFile::readMeshCache(const File& cacheFile, juce::uint64 sourceSize, juce::uint64 contentHash)
+{
+    if (!cacheFile.existsAsFile()) {
+        return false;
+    }
+
+    MemoryMappedFile mappedFile(cacheFile, MemoryMappedFile::readOnly);
+
+    auto* data = static_cast<const char*>(mappedFile.getData());
+    auto const size = (juce::uint64) mappedFile.getSize();
+
+    if (data == nullptr || size < sizeof(RsmeshHeader)) {
+        return false;
+    }
+
+    RsmeshHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, rsmeshMagic, sizeof(rsmeshMagic)) != 0
+        || header.version != rsmeshVersion
+        || header.byteOrderMark != rsmeshByteOrderMark
+        || header.sourceSize != sourceSize
+        || header.sourceHash != contentHash
+        || header.fileSize != size
+        || header.numShapes > (size - sizeof(RsmeshHeader)) / sizeof(RsmeshShape)) {
+        return false;
+    }
+
+    auto const isInside = [size] (const RsmeshArray& array, size_t itemSize) {
+        return array.offset <= size && array.count <= (size - array.offset) / itemSize;
+    };
+
+    for (juce::uint64 shapeNum = 0; shapeNum < header.numShapes; shapeNum++) {
+        RsmeshShape record;
+        memcpy(&record, data + sizeof(RsmeshHeader) + shapeNum * sizeof(RsmeshShape), sizeof(record));
+
+        if (!isInside(record.name, 1) || !isInside(record.material, 1)
+            || !isInside(record.vertices, sizeof(glm::vec3)) || !isInside(record.normals, sizeof(glm::vec3))
+            || !isInside(record.indices, sizeof(Index)) || !isInside(record.surfaceSizes, sizeof(juce::uint32))
+            || !isInside(record.surfaceNormals, sizeof(glm::vec3)) || !isInside(record.surfaceVertices, sizeof(glm::vec3))
+            || record.surfaceNormals.count != record.surfaceSizes.count) {
+            return false;
+        }
+
+        std::unique_ptr<Shape> shape(new Shape());
+        shape->name = String::fromUTF8(data + record.name.offset, (int) record.name.count);
+        shape->material = {String::fromUTF8(data + record.material.offset, (int) record.material.count)};
+
+        for (int band = 0; band < 6; band++) {
+            shape->materialProperties.absorptionCoefficients[band] = record.absorptionCoefficients[band];
+        }
+
+        shape->materialProperties.roughness = record.roughness;
+
+        copyArray(shape->mesh.vertices, data, record.vertices);
+        copyArray(shape->mesh.normals, data, record.normals);
+        copyArray(shape->mesh.indices, data, record.indices);
+
+        for (auto index : shape->mesh.indices) {
+            if (index >= shape->mesh.vertices.size()) {
+                return false;
+            }
+        }
+
+        std::vector<juce::uint32> surfaceSizes;
+        std::vector<glm::vec3> surfaceNormals, surfaceVertices;
+        copyArray(surfaceSizes, data, record.surfaceSizes);
+        copyArray(surfaceNormals, data, record.surfaceNormals);
+        copyArray(surfaceVertices, data, record.surfaceVertices);
+
+        shape->surfaces.resize(surfaceSizes.size());
+        size_t firstVertex = 0;
+
+        for (size_t surfaceNum = 0; surfaceNum < surfaceSizes.size(); surfaceNum++) {
+            if (surfaceSizes[surfaceNum] > surfaceVertices.size() - firstVertex) {
+                return false;
+            }
+
+            auto& surface = shape->surfaces[surfaceNum];
+            surface.normal = surfaceNormals[surfaceNum];
+            surface.vertices.assign(surfaceVertices.begin() + (std::ptrdiff_t) firstVertex,
+                                    surfaceVertices.begin() + (std::ptrdiff_t) (firstVertex + surfaceSizes[surfaceNum]));
+            firstVertex += surfaceSizes[surfaceNum];
+        }
+
+        shapes.push_back(shape.release());
+    }
+
+    return true;
+}
+
+/**
+ * Writes the shapes to a temporary file that replaces the cache file once it is complete,
+ * so other instances never see a partially written cache.
+ *
+ * @return False if the file could not be written.
+ */
+bool WavefrontObjFile::writeMeshCache(const File& cacheFile, juce::uint64 sourceSize, juce::uint64 contentHash) const
+{
+    if (!cacheFile.getParentDirectory().createDirectory().wasOk()) {
+        return false;
+    }
+
+    // lay out all arrays before anything is written
+    std::vector<RsmeshShape> records(shapes.size());
+    juce::uint64 fileSize = sizeof(RsmeshHeader) + shapes.size() * sizeof(RsmeshShape);
+
+    auto const allocate = [&fileSize] (RsmeshArray& array, size_t count, size_t itemSize) {
+        fileSize = (fileSize + rsmeshAlignment - 1) / rsmeshAlignment * rsmeshAlignment;
+        array = {fileSize, (juce::uint64) count};
+        fileSize += (juce::uint64) count * itemSize;
+    };
+
+    for (size_t shapeNum = 0; shapeNum < shapes.size(); shapeNum++) {
+        const auto& shape = *shapes[shapeNum];
+        auto& record = records[shapeNum];
+
+        size_t numSurfaceVertices = 0;
+
+        for (const auto& surface : shape.surfaces) {
+            numSurfaceVertices += surface.vertices.size();
+        }
+
+        for (int band = 0; band < 6; band++) {
+            record.absorptionCoefficients[band] = shape.materialProperties.absorptionCoefficients[band];
+        }
+
+        record.roughness = shape.materialProperties.roughness;
+        record.reserved = 0;
+
+        allocate(record.name, shape.name.getNumBytesAsUTF8(), 1);
+        allocate(record.material, shape.material.name.getNumBytesAsUTF8(), 1);
+        allocate(record.vertices, shape.mesh.vertices.size(), sizeof(glm::vec3));
+        allocate(record.normals, shape.mesh.normals.size(), sizeof(glm::vec3));
+        allocate(record.indices, shape.mesh.indices.size(), sizeof(Index));
+        allocate(record.surfaceSizes, shape.surfaces.size(), sizeof(juce::uint32));
+        allocate(record.surfaceNormals, shape.surfaces.size(), sizeof(glm::vec3));
+        allocate(record.surfaceVertices, numSurfaceVertices, sizeof(glm::vec3));
+    }
+
+    RsmeshHeader header;
+    memcpy(header.magic, rsmeshMagic, sizeof(rsmeshMagic));
+    header.version = rsmeshVersion;
+    header.byteOrderMark = rsmeshByteOrderMark;
+    header.sourceSize = sourceSize;
+    header.sourceHash = contentHash;
+    header.numShapes = shapes.size();
+    header.fileSize = fileSize;
+    header.accelerationOffset = 0;
+    header.accelerationSize = 0;
+
+    TemporaryFile temporaryFile(cacheFile);
+
+    {
+        FileOutputStream stream(temporaryFile.getFile());
+
+        if (stream.failedToOpen()) {
+            return false;
+        }
+
+        auto const seekTo = [&stream] (const RsmeshArray& array) {
+            while ((juce::uint64) stream.getPosition() < array.offset) {
+                stream.writeByte(0);
+            }
+        };
+
+        auto const writeArray = [&stream, &seekTo] (const RsmeshArray& array, const void* items, size_t itemSize) {
+            seekTo(array);
+            return array.count == 0 || stream.write(items, (size_t) array.count * itemSize);
+        };
+
+        bool ok = stream.write(&header, sizeof(header))
+               && (records.empty() || stream.write(records.data(), records.size() * sizeof(RsmeshShape)));
+
+        for (size_t shapeNum = 0; ok && shapeNum < shapes.size(); shapeNum++) {
+            const auto& shape = *shapes[shapeNum];
+            const auto& record = records[shapeNum];
+
+            ok = writeArray(record.name, shape.name.toRawUTF8(), 1)
+              && writeArray(record.material, shape.material.name.toRawUTF8(), 1)
+              && writeArray(record.vertices, shape.mesh.vertices.data(), sizeof(glm::vec3))
+              && writeArray(record.normals, shape.mesh.normals.data(), sizeof(glm::vec3))
+              && writeArray(record.indices, shape.mesh.indices.data(), sizeof(Index));
+
+            seekTo(record.surfaceSizes);
+
+            for (const auto& surface : shape.surfaces) {
+                auto const surfaceSize = (juce::uint32) surface.vertices.size();
+                ok = ok && stream.write(&surfaceSize, sizeof(surfaceSize));
+            }
+
+            seekTo(record.surfaceNormals);
+
+            for (const auto& surface : shape.surfaces) {
+                ok = ok && stream.write(&surface.normal, sizeof(glm::vec3));
+            }
+
+            seekTo(record.surfaceVertices);
+
+            for (const auto& surface : shape.surfaces) {
+                ok = ok && (surface.vertices.empty() || stream.write(surface.vertices.data(), surface.vertices.size() * sizeof(glm::vec3)));
+            }
+        }
+
+        stream.flush();
+
+        if (!ok || stream.getStatus().failed() || (juce::uint64) stream.getPosition() != fileSize) {
+            return false;
+        }
+    }
+
+    return temporaryFile.overwriteTargetFileWithTemporary();
+}
@@ -3,6 +3,8 @@
 #include "CustomDatatypes.h"
 #include "glm/ext.hpp"
 #include "glm/glm.hpp"
+#include <thread>
+#include <unordered_map>
 
 using namespace juce;
 
@@ -11,16 +13,54 @@ class WavefrontObjFile
 public:
     WavefrontObjFile() {}
 
+    ~WavefrontObjFile()
+    {
+        clearShapes();
+    }
+
     Result load (const String& objFileContent)
     {
-        shapes.clear();
+        clearShapes();
         return parseObjFile (StringArray::fromLines (objFileContent));
     }
 
+    /**
+     * Maps the file into memory and parses it in place, large files are split into chunks of lines
+     * that are parsed in parallel. Falls back to the text parser if the file cannot be mapped.
+     *
+     * The parsed shapes are stored in a binary .rsmesh file, which is used instead of parsing
+     * as long as the content of the OBJ file does not change.
+     */
     Result load (const File& file)
     {
         sourceFile = file;
-        return load (file.loadFileAsString());
+        clearShapes();
+
+        MemoryMappedFile mappedFile (file, MemoryMappedFile::readOnly);
+
+        if (mappedFile.getData() == nullptr || mappedFile.getSize() == 0)
+            return load (file.loadFileAsString());
+
+        auto const contentHash = hashContent (mappedFile.getData(), mappedFile.getSize());
+
+        for (const auto& cacheFile : getMeshCacheFiles (file, contentHash))
+        {
+            if (readMeshCache (cacheFile, (juce::uint64) mappedFile.getSize(), contentHash))
+                return Result::ok();
+
+            clearShapes();
+        }
+
+        auto result = parseMappedObjFile (static_cast<const char*> (mappedFile.getData()), mappedFile.getSize());
+
+        if (result.wasOk())
+        {
+            for (const auto& cacheFile : getMeshCacheFiles (file, contentHash))
+                if (writeMeshCache (cacheFile, (juce::uint64) mappedFile.getSize(), contentHash))
+                    break;
+        }
+
+        return result;
     }
 
     typedef juce::uint32 Index;
@@ -55,10 +95,33 @@ public:
 private:
     File sourceFile;
 
+    //==============================================================================
+    // Binary mesh cache, @see WavefrontObjCache.cpp
+
+    static juce::uint64 hashContent (const void* data, size_t size);
+    static Array<File> getMeshCacheFiles (const File& objFile, juce::uint64 contentHash);
+    bool readMeshCache (const File& cacheFile, juce::uint64 sourceSize, juce::uint64 contentHash);
+    bool writeMeshCache (const File& cacheFile, juce::uint64 sourceSize, juce::uint64 contentHash) const;
+
+    void clearShapes()
+    {
+        for (auto* shape : shapes)
+            delete shape;
+
+        shapes.clear();
+    }
+
     struct TripleIndex
     {
         TripleIndex() noexcept {}
 
+        bool operator== (const TripleIndex& other) const noexcept
+        {
+            return vertexIndex == other.vertexIndex
+                && textureIndex == other.textureIndex
+                && normalIndex == other.normalIndex;
+        }
+
         bool operator< (const TripleIndex& other) const noexcept
         {
             if (this == &other)
@@ -76,13 +139,24 @@ private:
         int vertexIndex = -1, textureIndex = -1, normalIndex = -1;
     };
 
+    struct TripleIndexHash
+    {
+        size_t operator() (const TripleIndex& i) const noexcept
+        {
+            auto hash = (size_t) (juce::uint32) i.vertexIndex;
+            hash = hash * 0x9e3779b1u + (size_t) (juce::uint32) i.normalIndex;
+            hash = hash * 0x9e3779b1u + (size_t) (juce::uint32) i.textureIndex;
+            return hash;
+        }
+    };
+
     struct IndexMap
     {
-        std::map<TripleIndex, Index> map;
+        std::unordered_map<TripleIndex, Index, TripleIndexHash> map;
 
         Index getIndexFor (TripleIndex i, Mesh& newMesh, const Mesh& srcMesh)
         {
-            const std::map<TripleIndex, Index>::iterator it (map.find (i));
+            auto it = map.find (i);
 
             if (it != map.end())
                 return it->second;
@@ -185,21 +259,6 @@ private:
 
         Array<TripleIndex> triples;
 
-        void addIndices(Mesh& newMesh, const Mesh& srcMesh, IndexMap& indexMap)
-        {
-            TripleIndex i0 (triples[0]), i1, i2 (triples[1]);
-
-            for (auto i = 2; i < triples.size(); ++i)
-            {
-                i1 = i2;
-                i2 = triples.getReference(i);
-
-                newMesh.indices.push_back(indexMap.getIndexFor (i0, newMesh, srcMesh));
-                newMesh.indices.push_back(indexMap.getIndexFor (i1, newMesh, srcMesh));
-                newMesh.indices.push_back(indexMap.getIndexFor (i2, newMesh, srcMesh));
-            }
-        }
-
         static TripleIndex parseTriple(String::CharPointerType& t)
         {
             TripleIndex i;
@@ -250,20 +309,36 @@ private:
 
         IndexMap indexMap;
 
-        for (auto& f : faceGroup) {
-            f.addIndices(shape->mesh, srcMesh, indexMap);
+        for (auto& f : faceGroup)
+            addFace(*shape, f.triples.begin(), f.triples.size(), srcMesh, indexMap);
 
-            Surface surface;
+        return shape.release();
+    }
 
-            for (TripleIndex index : f.triples) {
-                surface.normal = srcMesh.normals[index.normalIndex];
-                surface.vertices.push_back(srcMesh.vertices[index.vertexIndex]);
-            }
+    /**
+     * Triangulates a face as a fan into the mesh of the shape and adds it as a surface.
+     */
+    static void addFace(Shape& shape, const TripleIndex* triples, int numTriples, const Mesh& srcMesh, IndexMap& indexMap)
+    {
+        for (auto i = 2; i < numTriples; ++i)
+        {
+            shape.mesh.indices.push_back(indexMap.getIndexFor (triples[0],     shape.mesh, srcMesh));
+            shape.mesh.indices.push_back(indexMap.getIndexFor (triples[i - 1], shape.mesh, srcMesh));
+            shape.mesh.indices.push_back(indexMap.getIndexFor (triples[i],     shape.mesh, srcMesh));
+        }
+
+        Surface surface;
+
+        for (auto i = 0; i < numTriples; ++i)
+        {
+            if (isPositiveAndBelow(triples[i].normalIndex, srcMesh.normals.size()))
+                surface.normal = srcMesh.normals[(size_t) triples[i].normalIndex];
 
-            shape->surfaces.push_back(surface);
+            if (isPositiveAndBelow(triples[i].vertexIndex, srcMesh.vertices.size()))
+                surface.vertices.push_back(srcMesh.vertices[(size_t) triples[i].vertexIndex]);
         }
 
-        return shape.release();
+        shape.surfaces.push_back(surface);
     }
 
     Result parseObjFile(const StringArray& lines)
@@ -309,5 +384,325 @@ private:
         return Result::ok();
     }
 
+    //==============================================================================
+    // Parser for memory mapped files, works on the raw bytes without copying them into strings
+
+    struct MappedStatement
+    {
+        enum Type { useMaterial, group };
+
+        Type type;
+        size_t numFacesBefore;  // faces of the same chunk that come before the statement
+        String argument;
+    };
+
+    // everything found in a range of lines, faces refer to the vertices and normals of the whole file
+    struct MappedChunk
+    {
+        const char* start = nullptr;
+        const char* end = nullptr;
+
+        std::vector<glm::vec3> vertices, normals;
+        std::vector<TripleIndex> triples;
+        std::vector<size_t> faceEnds;   // end of each face in triples
+        std::vector<MappedStatement> statements;
+    };
+
+    static bool isSpace (char c) noexcept                { return c == ' ' || c == '\t' || c == '\v' || c == '\f'; }
+    static bool isDigit (char c) noexcept                { return c >= '0' && c <= '9'; }
+
+    static const char* skipSpace (const char* t, const char* end) noexcept
+    {
+        while (t < end && isSpace (*t))
+            ++t;
+
+        return t;
+    }
+
+    static bool matchToken (const char*& t, const char* end, const char* token) noexcept
+    {
+        auto len = (size_t) strlen (token);
+
+        if ((size_t) (end - t) < len || memcmp (t, token, len) != 0)
+            return false;
+
+        if (t + len < end && ! isSpace (t[len]))
+            return false;
+
+        t = skipSpace (t + len, end);
+        return true;
+    }
+
+    static int parseInt (const char*& t, const char* end) noexcept
+    {
+        bool negative = false;
+
+        if (t < end && (*t == '-' || *t == '+'))
+            negative = (*t++ == '-');
+
+        int value = 0;
+
+        while (t < end && isDigit (*t))
+            value = value * 10 + (*t++ - '0');
+
+        return negative ? -value : value;
+    }
+
+    /**
+     * Reads a decimal number, accumulating up to 19 significant digits in an integer and scaling it
+     * by a power of ten once. Precise enough for coordinates and much faster than the locale aware parsers.
+     */
+    static float parseFastFloat (const char*& t, const char* end) noexcept
+    {
+        static constexpr double powersOfTen[] = { 1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+        t = skipSpace (t, end);
+
+        bool negative = false;
+
+        if (t < end && (*t == '-' || *t == '+'))
+            negative = (*t++ == '-');
+
+        juce::uint64 mantissa = 0;
+        int numDigits = 0;
+        int exponent = 0;
+
+        for (; t < end && isDigit (*t); ++t)
+        {
+            if (numDigits < 19) { mantissa = mantissa * 10 + (juce::uint64) (*t - '0'); if (mantissa != 0) ++numDigits; }
+            else                { ++exponent; }
+        }
+
+        if (t < end && *t == '.')
+        {
+            for (++t; t < end && isDigit (*t); ++t)
+            {
+                if (numDigits < 19) { mantissa = mantissa * 10 + (juce::uint64) (*t - '0'); if (mantissa != 0) ++numDigits; --exponent; }
+            }
+        }
+
+        if (t < end && (*t == 'e' || *t == 'E'))
+        {
+            ++t;
+            exponent += parseInt (t, end);
+        }
+
+        auto value = (double) mantissa;
+
+        if (mantissa != 0 && exponent != 0)
+        {
+            if (exponent > 0 && exponent <= 22)        value *= powersOfTen[exponent];
+            else if (exponent < 0 && exponent >= -22)  value /= powersOfTen[-exponent];
+            else                                       value *= std::pow (10.0, (double) exponent);
+        }
+
+        return (float) (negative ? -value : value);
+    }
+
+    static glm::vec3 parseFastVector (const char* t, const char* end) noexcept
+    {
+        glm::vec3 v;
+        v.x = parseFastFloat (t, end);
+        v.y = parseFastFloat (t, end);
+        v.z = parseFastFloat (t, end);
+        return v;
+    }
+
+    static const char* findEndOfFaceToken (const char* t, const char* end) noexcept
+    {
+        while (t < end && *t != '/' && ! isSpace (*t))
+            ++t;
+
+        return t;
+    }
+
+    static TripleIndex parseFastTriple (const char*& t, const char* end) noexcept
+    {
+        TripleIndex i;
+
+        i.vertexIndex = parseInt (t, end) - 1;
+        t = findEndOfFaceToken (t, end);
+
+        if (t == end || *t++ != '/')
+            return i;
+
+        // a file may end right after the slash, so every lookahead checks the end first
+        if (t < end && *t == '/')
+        {
+            ++t;
+        }
+        else
+        {
+            i.textureIndex = parseInt (t, end) - 1;
+            t = findEndOfFaceToken (t, end);
+
+            if (t == end || *t++ != '/')
+                return i;
+        }
+
+        i.normalIndex = parseInt (t, end) - 1;
+        t = findEndOfFaceToken (t, end);
+        return i;
+    }
+
+    static void parseMappedChunk (MappedChunk& chunk)
+    {
+        for (auto* line = chunk.start; line < chunk.end;)
+        {
+            auto* lineEnd = line;
+
+            while (lineEnd < chunk.end && *lineEnd != '\n' && *lineEnd != '\r')
+                ++lineEnd;
+
+            auto* l = skipSpace (line, lineEnd);
+            line = lineEnd < chunk.end ? lineEnd + 1 : chunk.end;
+
+            if (matchToken (l, lineEnd, "v"))   { chunk.vertices.push_back (parseFastVector (l, lineEnd)); continue; }
+            if (matchToken (l, lineEnd, "vn"))  { chunk.normals .push_back (parseFastVector (l, lineEnd)); continue; }
+
+            if (matchToken (l, lineEnd, "f"))
+            {
+                for (l = skipSpace (l, lineEnd); l < lineEnd; l = skipSpace (l, lineEnd))
+                    chunk.triples.push_back (parseFastTriple (l, lineEnd));
+
+                chunk.faceEnds.push_back (chunk.triples.size());
+                continue;
+            }
+
+            if (matchToken (l, lineEnd, "usemtl"))
+            {
+                chunk.statements.push_back ({ MappedStatement::useMaterial, chunk.faceEnds.size(),
+                                              String::fromUTF8 (l, (int) (lineEnd - l)).trim() });
+                continue;
+            }
+
+            if (matchToken (l, lineEnd, "g") || matchToken (l, lineEnd, "o"))
+            {
+                auto* nameEnd = l;
+
+                while (nameEnd < lineEnd && ! isSpace (*nameEnd))
+                    ++nameEnd;
+
+                chunk.statements.push_back ({ MappedStatement::group, chunk.faceEnds.size(),
+                                              String::fromUTF8 (l, (int) (nameEnd - l)) });
+                continue;
+            }
+        }
+    }
+
+    Result parseMappedObjFile (const char* data, size_t size)
+    {
+        auto* end = data + size;
+
+        // skip the byte order mark
+        if (size >= 3 && memcmp (data, "\xEF\xBB\xBF", 3) == 0)
+            data += 3;
+
+        // split at line breaks into chunks of at least a few megabytes, one per core
+        static constexpr size_t minimumChunkSize = 4 * 1024 * 1024;
+        auto const numChunks = (size_t) jlimit (1, jmax (1, (int) std::thread::hardware_concurrency()), (int) ((size_t) (end - data) / minimumChunkSize));
+
+        std::vector<MappedChunk> chunks (numChunks);
+        auto* chunkStart = data;
+
+        for (size_t chunkNum = 0; chunkNum < numChunks; ++chunkNum)
+        {
+            auto* chunkEnd = chunkNum + 1 == numChunks ? end : jmax (chunkStart, data + (size_t) (end - data) * (chunkNum + 1) / numChunks);
+
+            while (chunkEnd < end && *chunkEnd != '\n')
+                ++chunkEnd;
+
+            chunks[chunkNum].start = chunkStart;
+            chunks[chunkNum].end = chunkEnd;
+            chunkStart = chunkEnd;
+        }
+
+        std::vector<std::thread> workers;
+
+        for (size_t chunkNum = 1; chunkNum < numChunks; ++chunkNum)
+            workers.emplace_back ([&chunks, chunkNum] { parseMappedChunk (chunks[chunkNum]); });
+
+        parseMappedChunk (chunks[0]);
+
+        for (auto& worker : workers)
+            worker.join();
+
+        // vertex and normal indices are global, so all of them have to be known before the faces are resolved
+        Mesh mesh;
+        size_t numVertices = 0, numNormals = 0;
+
+        for (const auto& chunk : chunks)
+        {
+            numVertices += chunk.vertices.size();
+            numNormals  += chunk.normals.size();
+        }
+
+        mesh.vertices.reserve (numVertices);
+        mesh.normals.reserve (numNormals);
+
+        for (auto& chunk : chunks)
+        {
+            mesh.vertices.insert (mesh.vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+            mesh.normals .insert (mesh.normals .end(), chunk.normals .begin(), chunk.normals .end());
+            std::vector<glm::vec3>().swap (chunk.vertices);
+            std::vector<glm::vec3>().swap (chunk.normals);
+        }
+
+        // same grouping as parseObjFile, the material that is active at the end of a group applies to all of it
+        std::unique_ptr<Shape> shape (new Shape());
+        IndexMap indexMap;
+        Material lastMaterial;
+        String lastName;
+
+        auto finishShape = [&]
+        {
+            if (! shape->surfaces.empty())
+            {
+                shape->name = lastName;
+                shape->material = lastMaterial;
+                shape->materialProperties = parseMaterialProperties (lastMaterial.name.getCharPointer());
+                shapes.push_back (shape.release());
+                shape.reset (new Shape());
+            }
+
+            indexMap.map.clear();
+        };
+
+        for (const auto& chunk : chunks)
+        {
+            size_t statementNum = 0;
+            size_t faceStart = 0;
+
+            for (size_t faceNum = 0; faceNum <= chunk.faceEnds.size(); ++faceNum)
+            {
+                for (; statementNum < chunk.statements.size() && chunk.statements[statementNum].numFacesBefore == faceNum; ++statementNum)
+                {
+                    const auto& statement = chunk.statements[statementNum];
+
+                    if (statement.type == MappedStatement::useMaterial)
+                    {
+                        lastMaterial = { statement.argument };
+                    }
+                    else
+                    {
+                        finishShape();
+                        lastName = statement.argument;
+                    }
+                }
+
+                if (faceNum == chunk.faceEnds.size())
+                    break;
+
+                addFace (*shape, chunk.triples.data() + faceStart, (int) (chunk.faceEnds[faceNum] - faceStart), mesh, indexMap);
+                faceStart = chunk.faceEnds[faceNum];
+            }
+        }
+
+        finishShape();
+
+        return Result::ok();
+    }
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WavefrontObjFile)
 };